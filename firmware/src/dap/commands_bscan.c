@@ -0,0 +1,140 @@
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/ring_buffer.h>
+
+#include "dap/dap.h"
+#include "util.h"
+
+LOG_MODULE_DECLARE(dap, CONFIG_DAP_LOG_LEVEL);
+
+/* scans one vector through the boundary register of the device at the current index, returning true if the
+ * captured cells differ from expect anywhere the mask is set, with nothing compared if expect is NULL */
+static bool bscan_shift(
+    struct dap_driver *dap,
+    const uint8_t *drive,
+    const uint8_t *expect,
+    const uint8_t *mask,
+    uint16_t bits
+) {
+    bool failed = false;
+    uint8_t after_index = dap->jtag.count - dap->jtag.index - 1;
+
+    jtag_goto_state(dap, jtag_state_shift_dr);
+
+    /* bypass for every tap before the current index */
+    gpio_pin_set_dt(&dap->io.tdi, 1);
+    for (uint8_t i = 0; i < dap->jtag.index; i++) {
+        jtag_tck_cycle(dap);
+    }
+
+    /* a word at a time, so each is compared without holding the whole captured register */
+    for (uint16_t offset = 0; offset < bits; offset += 32) {
+        uint8_t word_bits = MIN(bits - offset, 32);
+        uint8_t captured[4] = {0};
+        if (offset + word_bits == bits && after_index == 0) {
+            /* last register bit, then exit-1-dr */
+            swj_shift(dap, &dap->io.tdi, &drive[offset / 8], &dap->io.tdo, captured, word_bits - 1);
+            uint8_t last = word_bits - 1;
+            gpio_pin_set_dt(&dap->io.tms_swdio, 1);
+            captured[last / 8] |= jtag_tdio_cycle(dap, drive[(offset + last) / 8] >> (last % 8)) << (last % 8);
+        } else {
+            swj_shift(dap, &dap->io.tdi, &drive[offset / 8], &dap->io.tdo, captured, word_bits);
+        }
+
+        if (expect == NULL) continue;
+        for (uint8_t i = 0; i < DIV_ROUND_UP(word_bits, 8); i++) {
+            if (((captured[i] ^ expect[offset / 8 + i]) & mask[offset / 8 + i]) != 0) failed = true;
+        }
+    }
+
+    if (after_index > 0) {
+        /* bypass after index, the last one then exit-1-dr */
+        gpio_pin_set_dt(&dap->io.tdi, 1);
+        for (uint8_t i = 0; i < after_index - 1; i++) {
+            jtag_tck_cycle(dap);
+        }
+        gpio_pin_set_dt(&dap->io.tms_swdio, 1);
+        jtag_tck_cycle(dap);
+    }
+
+    /* vectors follow each other straight from update-dr, without passing through idle */
+    dap->jtag.state = jtag_state_exit1_dr;
+    jtag_goto_state(dap, jtag_state_update_dr);
+    return failed;
+}
+
+int32_t dap_handle_cmd_vendor_bscan_upload(struct dap_driver *dap) {
+    uint16_t offset = 0;
+    if (ring_buf_get_le16(&dap->buf.request, &offset) < 0) return -EMSGSIZE;
+    uint16_t len = 0;
+    if (ring_buf_get_le16(&dap->buf.request, &len) < 0) return -EMSGSIZE;
+
+    uint8_t status = dap_cmd_response_ok;
+    if (offset + len > DAP_BSCAN_SIZE) {
+        status = dap_cmd_response_error;
+        /* process remaining request bytes */
+        uint8_t *temp = NULL;
+        if (ring_buf_get_claim(&dap->buf.request, &temp, len) != len) return -EMSGSIZE;
+        if (ring_buf_get_finish(&dap->buf.request, len) < 0) return -EMSGSIZE;
+    } else if (ring_buf_get(&dap->buf.request, &dap->bscan.vectors[offset], len) != len) {
+        return -EMSGSIZE;
+    }
+
+    uint8_t response[] = {dap_cmd_vendor_bscan_upload, status};
+    if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_bscan_run(struct dap_driver *dap) {
+    uint8_t status = dap_cmd_response_ok;
+    uint16_t failed = 0;
+    uint8_t bitmap[DIV_ROUND_UP(DAP_BSCAN_SIZE / 3, 8)] = {0};
+
+    uint8_t index = 0;
+    if (ring_buf_get(&dap->buf.request, &index, 1) != 1) return -EMSGSIZE;
+    uint16_t bits = 0;
+    if (ring_buf_get_le16(&dap->buf.request, &bits) < 0) return -EMSGSIZE;
+    uint32_t sample_ir = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &sample_ir) < 0) return -EMSGSIZE;
+    uint32_t extest_ir = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &extest_ir) < 0) return -EMSGSIZE;
+    uint16_t count = 0;
+    if (ring_buf_get_le16(&dap->buf.request, &count) < 0) return -EMSGSIZE;
+
+    /* every vector is the cells to drive, the values expected back, and which of them to compare */
+    uint16_t len = DIV_ROUND_UP(bits, 8);
+    if (dap->swj.port != dap_port_jtag || index >= dap->jtag.count || bits == 0 || count == 0 ||
+        (uint32_t) count * len * 3 > DAP_BSCAN_SIZE) {
+        status = dap_cmd_response_error;
+        count = 0;
+        goto end;
+    }
+    dap->jtag.index = index;
+    const uint8_t *vectors = dap->bscan.vectors;
+
+    /* the first vector is preloaded, so the pins start out driven with it as soon as extest is selected */
+    jtag_set_ir(dap, sample_ir);
+    bscan_shift(dap, vectors, NULL, NULL, bits);
+    jtag_set_ir(dap, extest_ir);
+
+    /* each scan captures the response to the vector already applied while shifting in the next one, with the last
+     * shifted in again to capture its own response without changing the pins */
+    for (uint16_t i = 0; i < count; i++) {
+        const uint8_t *vector = &vectors[i * len * 3];
+        const uint8_t *next = i + 1 < count ? &vector[len * 3] : vector;
+        if (bscan_shift(dap, next, &vector[len], &vector[len * 2], bits)) {
+            bitmap[i / 8] |= BIT(i % 8);
+            failed++;
+        }
+    }
+
+end: ;
+    uint8_t response[] = {dap_cmd_vendor_bscan_run, status, 0, 0};
+    sys_put_le16(failed, &response[2]);
+    if (ring_buf_put(&dap->buf.response, response, sizeof(response)) != sizeof(response)) return -ENOBUFS;
+    uint16_t bitmap_len = DIV_ROUND_UP(count, 8);
+    if (ring_buf_put(&dap->buf.response, bitmap, bitmap_len) != bitmap_len) return -ENOBUFS;
+    return 0;
+}
@@ -0,0 +1,320 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/ring_buffer.h>
+
+#include "dap/dap.h"
+#include "util.h"
+
+LOG_MODULE_DECLARE(dap, CONFIG_DAP_LOG_LEVEL);
+
+/* core register selectors set up for every algorithm call, the four arguments, static base, stack
+ * pointer, link register, program counter and xpsr */
+static const uint8_t flash_call_regsel[] = {0, 1, 2, 3, 9, 13, 14, 15, 16};
+/* thumb state bit of the xpsr, the only state an algorithm is started with */
+static const uint32_t xpsr_thumb = 0x01000000;
+
+static uint8_t flash_halt(struct dap_driver *dap) {
+    uint32_t halt = dhcsr_dbgkey | dhcsr_c_debugen | dhcsr_c_halt;
+    uint8_t ack = mem_write(dap, dap->flash.ap, dhcsr, &halt, 1);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    k_timepoint_t end = sys_timepoint_calc(K_MSEC(dap->flash.timeout_ms));
+    uint32_t status = 0;
+    do {
+        ack = mem_read(dap, dap->flash.ap, dhcsr, &status, 1);
+        if (ack != transfer_response_ack_ok) return ack;
+        if ((status & dhcsr_s_halt) != 0) return ack;
+    } while (!sys_timepoint_expired(end));
+    return transfer_response_ack_wait;
+}
+
+/* starts an algorithm function on the halted core, which returns to the breakpoint and halts again */
+static uint8_t flash_call_start(struct dap_driver *dap, uint32_t pc, const uint32_t *args) {
+    uint32_t values[] = {
+        args[0], args[1], args[2], args[3], dap->flash.static_base, dap->flash.stack_pointer,
+        dap->flash.breakpoint | 0x01, pc, xpsr_thumb,
+    };
+    uint32_t completed = 0;
+    uint8_t ack = core_reg_write(dap, dap->flash.ap, flash_call_regsel, values, ARRAY_SIZE(values), &completed);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    /* interrupts stay masked, the target's own handlers have no business running during an algorithm */
+    uint32_t run = dhcsr_dbgkey | dhcsr_c_debugen | dhcsr_c_maskints;
+    return mem_write(dap, dap->flash.ap, dhcsr, &run, 1);
+}
+
+/* waits for a running algorithm function to halt on its breakpoint, an algorithm that never returns is
+ * halted and reported as a wait */
+static uint8_t flash_call_wait(struct dap_driver *dap, uint32_t *result) {
+    k_timepoint_t end = sys_timepoint_calc(K_MSEC(dap->flash.timeout_ms));
+    uint32_t status = 0;
+    uint8_t ack = transfer_response_ack_ok;
+    do {
+        ack = mem_read(dap, dap->flash.ap, dhcsr, &status, 1);
+        if (ack != transfer_response_ack_ok) return ack;
+        if ((status & dhcsr_s_halt) != 0) break;
+    } while (!sys_timepoint_expired(end));
+
+    if ((status & dhcsr_s_halt) == 0) {
+        ack = flash_halt(dap);
+        return ack == transfer_response_ack_ok ? transfer_response_ack_wait : ack;
+    }
+
+    const uint8_t regsel_r0 = 0;
+    uint32_t completed = 0;
+    return core_reg_read(dap, dap->flash.ap, &regsel_r0, result, 1, &completed);
+}
+
+static void flash_fail_state(struct dap_driver *dap, uint8_t ack, uint32_t result, uint32_t address) {
+    LOG_ERR("flash algorithm failed at 0x%x, transfer response 0x%x result 0x%x", address, ack, result);
+    dap->flash.state = dap_flash_state_error;
+    dap->flash.ack = ack;
+    dap->flash.result = result;
+    dap->flash.error_address = address;
+}
+
+/* commands only get this far once flash_command_begin found no sticky errors, so any flagged now are from the
+ * runner's own accesses */
+static void flash_fail(struct dap_driver *dap, uint8_t ack, uint32_t result, uint32_t address) {
+    flash_fail_state(dap, ack, result, address);
+    dp_clear_errors(dap);
+}
+
+/* a sticky error flagged before a command is from the host's accesses, so the command fails without touching
+ * the target, leaving the error for the host to find */
+static bool flash_command_begin(struct dap_driver *dap) {
+    uint8_t ack = dp_check_errors(dap);
+    if (ack != transfer_response_ack_ok) {
+        flash_fail_state(dap, ack, 0, dap->flash.address);
+        return false;
+    }
+    return true;
+}
+
+/* waits for the page being programmed, returns false if it failed */
+static bool flash_page_wait(struct dap_driver *dap) {
+    if (!dap->flash.busy) return true;
+    dap->flash.busy = false;
+
+    uint32_t result = 0;
+    uint8_t ack = flash_call_wait(dap, &result);
+    if (ack != transfer_response_ack_ok || result != 0) {
+        flash_fail(dap, ack, result, dap->flash.busy_address);
+        return false;
+    }
+    return true;
+}
+
+/* starts programming the filled page buffer, and moves on to filling the other buffer meanwhile */
+static bool flash_page_program(struct dap_driver *dap) {
+    if (!flash_page_wait(dap)) return false;
+
+    uint32_t args[] = {dap->flash.address, dap->flash.page_size, dap->flash.buffers[dap->flash.buffer], 0};
+    uint8_t ack = flash_call_start(dap, dap->flash.program_page, args);
+    if (ack != transfer_response_ack_ok) {
+        flash_fail(dap, ack, 0, dap->flash.address);
+        return false;
+    }
+
+    dap->flash.busy = true;
+    dap->flash.busy_address = dap->flash.address;
+    dap->flash.address += dap->flash.page_size;
+    dap->flash.buffer ^= 1;
+    dap->flash.offset = 0;
+    return true;
+}
+
+/* pads out and programs a partially filled page, then waits for every page to finish */
+static bool flash_flush(struct dap_driver *dap) {
+    if (dap->flash.offset > 0) {
+        /* padding is written to target ram a chunk at a time */
+        uint8_t pad[64];
+        memset(pad, dap->flash.erased, sizeof(pad));
+        while (dap->flash.offset < dap->flash.page_size) {
+            uint32_t chunk = MIN(dap->flash.page_size - dap->flash.offset, sizeof(pad));
+            uint32_t addr = dap->flash.buffers[dap->flash.buffer] + dap->flash.offset;
+            uint8_t ack = mem_write_bytes(dap, dap->flash.ap, addr, pad, chunk);
+            if (ack != transfer_response_ack_ok) {
+                flash_fail(dap, ack, 0, dap->flash.address);
+                return false;
+            }
+            dap->flash.offset += chunk;
+        }
+        if (!flash_page_program(dap)) return false;
+    }
+    return flash_page_wait(dap);
+}
+
+/* every flash command responds with the runner state, followed by the last failure, or with the next
+ * flash address to be programmed if nothing has failed */
+static int32_t flash_respond(struct dap_driver *dap, uint8_t command, uint8_t status) {
+    bool failed = dap->flash.state == dap_flash_state_error;
+    uint8_t response[] = {command, status, dap->flash.state, failed ? dap->flash.ack : transfer_response_ack_ok};
+    if (ring_buf_put(&dap->buf.response, response, sizeof(response)) != sizeof(response)) return -ENOBUFS;
+    if (ring_buf_put_le32(&dap->buf.response, dap->flash.result) < 0) return -ENOBUFS;
+    uint32_t address = failed ? dap->flash.error_address : dap->flash.address;
+    if (ring_buf_put_le32(&dap->buf.response, address) < 0) return -ENOBUFS;
+    return 0;
+}
+
+/* the host's AP selection is put back after each command, while an algorithm may still be running */
+static void flash_command_finish(struct dap_driver *dap) {
+    uint8_t ack = mem_command_finish(dap, transfer_response_ack_ok);
+    if (ack != transfer_response_ack_ok && dap->flash.state == dap_flash_state_running) {
+        flash_fail(dap, ack, 0, dap->flash.address);
+    }
+}
+
+void flash_reset(struct dap_driver *dap) {
+    dap->flash.state = dap_flash_state_stopped;
+    dap->flash.busy = false;
+    dap->flash.offset = 0;
+    dap->flash.buffer = 0;
+    dap->flash.ack = transfer_response_ack_ok;
+    dap->flash.result = 0;
+    dap->flash.error_address = 0;
+}
+
+int32_t dap_handle_cmd_vendor_flash_control(struct dap_driver *dap) {
+    uint8_t status = dap_cmd_response_ok;
+
+    /* control values */
+    const uint8_t control_stop = 0x00;
+    const uint8_t control_start = 0x01;
+    const uint8_t control_call = 0x02;
+    const uint8_t control_flush = 0x03;
+
+    uint8_t control = 0;
+    if (ring_buf_get(&dap->buf.request, &control, 1) != 1) return -EMSGSIZE;
+
+    if (control == control_stop) {
+        /* an algorithm still running is halted, any unflushed page data is dropped */
+        if (dap->flash.state != dap_flash_state_stopped && dap->swj.port != dap_port_disabled &&
+            dp_check_errors(dap) == transfer_response_ack_ok) {
+            flash_halt(dap);
+            flash_command_finish(dap);
+        }
+        flash_reset(dap);
+    } else if (control == control_start) {
+        uint8_t ap = 0;
+        if (ring_buf_get(&dap->buf.request, &ap, 1) != 1) return -EMSGSIZE;
+        uint8_t erased = 0;
+        if (ring_buf_get(&dap->buf.request, &erased, 1) != 1) return -EMSGSIZE;
+        uint32_t config[9];
+        for (uint8_t i = 0; i < ARRAY_SIZE(config); i++) {
+            if (ring_buf_get_le32(&dap->buf.request, &config[i]) < 0) return -EMSGSIZE;
+        }
+        uint32_t page_size = config[6];
+        uint32_t timeout_ms = config[8];
+        if (page_size == 0 || timeout_ms == 0 || dap->swj.port == dap_port_disabled ||
+            dap->flash.state == dap_flash_state_running) {
+            status = dap_cmd_response_error;
+            goto end;
+        }
+
+        flash_reset(dap);
+        dap->flash.ap = ap;
+        dap->flash.erased = erased;
+        dap->flash.program_page = config[0];
+        dap->flash.static_base = config[1];
+        dap->flash.stack_pointer = config[2];
+        dap->flash.breakpoint = config[3];
+        dap->flash.buffers[0] = config[4];
+        dap->flash.buffers[1] = config[5];
+        dap->flash.page_size = page_size;
+        dap->flash.address = config[7];
+        dap->flash.timeout_ms = timeout_ms;
+
+        /* algorithm calls can only be set up on a halted core */
+        dap->flash.state = dap_flash_state_running;
+        if (!flash_command_begin(dap)) goto end;
+        uint8_t ack = flash_halt(dap);
+        if (ack != transfer_response_ack_ok) {
+            flash_fail(dap, ack, 0, dap->flash.address);
+        }
+        flash_command_finish(dap);
+    } else if (control == control_call) {
+        uint32_t pc = 0;
+        if (ring_buf_get_le32(&dap->buf.request, &pc) < 0) return -EMSGSIZE;
+        uint32_t args[4];
+        for (uint8_t i = 0; i < ARRAY_SIZE(args); i++) {
+            if (ring_buf_get_le32(&dap->buf.request, &args[i]) < 0) return -EMSGSIZE;
+        }
+        if (dap->flash.state != dap_flash_state_running || dap->swj.port == dap_port_disabled) {
+            status = dap_cmd_response_error;
+            goto end;
+        }
+
+        if (!flash_command_begin(dap)) goto end;
+        /* init, erase and uninit functions return their result to the host, which decides what failed */
+        if (flash_page_wait(dap)) {
+            uint8_t ack = flash_call_start(dap, pc, args);
+            if (ack == transfer_response_ack_ok) {
+                ack = flash_call_wait(dap, &dap->flash.result);
+            }
+            if (ack != transfer_response_ack_ok) {
+                flash_fail(dap, ack, 0, dap->flash.address);
+            }
+        }
+        flash_command_finish(dap);
+    } else if (control == control_flush) {
+        if (dap->flash.state != dap_flash_state_running || dap->swj.port == dap_port_disabled) {
+            status = dap_cmd_response_error;
+            goto end;
+        }
+        if (!flash_command_begin(dap)) goto end;
+
+        flash_flush(dap);
+        flash_command_finish(dap);
+    } else {
+        status = dap_cmd_response_error;
+    }
+
+end:
+    if (dap->flash.state == dap_flash_state_error) {
+        status = dap_cmd_response_error;
+    }
+    return flash_respond(dap, dap_cmd_vendor_flash_control, status);
+}
+
+int32_t dap_handle_cmd_vendor_flash_data(struct dap_driver *dap) {
+    uint8_t status = dap_cmd_response_ok;
+
+    uint16_t len = 0;
+    if (ring_buf_get_le16(&dap->buf.request, &len) < 0) return -EMSGSIZE;
+
+    /* the data is written straight out of the request buffer */
+    uint8_t *data = NULL;
+    if (ring_buf_get_claim(&dap->buf.request, &data, len) != len) return -EMSGSIZE;
+
+    if (dap->flash.state != dap_flash_state_running || dap->swj.port == dap_port_disabled) {
+        status = dap_cmd_response_error;
+        goto end;
+    }
+    if (!flash_command_begin(dap)) goto end;
+
+    /* each page is programmed as soon as it fills, while the rest of the data goes to the other buffer */
+    uint32_t written = 0;
+    while (written < len) {
+        uint32_t chunk = MIN(len - written, dap->flash.page_size - dap->flash.offset);
+        uint32_t addr = dap->flash.buffers[dap->flash.buffer] + dap->flash.offset;
+        uint8_t ack = mem_write_bytes(dap, dap->flash.ap, addr, &data[written], chunk);
+        if (ack != transfer_response_ack_ok) {
+            flash_fail(dap, ack, 0, dap->flash.address);
+            break;
+        }
+        written += chunk;
+        dap->flash.offset += chunk;
+
+        if (dap->flash.offset == dap->flash.page_size && !flash_page_program(dap)) break;
+    }
+    flash_command_finish(dap);
+
+end:
+    if (ring_buf_get_finish(&dap->buf.request, len) < 0) return -EMSGSIZE;
+    if (dap->flash.state == dap_flash_state_error) {
+        status = dap_cmd_response_error;
+    }
+    return flash_respond(dap, dap_cmd_vendor_flash_data, status);
+}
@@ -182,6 +182,7 @@ int32_t dap_handle_cmd_connect(struct dap_driver *dap) {
 
     /* signifies a failed port initialization */
     uint8_t response_port = 0;
+    dap_forget_target_state(dap);
     if (gpio_pin_get_dt(&dap->io.vtref) != 1) {
         LOG_ERR("cannot configure dap port with no target voltage");
         goto end;
@@ -231,6 +232,8 @@ int32_t dap_handle_cmd_connect(struct dap_driver *dap) {
         );
         FATAL_CHECK(gpio_pin_configure_dt(&dap->io.tdo, GPIO_INPUT | GPIO_PULL_UP) >= 0, "tdo config failed");
         dap->swj.port = dap_port_jtag;
+        /* the host resets the tap with its own sequences, which end in run-test/idle */
+        dap->jtag.state = jtag_state_run_test_idle;
         response_port = 2;
     } else {
         /* unsupported port, respond with failed initialization */
@@ -247,11 +250,15 @@ end: ;
 int32_t dap_handle_cmd_disconnect(struct dap_driver *dap) {
     uint8_t status = dap_cmd_response_ok;
 
+    /* the tap is left where the next host to connect expects to find it */
+    jtag_settle(dap);
+
     /* disable SWO if it is currently enabled */
     swo_capture_control(dap, false);
     if (dap_configure_pin(&dap->pinctrl.jtag_state_pins) != 0) { status = dap_cmd_response_error; }
 
     dap->swj.port = dap_port_disabled;
+    dap_forget_target_state(dap);
     FATAL_CHECK(gpio_pin_configure_dt(&dap->io.tck_swclk, GPIO_INPUT) >= 0, "tck swclk config failed");
     FATAL_CHECK(gpio_pin_configure_dt(&dap->io.tms_swdio, GPIO_INPUT) >= 0, "tms swdio config failed");
     FATAL_CHECK(gpio_pin_configure_dt(&dap->io.tdo, GPIO_INPUT) >= 0, "tdo config failed");
@@ -267,16 +274,63 @@ int32_t dap_handle_cmd_disconnect(struct dap_driver *dap) {
 int32_t dap_handle_cmd_delay(struct dap_driver *dap) {
     uint16_t delay_us = 0;
     if (ring_buf_get_le16(&dap->buf.request, &delay_us) < 0) return -EMSGSIZE;
-    k_sleep(K_USEC(delay_us));
+    delay_micros(delay_us);
 
     uint8_t response[] = {dap_cmd_delay, dap_cmd_response_ok};
     if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
     return 0;
 }
 
+void swj_nreset_edge(const struct device *port, struct gpio_callback *cb, gpio_port_pins_t pins) {
+    ARG_UNUSED(port);
+    ARG_UNUSED(pins);
+
+    struct dap_driver *dap = CONTAINER_OF(cb, struct dap_driver, swj.nreset.callback);
+    k_sem_give(&dap->swj.nreset.edge);
+}
+
+bool swj_nreset_wait(struct dap_driver *dap, uint8_t level, uint32_t timeout_us) {
+    /* waiting on the edge semaphore rounds up to whole ticks, so waits too short for that are polled instead, just
+     * as delay_micros busy waits for them */
+    if (timeout_us <= k_ticks_to_us_ceil32(1) * 2) {
+        uint32_t start = k_cycle_get_32();
+        uint32_t wait = k_us_to_cyc_ceil32(timeout_us);
+        bool reached = gpio_pin_get_dt(&dap->io.nreset) == level;
+        while (!reached && (k_cycle_get_32() - start) < wait) {
+            /* native posix platforms don't progress time unless sleep functions are called */
+            IF_ENABLED(CONFIG_ARCH_POSIX, (k_busy_wait(1);));
+            reached = gpio_pin_get_dt(&dap->io.nreset) == level;
+        }
+        return reached;
+    }
+
+    k_timepoint_t end = sys_timepoint_calc(K_USEC(timeout_us));
+    k_sem_reset(&dap->swj.nreset.edge);
+    gpio_pin_interrupt_configure_dt(&dap->io.nreset, GPIO_INT_EDGE_BOTH);
+
+    /* the pin is checked after enabling the interrupt, so an edge in between isn't missed, and again after each
+     * edge, since a glitch could have come and gone */
+    bool reached = gpio_pin_get_dt(&dap->io.nreset) == level;
+    while (!reached && k_sem_take(&dap->swj.nreset.edge, sys_timepoint_timeout(end)) == 0) {
+        reached = gpio_pin_get_dt(&dap->io.nreset) == level;
+    }
+
+    gpio_pin_interrupt_configure_dt(&dap->io.nreset, GPIO_INT_DISABLE);
+    return reached;
+}
+
 int32_t dap_handle_cmd_reset_target(struct dap_driver *dap) {
-    /* device specific target reset sequence is not implemented for this debug unit */
-    uint8_t response[] = {dap_cmd_reset_target, dap_cmd_response_ok, 0x00};
+    dap_forget_target_state(dap);
+
+    /* the device specific reset sequence is a script the host sets up beforehand */
+    uint8_t status = dap_cmd_response_ok;
+    uint8_t execute = 0;
+    if (dap->script.reset.entry != DAP_SCRIPT_ENTRY_NONE) {
+        execute = 1;
+        if (!script_reset(dap)) status = dap_cmd_response_error;
+    }
+
+    uint8_t response[] = {dap_cmd_reset_target, status, execute};
     if (ring_buf_put(&dap->buf.response, response, 3) != 3) return -ENOBUFS;
     return 0;
 }
@@ -296,6 +350,11 @@ int32_t dap_handle_cmd_swj_pins(struct dap_driver *dap) {
     uint32_t delay_us = 0;
     if (ring_buf_get_le32(&dap->buf.request, &delay_us) < 0) return -EMSGSIZE;
 
+    /* the host drives the jtag clock expecting the tap in run-test/idle, other pins leave the tap alone */
+    if ((pin_mask & (BIT(pin_swclk_tck_shift) | BIT(pin_swdio_tms_shift))) != 0) {
+        jtag_settle(dap);
+    }
+
     if ((pin_mask & BIT(pin_swclk_tck_shift)) != 0) {
         gpio_pin_set_dt(&dap->io.tck_swclk, (pin_output & BIT(pin_swclk_tck_shift)) == 0 ? 0 : 1);
     }
@@ -313,21 +372,18 @@ int32_t dap_handle_cmd_swj_pins(struct dap_driver *dap) {
     }
     /* ignore nTRST, this debug probe doesn't support it */
 
+    /* driving any pin can disturb the debug port, only reading the pins leaves it alone */
+    if (pin_mask != 0) {
+        dap_forget_target_state(dap);
+    }
+
     /* maximum wait time allowed by command */
     if (delay_us > 3000000) {
         delay_us = 3000000;
     }
     /* all pins expect nreset are push-pull, don't wait on those */
     if ((delay_us > 0) && (pin_mask & BIT(pin_nreset_shift))) {
-        k_timepoint_t delay_end_time = sys_timepoint_calc(K_USEC(delay_us));
-        do {
-            uint32_t nreset_val = gpio_pin_get_dt(&dap->io.nreset);
-            if ((pin_output & BIT(pin_nreset_shift)) ^ (nreset_val << pin_nreset_shift)) {
-                k_busy_wait(1);
-            } else {
-                break;
-            }
-        } while (!sys_timepoint_expired(delay_end_time));
+        swj_nreset_wait(dap, (pin_output >> pin_nreset_shift) & 0x01, delay_us);
     }
 
     uint8_t pin_input =
@@ -356,6 +412,53 @@ int32_t dap_handle_cmd_swj_clock(struct dap_driver *dap) {
     return 0;
 }
 
+void swj_shift(
+    struct dap_driver *dap,
+    const struct gpio_dt_spec *out,
+    const uint8_t *data,
+    const struct gpio_dt_spec *in,
+    uint8_t *capture,
+    uint16_t bits
+) {
+    /* the clock rate can't change during a shift, so the delay is only converted once */
+    uint32_t delay = nanos_to_cycles(dap->swj.delay_ns);
+    /* the output level isn't known going in, so the first bit is always driven */
+    int8_t level = -1;
+
+    for (uint16_t offset = 0; offset < bits; offset += 32) {
+        uint8_t word_bits = MIN(bits - offset, 32);
+        uint8_t word_bytes = DIV_ROUND_UP(word_bits, 8);
+        uint32_t word = 0;
+        for (uint8_t i = 0; i < word_bytes; i++) {
+            word |= (uint32_t) data[offset / 8 + i] << (i * 8);
+        }
+
+        uint32_t sampled = 0;
+        for (uint8_t i = 0; i < word_bits; i++) {
+            int8_t bit = word & 0x01;
+            word >>= 1;
+            /* long runs of the same value, like line resets or bypass fill, only drive the pin once */
+            if (bit != level) {
+                gpio_pin_set_dt(out, bit);
+                level = bit;
+            }
+            gpio_pin_set_dt(&dap->io.tck_swclk, 0);
+            busy_wait_cycles(delay);
+            if (capture != NULL) {
+                sampled |= (uint32_t) (gpio_pin_get_dt(in) & 0x01) << i;
+            }
+            gpio_pin_set_dt(&dap->io.tck_swclk, 1);
+            busy_wait_cycles(delay);
+        }
+
+        if (capture != NULL) {
+            for (uint8_t i = 0; i < word_bytes; i++) {
+                capture[offset / 8 + i] = sampled >> (i * 8);
+            }
+        }
+    }
+}
+
 int32_t dap_handle_cmd_swj_sequence(struct dap_driver *dap) {
     uint16_t count = 0;
     if (ring_buf_get(&dap->buf.request, (uint8_t*) &count, 1) != 1) return -EMSGSIZE;
@@ -363,18 +466,16 @@ int32_t dap_handle_cmd_swj_sequence(struct dap_driver *dap) {
         count = 256;
     }
 
-    uint8_t tms_swdio_bits = 0;
-    for (uint16_t i = 0; i < count; i++) {
-        if (i % 8 == 0) {
-            if (ring_buf_get(&dap->buf.request, &tms_swdio_bits, 1) != 1) return -EMSGSIZE;
-        }
-        gpio_pin_set_dt(&dap->io.tms_swdio, tms_swdio_bits & 0x01);
-        gpio_pin_set_dt(&dap->io.tck_swclk, 0);
-        busy_wait_nanos(dap->swj.delay_ns);
-        gpio_pin_set_dt(&dap->io.tck_swclk, 1);
-        busy_wait_nanos(dap->swj.delay_ns);
-        tms_swdio_bits >>= 1;
-    }
+    /* any sequence could be a line reset, or a protocol switch */
+    dap_forget_target_state(dap);
+    jtag_settle(dap);
+
+    uint8_t tms_swdio[32] = {0};
+    uint16_t len = DIV_ROUND_UP(count, 8);
+    if (ring_buf_get(&dap->buf.request, tms_swdio, len) != len) return -EMSGSIZE;
+    swj_shift(dap, &dap->io.tms_swdio, tms_swdio, NULL, NULL, count);
+    /* a sequence can leave the tap anywhere, test-logic-reset after a run of ones */
+    jtag_follow_tms(dap, tms_swdio, count);
 
     uint8_t response[] = {dap_cmd_swj_sequence, dap_cmd_response_ok};
     if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
@@ -43,16 +43,122 @@ uint8_t jtag_tdio_cycle(struct dap_driver *dap, uint8_t tdi) {
     return tdo & 0x01;
 }
 
+/* next tap state for tms low and tms high, indexed by the current state */
+static const uint8_t jtag_next_state[16][2] = {
+    {1, 0}, {1, 2}, {3, 9}, {4, 5}, {4, 5}, {6, 8}, {6, 7}, {4, 8},
+    {1, 2}, {10, 0}, {11, 12}, {11, 12}, {13, 15}, {13, 14}, {11, 15}, {1, 2},
+};
+
+/* tms bits, clocked out lsb first, to get from one tap state to another */
+struct jtag_path {
+    uint8_t tms;
+    uint8_t length;
+};
+
+/* shortest tms path between every pair of tap states, indexed by the current then the desired state */
+static const struct jtag_path jtag_paths[16][16] = {
+    /* test-logic-reset */
+    {{0x00, 0}, {0x00, 1}, {0x02, 2}, {0x02, 3}, {0x02, 4}, {0x0a, 4}, {0x0a, 5}, {0x2a, 6},
+     {0x1a, 5}, {0x06, 3}, {0x06, 4}, {0x06, 5}, {0x16, 5}, {0x16, 6}, {0x56, 7}, {0x36, 6}},
+    /* run-test/idle */
+    {{0x07, 3}, {0x00, 0}, {0x01, 1}, {0x01, 2}, {0x01, 3}, {0x05, 3}, {0x05, 4}, {0x15, 5},
+     {0x0d, 4}, {0x03, 2}, {0x03, 3}, {0x03, 4}, {0x0b, 4}, {0x0b, 5}, {0x2b, 6}, {0x1b, 5}},
+    /* select-dr-scan */
+    {{0x03, 2}, {0x03, 3}, {0x00, 0}, {0x00, 1}, {0x00, 2}, {0x02, 2}, {0x02, 3}, {0x0a, 4},
+     {0x06, 3}, {0x01, 1}, {0x01, 2}, {0x01, 3}, {0x05, 3}, {0x05, 4}, {0x15, 5}, {0x0d, 4}},
+    /* capture-dr */
+    {{0x1f, 5}, {0x03, 3}, {0x07, 3}, {0x00, 0}, {0x00, 1}, {0x01, 1}, {0x01, 2}, {0x05, 3},
+     {0x03, 2}, {0x0f, 4}, {0x0f, 5}, {0x0f, 6}, {0x2f, 6}, {0x2f, 7}, {0xaf, 8}, {0x6f, 7}},
+    /* shift-dr */
+    {{0x1f, 5}, {0x03, 3}, {0x07, 3}, {0x07, 4}, {0x00, 0}, {0x01, 1}, {0x01, 2}, {0x05, 3},
+     {0x03, 2}, {0x0f, 4}, {0x0f, 5}, {0x0f, 6}, {0x2f, 6}, {0x2f, 7}, {0xaf, 8}, {0x6f, 7}},
+    /* exit1-dr */
+    {{0x0f, 4}, {0x01, 2}, {0x03, 2}, {0x03, 3}, {0x02, 3}, {0x00, 0}, {0x00, 1}, {0x02, 2},
+     {0x01, 1}, {0x07, 3}, {0x07, 4}, {0x07, 5}, {0x17, 5}, {0x17, 6}, {0x57, 7}, {0x37, 6}},
+    /* pause-dr */
+    {{0x1f, 5}, {0x03, 3}, {0x07, 3}, {0x07, 4}, {0x01, 2}, {0x05, 3}, {0x00, 0}, {0x01, 1},
+     {0x03, 2}, {0x0f, 4}, {0x0f, 5}, {0x0f, 6}, {0x2f, 6}, {0x2f, 7}, {0xaf, 8}, {0x6f, 7}},
+    /* exit2-dr */
+    {{0x0f, 4}, {0x01, 2}, {0x03, 2}, {0x03, 3}, {0x00, 1}, {0x02, 2}, {0x02, 3}, {0x00, 0},
+     {0x01, 1}, {0x07, 3}, {0x07, 4}, {0x07, 5}, {0x17, 5}, {0x17, 6}, {0x57, 7}, {0x37, 6}},
+    /* update-dr */
+    {{0x07, 3}, {0x00, 1}, {0x01, 1}, {0x01, 2}, {0x01, 3}, {0x05, 3}, {0x05, 4}, {0x15, 5},
+     {0x00, 0}, {0x03, 2}, {0x03, 3}, {0x03, 4}, {0x0b, 4}, {0x0b, 5}, {0x2b, 6}, {0x1b, 5}},
+    /* select-ir-scan */
+    {{0x01, 1}, {0x01, 2}, {0x05, 3}, {0x05, 4}, {0x05, 5}, {0x15, 5}, {0x15, 6}, {0x55, 7},
+     {0x35, 6}, {0x00, 0}, {0x00, 1}, {0x00, 2}, {0x02, 2}, {0x02, 3}, {0x0a, 4}, {0x06, 3}},
+    /* capture-ir */
+    {{0x1f, 5}, {0x03, 3}, {0x07, 3}, {0x07, 4}, {0x07, 5}, {0x17, 5}, {0x17, 6}, {0x57, 7},
+     {0x37, 6}, {0x0f, 4}, {0x00, 0}, {0x00, 1}, {0x01, 1}, {0x01, 2}, {0x05, 3}, {0x03, 2}},
+    /* shift-ir */
+    {{0x1f, 5}, {0x03, 3}, {0x07, 3}, {0x07, 4}, {0x07, 5}, {0x17, 5}, {0x17, 6}, {0x57, 7},
+     {0x37, 6}, {0x0f, 4}, {0x0f, 5}, {0x00, 0}, {0x01, 1}, {0x01, 2}, {0x05, 3}, {0x03, 2}},
+    /* exit1-ir */
+    {{0x0f, 4}, {0x01, 2}, {0x03, 2}, {0x03, 3}, {0x03, 4}, {0x0b, 4}, {0x0b, 5}, {0x2b, 6},
+     {0x1b, 5}, {0x07, 3}, {0x07, 4}, {0x02, 3}, {0x00, 0}, {0x00, 1}, {0x02, 2}, {0x01, 1}},
+    /* pause-ir */
+    {{0x1f, 5}, {0x03, 3}, {0x07, 3}, {0x07, 4}, {0x07, 5}, {0x17, 5}, {0x17, 6}, {0x57, 7},
+     {0x37, 6}, {0x0f, 4}, {0x0f, 5}, {0x01, 2}, {0x05, 3}, {0x00, 0}, {0x01, 1}, {0x03, 2}},
+    /* exit2-ir */
+    {{0x0f, 4}, {0x01, 2}, {0x03, 2}, {0x03, 3}, {0x03, 4}, {0x0b, 4}, {0x0b, 5}, {0x2b, 6},
+     {0x1b, 5}, {0x07, 3}, {0x07, 4}, {0x00, 1}, {0x02, 2}, {0x02, 3}, {0x00, 0}, {0x01, 1}},
+    /* update-ir */
+    {{0x07, 3}, {0x00, 1}, {0x01, 1}, {0x01, 2}, {0x01, 3}, {0x05, 3}, {0x05, 4}, {0x15, 5},
+     {0x0d, 4}, {0x03, 2}, {0x03, 3}, {0x03, 4}, {0x0b, 4}, {0x0b, 5}, {0x2b, 6}, {0x00, 0}},
+};
+
+void jtag_goto_state(struct dap_driver *dap, uint8_t state) {
+    const struct jtag_path *path = &jtag_paths[dap->jtag.state][state];
+    uint8_t current = dap->jtag.state;
+    for (uint8_t i = 0; i < path->length; i++) {
+        uint8_t tms = (path->tms >> i) & 0x01;
+        gpio_pin_set_dt(&dap->io.tms_swdio, tms);
+        jtag_tck_cycle(dap);
+
+        /* the shortest paths out of the select states pass through test-logic-reset, which resets every
+         * instruction */
+        current = jtag_next_state[current][tms];
+        if (current == jtag_state_test_logic_reset) jtag_ir_invalidate(dap);
+    }
+    dap->jtag.state = state;
+    dap->jtag.host_placed = false;
+}
+
+void jtag_follow_tms(struct dap_driver *dap, const uint8_t *tms, uint16_t count) {
+    for (uint16_t i = 0; i < count; i++) {
+        dap->jtag.state = jtag_next_state[dap->jtag.state][(tms[i / 8] >> (i % 8)) & 0x01];
+    }
+    dap->jtag.host_placed = true;
+}
+
+void jtag_settle(struct dap_driver *dap) {
+    /* a host sequence can continue from wherever the last one left off, only the probe's own scans are undone */
+    if (dap->swj.port == dap_port_jtag && !dap->jtag.host_placed) jtag_goto_state(dap, jtag_state_run_test_idle);
+}
+
+void jtag_ir_invalidate(struct dap_driver *dap) {
+    dap->jtag.ir_valid = false;
+}
+
+/* returns true if the device at the current index holds the instruction, and every other device bypass */
+static bool jtag_ir_held(struct dap_driver *dap, uint32_t ir) {
+    if (!dap->jtag.ir_valid) return false;
+
+    for (uint8_t i = 0; i < dap->jtag.count; i++) {
+        uint32_t expected = i == dap->jtag.index ? ir : jtag_ir_bypass;
+        if (dap->jtag.ir[i] != expected) return false;
+    }
+    return true;
+}
+
 void jtag_set_ir(struct dap_driver *dap, uint32_t ir) {
-    /* assumes we are starting in idle tap state, move to select-dr-scan then select-ir-scan */
-    gpio_pin_set_dt(&dap->io.tms_swdio, 1);
-    jtag_tck_cycle(dap);
-    jtag_tck_cycle(dap);
+    if (jtag_ir_held(dap, ir)) return;
+    for (uint8_t i = 0; i < dap->jtag.count; i++) {
+        dap->jtag.ir[i] = i == dap->jtag.index ? ir : jtag_ir_bypass;
+    }
+    dap->jtag.ir_valid = true;
 
-    /* capture-ir, then shift-ir */
-    gpio_pin_set_dt(&dap->io.tms_swdio, 0);
-    jtag_tck_cycle(dap);
-    jtag_tck_cycle(dap);
+    jtag_goto_state(dap, jtag_state_shift_ir);
 
     /* bypass all tap bits before index */
     gpio_pin_set_dt(&dap->io.tdi, 1);
@@ -79,16 +185,31 @@ void jtag_set_ir(struct dap_driver *dap, uint32_t ir) {
         gpio_pin_set_dt(&dap->io.tms_swdio, 1);
         jtag_tck_cycle(dap);
     }
+    dap->jtag.state = jtag_state_exit1_ir;
 
-    /* update-ir then idle */
-    jtag_tck_cycle(dap);
-    gpio_pin_set_dt(&dap->io.tms_swdio, 0);
-    jtag_tck_cycle(dap);
+    /* update-ir then idle, instructions change rarely enough with the ir cache to not be worth a shorter path */
+    jtag_goto_state(dap, jtag_state_run_test_idle);
     gpio_pin_set_dt(&dap->io.tdi, 1);
 
     return;
 }
 
+/* sets the number of devices on the chain and their instruction lengths, from the device nearest tdo */
+static void jtag_configure(struct dap_driver *dap, uint8_t count, const uint8_t *ir_length) {
+    dap_forget_target_state(dap);
+    uint16_t ir_length_sum = 0;
+    dap->jtag.count = count;
+    for (uint8_t i = 0; i < dap->jtag.count; i++) {
+        dap->jtag.ir_before[i] = ir_length_sum;
+        ir_length_sum += ir_length[i];
+        dap->jtag.ir_length[i] = ir_length[i];
+    }
+    for (uint8_t i = 0; i < dap->jtag.count; i++) {
+        ir_length_sum -= dap->jtag.ir_length[i];
+        dap->jtag.ir_after[i] = ir_length_sum;
+    }
+}
+
 int32_t dap_handle_cmd_jtag_configure(struct dap_driver *dap) {
     uint8_t status = dap_cmd_response_ok;
 
@@ -103,19 +224,9 @@ int32_t dap_handle_cmd_jtag_configure(struct dap_driver *dap) {
         goto end;
     }
 
-    uint16_t ir_length_sum = 0;
-    dap->jtag.count = count;
-    for (uint8_t i = 0; i < dap->jtag.count; i++) {
-        uint8_t len = 0;
-        if (ring_buf_get(&dap->buf.request, &len, 1) != 1) return -EMSGSIZE;
-        dap->jtag.ir_before[i] = ir_length_sum;
-        ir_length_sum += len;
-        dap->jtag.ir_length[i] = len;
-    }
-    for (uint8_t i = 0; i < dap->jtag.count; i++) {
-        ir_length_sum -= dap->jtag.ir_length[i];
-        dap->jtag.ir_after[i] = ir_length_sum;
-    }
+    uint8_t ir_length[DAP_JTAG_MAX_DEVICE_COUNT] = {0};
+    if (ring_buf_get(&dap->buf.request, ir_length, count) != count) return -EMSGSIZE;
+    jtag_configure(dap, count, ir_length);
 
 end: ;
     uint8_t response[] = {dap_cmd_jtag_configure, status};
@@ -137,6 +248,11 @@ int32_t dap_handle_cmd_jtag_sequence(struct dap_driver *dap) {
     if (ring_buf_put_claim(&dap->buf.response, &response_status, 1) != 1) return -ENOBUFS;
     if (ring_buf_put_finish(&dap->buf.response, 1) < 0) return -ENOBUFS;
 
+    /* raw sequences leave the debug port in a state none of the probe's caches can follow, and start
+     * with the tap where the host expects it */
+    dap_forget_target_state(dap);
+    jtag_settle(dap);
+
     uint8_t seq_count = 0;
     if (ring_buf_get(&dap->buf.request, &seq_count, 1) != 1) return -EMSGSIZE;
     for (uint8_t i = 0; i < seq_count; i++) {
@@ -161,28 +277,22 @@ int32_t dap_handle_cmd_jtag_sequence(struct dap_driver *dap) {
 
         uint8_t tms_val = (info & BIT(info_tms_value_shift)) >> info_tms_value_shift;
         gpio_pin_set_dt(&dap->io.tms_swdio, tms_val);
-
-        while (tck_cycles > 0) {
-            uint8_t tdi = 0;
-            if (ring_buf_get(&dap->buf.request, &tdi, 1) != 1) return -EMSGSIZE;
-            uint8_t tdo = 0;
-
-            uint8_t bits = 8;
-            while (bits > 0 && tck_cycles > 0) {
-                uint8_t tdo_bit = jtag_tdio_cycle(dap, tdi);
-                tdi >>= 1;
-                tdo >>= 1;
-                tdo |= tdo_bit << 7;
-                bits--;
-                tck_cycles--;
-            }
-            /* if we are on byte boundary, no-op, otherwise move tdo to final bit position */
-            tdo >>= bits;
-
-            if ((info & info_tdo_capture_mask) != 0) {
-                if (ring_buf_put(&dap->buf.response, &tdo, 1) != 1) return -ENOBUFS;
-            }
+        uint8_t tms[8];
+        memset(tms, tms_val != 0 ? 0xff : 0x00, sizeof(tms));
+
+        /* the whole sequence is read before clocking, so a truncated request never clocks out part of one */
+        uint8_t tdi[8] = {0};
+        uint8_t tdo[8] = {0};
+        uint8_t len = DIV_ROUND_UP(tck_cycles, 8);
+        if (ring_buf_get(&dap->buf.request, tdi, len) != len) return -EMSGSIZE;
+
+        if ((info & info_tdo_capture_mask) != 0) {
+            swj_shift(dap, &dap->io.tdi, tdi, &dap->io.tdo, tdo, tck_cycles);
+            if (ring_buf_put(&dap->buf.response, tdo, len) != len) return -ENOBUFS;
+        } else {
+            swj_shift(dap, &dap->io.tdi, tdi, NULL, NULL, tck_cycles);
         }
+        jtag_follow_tms(dap, tms, tck_cycles);
     }
 
     memcpy(response_status, &status, 1);
@@ -203,16 +313,8 @@ int32_t dap_handle_cmd_jtag_idcode(struct dap_driver *dap) {
         dap->jtag.index = index;
     }
 
-    const uint8_t jtag_ir_idcode = 0x0e;
     jtag_set_ir(dap, jtag_ir_idcode);
-
-    /* select-dr-scan */
-    gpio_pin_set_dt(&dap->io.tms_swdio, 1);
-    jtag_tck_cycle(dap);
-    /* capture-dr, then shift-dr */
-    gpio_pin_set_dt(&dap->io.tms_swdio, 0);
-    jtag_tck_cycle(dap);
-    jtag_tck_cycle(dap);
+    jtag_goto_state(dap, jtag_state_shift_dr);
 
     /* bypass for every tap before the current index */
     for (uint8_t i = 0; i < dap->jtag.index; i++) {
@@ -225,11 +327,8 @@ int32_t dap_handle_cmd_jtag_idcode(struct dap_driver *dap) {
     /* last tdo bit and exit-1-dr*/
     gpio_pin_set_dt(&dap->io.tms_swdio, 1);
     idcode |= jtag_tdo_cycle(dap) << 31;
-
-    /* update-dr, then idle */
-    jtag_tck_cycle(dap);
-    gpio_pin_set_dt(&dap->io.tms_swdio, 0);
-    jtag_tck_cycle(dap);
+    dap->jtag.state = jtag_state_exit1_dr;
+    jtag_goto_state(dap, jtag_state_update_dr);
 
 end: ;
     uint8_t response[] = {dap_cmd_jtag_idcode, status, 0, 0, 0, 0};
@@ -238,3 +337,254 @@ end: ;
 
     return 0;
 }
+
+/* moves any tap state to test-logic-reset, without trusting the tracked state */
+static void jtag_detect_reset(struct dap_driver *dap) {
+    gpio_pin_set_dt(&dap->io.tms_swdio, 1);
+    for (uint8_t i = 0; i < 5; i++) {
+        jtag_tck_cycle(dap);
+    }
+    dap->jtag.state = jtag_state_test_logic_reset;
+}
+
+/* scans the instruction registers as captured after reset, returning the total instruction length of the chain or 0
+ * if it couldn't be found, and the offsets of every possible device start, from each captured '01' marker */
+static uint16_t jtag_detect_ir(struct dap_driver *dap, uint16_t *starts, uint8_t *start_count) {
+    /* no chain this probe can describe has longer instructions than this */
+    const uint16_t max_ir_bits = DAP_JTAG_MAX_DEVICE_COUNT * DAP_JTAG_MAX_IR_LENGTH;
+
+    jtag_goto_state(dap, jtag_state_shift_ir);
+
+    /* flush the chain with zeros, every device captured a 1 then a 0 in its least significant bits */
+    const uint8_t zeros[4] = {0};
+    uint8_t previous = 0;
+    *start_count = 0;
+    for (uint16_t offset = 0; offset < max_ir_bits; offset += 32) {
+        uint8_t bits = MIN(max_ir_bits - offset, 32);
+        uint8_t captured[4] = {0};
+        swj_shift(dap, &dap->io.tdi, zeros, &dap->io.tdo, captured, bits);
+        for (uint8_t i = 0; i < bits; i++) {
+            uint8_t bit = (captured[i / 8] >> (i % 8)) & 0x01;
+            if (previous == 1 && bit == 0 && *start_count < DAP_JTAG_MAX_DEVICE_COUNT + 1) {
+                starts[(*start_count)++] = offset + i - 1;
+            }
+            previous = bit;
+        }
+    }
+
+    /* then shift ones in, until the first one makes it out the other end of the chain */
+    uint16_t ir_total = 0;
+    gpio_pin_set_dt(&dap->io.tdi, 1);
+    while (ir_total <= max_ir_bits && jtag_tdo_cycle(dap) == 0) {
+        ir_total++;
+    }
+    if (ir_total > max_ir_bits) ir_total = 0;
+
+    /* every device now holds bypass */
+    jtag_goto_state(dap, jtag_state_update_ir);
+    return ir_total;
+}
+
+/* scans the data registers as selected after reset, a device with an idcode starts with a 1 and the bypass register
+ * of a device without one is a single 0, returns the number of devices or -1 if the chain is too long */
+static int16_t jtag_detect_idcodes(struct dap_driver *dap, uint32_t *idcodes) {
+    jtag_goto_state(dap, jtag_state_shift_dr);
+
+    /* ones shifted in make an idcode of all ones once past the end of the chain, which no device can have */
+    gpio_pin_set_dt(&dap->io.tdi, 1);
+    int16_t count = 0;
+    while (true) {
+        uint32_t idcode = jtag_tdo_cycle(dap);
+        if (idcode != 0) {
+            for (uint8_t i = 1; i < 32; i++) {
+                idcode |= jtag_tdo_cycle(dap) << i;
+            }
+            if (idcode == 0xffffffff) break;
+        }
+        if (count == DAP_JTAG_MAX_DEVICE_COUNT) {
+            count = -1;
+            break;
+        }
+        idcodes[count++] = idcode;
+    }
+
+    jtag_goto_state(dap, jtag_state_run_test_idle);
+    return count;
+}
+
+int32_t dap_handle_cmd_vendor_jtag_detect(struct dap_driver *dap) {
+    uint8_t status = dap_cmd_response_ok;
+    uint16_t ir_total = 0;
+    int16_t count = 0;
+    uint32_t idcodes[DAP_JTAG_MAX_DEVICE_COUNT] = {0};
+    uint8_t ir_length[DAP_JTAG_MAX_DEVICE_COUNT] = {0};
+
+    if (dap->swj.port != dap_port_jtag) {
+        status = dap_cmd_response_error;
+        goto end;
+    }
+
+    /* detection leaves the chain in a known state, but not one any cache can follow */
+    dap_forget_target_state(dap);
+
+    uint16_t starts[DAP_JTAG_MAX_DEVICE_COUNT + 1] = {0};
+    uint8_t start_count = 0;
+    jtag_detect_reset(dap);
+    ir_total = jtag_detect_ir(dap, starts, &start_count);
+    jtag_detect_reset(dap);
+    count = jtag_detect_idcodes(dap, idcodes);
+    if (ir_total == 0 || count <= 0) {
+        count = MAX(count, 0);
+        status = dap_cmd_response_error;
+        goto end;
+    }
+
+    /* markers are only device boundaries if there is one per device, as an instruction can capture more of them,
+     * the last bit of the chain can't be one either as every instruction is at least two bits */
+    while (start_count > 0 && starts[start_count - 1] >= ir_total - 1) {
+        start_count--;
+    }
+    if (count == 1) {
+        /* a single device has the whole chain, whatever its instruction captures */
+        starts[0] = 0;
+        start_count = 1;
+    }
+    if (start_count != count || starts[0] != 0) {
+        LOG_WRN("jtag chain of %d devices has ambiguous instruction lengths", count);
+        status = dap_cmd_response_error;
+        goto end;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        uint16_t next = i + 1 < count ? starts[i + 1] : ir_total;
+        if (next - starts[i] > DAP_JTAG_MAX_IR_LENGTH) {
+            LOG_WRN("jtag device %u instruction length %u is unsupported", i, next - starts[i]);
+            status = dap_cmd_response_error;
+            goto end;
+        }
+        ir_length[i] = next - starts[i];
+    }
+
+    jtag_configure(dap, count, ir_length);
+
+end: ;
+    uint8_t response[] = {dap_cmd_vendor_jtag_detect, status, count, 0, 0};
+    sys_put_le16(ir_total, &response[3]);
+    if (ring_buf_put(&dap->buf.response, response, sizeof(response)) != sizeof(response)) return -ENOBUFS;
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t device[] = {ir_length[i], 0, 0, 0, 0};
+        sys_put_le32(idcodes[i], &device[1]);
+        if (ring_buf_put(&dap->buf.response, device, sizeof(device)) != sizeof(device)) return -ENOBUFS;
+    }
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_jtag_idcodes(struct dap_driver *dap) {
+    uint8_t status = dap_cmd_response_ok;
+    uint8_t count = 0;
+    uint32_t idcodes[DAP_JTAG_MAX_DEVICE_COUNT] = {0};
+
+    if (dap->swj.port != dap_port_jtag || dap->jtag.count == 0) {
+        status = dap_cmd_response_error;
+        goto end;
+    }
+    count = dap->jtag.count;
+
+    /* test-logic-reset has every device select its own idcode register, or bypass if it doesn't have one, so
+     * no instruction is needed that only some devices would understand */
+    jtag_goto_state(dap, jtag_state_test_logic_reset);
+    jtag_ir_invalidate(dap);
+
+    /* then the whole data chain at once, an idcode starts with a 1 and the bypass register is a single 0 */
+    jtag_goto_state(dap, jtag_state_shift_dr);
+    gpio_pin_set_dt(&dap->io.tdi, 1);
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t idcode = jtag_tdo_cycle(dap);
+        if (idcode == 0) continue;
+        for (uint8_t j = 1; j < 32; j++) {
+            idcode |= jtag_tdo_cycle(dap) << j;
+        }
+        idcodes[i] = idcode;
+    }
+    jtag_goto_state(dap, jtag_state_update_dr);
+
+end: ;
+    uint8_t response[] = {dap_cmd_vendor_jtag_idcodes, status, count};
+    if (ring_buf_put(&dap->buf.response, response, sizeof(response)) != sizeof(response)) return -ENOBUFS;
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t idcode[4] = {0};
+        sys_put_le32(idcodes[i], idcode);
+        if (ring_buf_put(&dap->buf.response, idcode, sizeof(idcode)) != sizeof(idcode)) return -ENOBUFS;
+    }
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_jtag_stream(struct dap_driver *dap) {
+    uint8_t status = dap_cmd_response_ok;
+
+    uint8_t index = 0;
+    if (ring_buf_get(&dap->buf.request, &index, 1) != 1) return -EMSGSIZE;
+    uint32_t ir = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &ir) < 0) return -EMSGSIZE;
+    uint32_t bits = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &bits) < 0) return -EMSGSIZE;
+
+    if (dap->swj.port != dap_port_jtag || index >= dap->jtag.count || bits == 0) {
+        status = dap_cmd_response_error;
+        goto end;
+    }
+    dap->jtag.index = index;
+
+    jtag_set_ir(dap, ir);
+    /* unlike a fixed length register, the device consumes the data as it arrives, so no bypass bits lead it for the
+     * taps before the index, and only those after it need flushing once the stream ends */
+    jtag_goto_state(dap, jtag_state_shift_dr);
+    /* the tap stays in shift-dr until every bit has been received */
+    dap->jtag.stream_remaining = bits;
+
+end: ;
+    uint8_t response[] = {dap_cmd_vendor_jtag_stream, status};
+    if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
+    return 0;
+}
+
+int32_t jtag_stream_data(struct dap_driver *dap) {
+    uint8_t status = dap_cmd_response_ok;
+
+    /* the data is shifted straight out of the request buffer */
+    uint8_t *data = NULL;
+    uint32_t len = ring_buf_get_claim(&dap->buf.request, &data, ring_buf_size_get(&dap->buf.request));
+    uint32_t bits = MIN(len * 8, dap->jtag.stream_remaining);
+    dap->jtag.stream_remaining -= bits;
+    if (dap->jtag.stream_remaining > 0) {
+        swj_shift(dap, &dap->io.tdi, data, NULL, NULL, bits);
+        if (ring_buf_get_finish(&dap->buf.request, len) < 0) return -EMSGSIZE;
+        return 1;
+    }
+
+    uint8_t after_index = dap->jtag.count - dap->jtag.index - 1;
+    if (after_index == 0) {
+        /* last stream bit, then exit-1-dr */
+        swj_shift(dap, &dap->io.tdi, data, NULL, NULL, bits - 1);
+        gpio_pin_set_dt(&dap->io.tms_swdio, 1);
+        jtag_tdi_cycle(dap, data[(bits - 1) / 8] >> ((bits - 1) % 8));
+    } else {
+        swj_shift(dap, &dap->io.tdi, data, NULL, NULL, bits);
+        /* bypass after index, the last one then exit-1-dr */
+        gpio_pin_set_dt(&dap->io.tdi, 1);
+        for (uint8_t i = 0; i < after_index - 1; i++) {
+            jtag_tck_cycle(dap);
+        }
+        gpio_pin_set_dt(&dap->io.tms_swdio, 1);
+        jtag_tck_cycle(dap);
+    }
+    dap->jtag.state = jtag_state_exit1_dr;
+    jtag_goto_state(dap, jtag_state_update_dr);
+
+    /* a host sending more than it said it would is out of step with the probe */
+    if (len > DIV_ROUND_UP(bits, 8)) status = dap_cmd_response_error;
+    if (ring_buf_get_finish(&dap->buf.request, len) < 0) return -EMSGSIZE;
+
+    uint8_t response[] = {dap_cmd_vendor_jtag_stream, status};
+    if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
+    return 0;
+}
@@ -0,0 +1,276 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/ring_buffer.h>
+
+#include "dap/dap.h"
+#include "util.h"
+
+LOG_MODULE_DECLARE(dap, CONFIG_DAP_LOG_LEVEL);
+
+/* largest access size, a 32-bit word */
+static const uint8_t mem_access_size_max = 0x02;
+
+/* reads as much of the remaining memory read as fits in the response, after a header of the command, ack
+ * and count of bytes read */
+int32_t mem_read_stream_data(struct dap_driver *dap) {
+    if (ring_buf_put(&dap->buf.response, &dap_cmd_vendor_mem_read, 1) != 1) return -ENOBUFS;
+
+    /* need pointers to these items because we will write to them after finding out how much data was read */
+    uint8_t *response_header_ptr = NULL;
+    if (ring_buf_put_claim(&dap->buf.response, &response_header_ptr, 3) != 3) return -ENOBUFS;
+    if (ring_buf_put_finish(&dap->buf.response, 3) < 0) return -ENOBUFS;
+
+    uint8_t size = dap->mem.read_size;
+    uint32_t response_space = DAP_MAX_PACKET_SIZE - MIN(ring_buf_size_get(&dap->buf.response), DAP_MAX_PACKET_SIZE);
+    uint16_t count = MIN(dap->mem.read_remaining, response_space) & ~((1 << size) - 1);
+    uint8_t *data = NULL;
+    if (ring_buf_put_claim(&dap->buf.response, &data, count) != count) {
+        ring_buf_put_finish(&dap->buf.response, 0);
+        return -ENOBUFS;
+    }
+
+    uint8_t ack = mem_command_finish(dap, mem_read_sized(dap, dap->mem.read_ap, dap->mem.read_addr, size, data, count));
+    if (ack == transfer_response_ack_ok) {
+        dap->mem.read_addr += count;
+        dap->mem.read_remaining -= count;
+    } else {
+        /* the host learns from the ack that the read ended early */
+        count = 0;
+        dap->mem.read_remaining = 0;
+    }
+    if (ring_buf_put_finish(&dap->buf.response, count) < 0) return -ENOBUFS;
+
+    response_header_ptr[0] = ack;
+    sys_put_le16(count, &response_header_ptr[1]);
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_mem_read(struct dap_driver *dap) {
+    uint8_t ap = 0;
+    if (ring_buf_get(&dap->buf.request, &ap, 1) != 1) return -EMSGSIZE;
+    uint8_t size = 0;
+    if (ring_buf_get(&dap->buf.request, &size, 1) != 1) return -EMSGSIZE;
+    uint32_t addr = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &addr) < 0) return -EMSGSIZE;
+    uint32_t len = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &len) < 0) return -EMSGSIZE;
+
+    if (size > mem_access_size_max || (addr & ((1 << size) - 1)) != 0 || (len & ((1 << size) - 1)) != 0 ||
+        dap->swj.port == dap_port_disabled) {
+        uint8_t response[] = {dap_cmd_vendor_mem_read, dap_cmd_response_error, 0x00, 0x00};
+        if (ring_buf_put(&dap->buf.response, response, sizeof(response)) != sizeof(response)) return -ENOBUFS;
+        return 0;
+    }
+
+    dap->mem.read_ap = ap;
+    dap->mem.read_size = size;
+    dap->mem.read_addr = addr;
+    dap->mem.read_remaining = len;
+    int32_t ret = mem_read_stream_data(dap);
+
+    /* the rest of the read follows in as many further responses as it takes, without any more requests,
+     * unless other commands follow in this request. then the host continues from wherever this read ended.
+     * the host can also end the read early by sending any other request */
+    if (!ring_buf_is_empty(&dap->buf.request)) dap->mem.read_remaining = 0;
+    return ret;
+}
+
+int32_t dap_handle_cmd_vendor_mem_write(struct dap_driver *dap) {
+    uint8_t ap = 0;
+    if (ring_buf_get(&dap->buf.request, &ap, 1) != 1) return -EMSGSIZE;
+    uint8_t size = 0;
+    if (ring_buf_get(&dap->buf.request, &size, 1) != 1) return -EMSGSIZE;
+    uint32_t addr = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &addr) < 0) return -EMSGSIZE;
+    uint16_t len = 0;
+    if (ring_buf_get_le16(&dap->buf.request, &len) < 0) return -EMSGSIZE;
+
+    /* the data is written straight out of the request buffer */
+    uint8_t *data = NULL;
+    if (ring_buf_get_claim(&dap->buf.request, &data, len) != len) return -EMSGSIZE;
+
+    uint8_t ack = dap_cmd_response_error;
+    if (size <= mem_access_size_max && (addr & ((1 << size) - 1)) == 0 && (len & ((1 << size) - 1)) == 0 &&
+        dap->swj.port != dap_port_disabled) {
+        ack = mem_command_finish(dap, mem_write_sized(dap, ap, addr, size, data, len));
+    }
+    if (ring_buf_get_finish(&dap->buf.request, len) < 0) return -EMSGSIZE;
+
+    uint8_t response[] = {dap_cmd_vendor_mem_write, ack};
+    if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_mem_crc32(struct dap_driver *dap) {
+    uint8_t ap = 0;
+    if (ring_buf_get(&dap->buf.request, &ap, 1) != 1) return -EMSGSIZE;
+    uint32_t addr = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &addr) < 0) return -EMSGSIZE;
+    uint32_t len = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &len) < 0) return -EMSGSIZE;
+    uint32_t sector_size = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &sector_size) < 0) return -EMSGSIZE;
+
+    if (ring_buf_put(&dap->buf.response, &dap_cmd_vendor_mem_crc32, 1) != 1) return -ENOBUFS;
+
+    /* need pointers to these items because we will write to them after finding out how many crcs were done */
+    uint8_t *response_header_ptr = NULL;
+    if (ring_buf_put_claim(&dap->buf.response, &response_header_ptr, 3) != 3) return -ENOBUFS;
+    if (ring_buf_put_finish(&dap->buf.response, 3) < 0) return -ENOBUFS;
+
+    /* a sector size of 0 calculates a single crc over the whole range */
+    uint8_t ack = dap_cmd_response_error;
+    uint16_t count = 0;
+    if (sector_size == 0) sector_size = len;
+    uint32_t sectors = sector_size > 0 ? DIV_ROUND_UP(len, sector_size) : 0;
+    uint32_t response_space = DAP_MAX_PACKET_SIZE - MIN(ring_buf_size_get(&dap->buf.response), DAP_MAX_PACKET_SIZE);
+    if ((addr & 0x03) != 0 || (len & 0x03) != 0 || (sector_size & 0x03) != 0 ||
+        sectors > response_space / 4 || dap->swj.port == dap_port_disabled) {
+        goto end;
+    }
+
+    uint8_t *crcs = NULL;
+    if (ring_buf_put_claim(&dap->buf.response, &crcs, sectors * 4) != sectors * 4) {
+        ring_buf_put_finish(&dap->buf.response, 0);
+        return -ENOBUFS;
+    }
+
+    /* target memory is read a chunk of words at a time while calculating a crc */
+    uint32_t words[64];
+    ack = transfer_response_ack_ok;
+    while (ack == transfer_response_ack_ok && len > 0) {
+        uint32_t sector_len = MIN(len, sector_size);
+        uint32_t crc = 0;
+        for (uint32_t offset = 0; offset < sector_len && ack == transfer_response_ack_ok; ) {
+            uint32_t chunk = MIN((sector_len - offset) / 4, ARRAY_SIZE(words));
+            ack = mem_read(dap, ap, addr + offset, words, chunk);
+            for (uint32_t i = 0; i < chunk; i++) {
+                words[i] = sys_cpu_to_le32(words[i]);
+            }
+            crc = crc32_ieee_update(crc, (uint8_t*) words, chunk * 4);
+            offset += chunk * 4;
+        }
+        if (ack != transfer_response_ack_ok) break;
+
+        sys_put_le32(crc, &crcs[count * 4]);
+        count++;
+        addr += sector_len;
+        len -= sector_len;
+    }
+
+    /* a failed access is only reported by the access after it, which can be in the following sector,
+     * so the last finished sector can't be trusted after any error */
+    ack = mem_command_finish(dap, ack);
+    if (ack != transfer_response_ack_ok && count > 0) count--;
+    if (ring_buf_put_finish(&dap->buf.response, count * 4) < 0) return -ENOBUFS;
+
+end:
+    response_header_ptr[0] = ack;
+    sys_put_le16(count, &response_header_ptr[1]);
+    return 0;
+}
+
+/* collects the register selector of every bit set in the bitmap, bit n selecting register base + n,
+ * returns false if any selector is out of range */
+static bool core_reg_bitmap(uint8_t base, uint32_t bitmap, uint8_t *regsel, uint8_t *count) {
+    bool valid = true;
+    *count = 0;
+    for (uint8_t i = 0; i < 32; i++) {
+        if ((bitmap & BIT(i)) == 0) continue;
+        valid = valid && base + i <= dcrsr_regsel_mask;
+        regsel[(*count)++] = (uint8_t) (base + i);
+    }
+    return valid;
+}
+
+/* core registers are only accessible while the core is halted */
+static uint8_t core_reg_check_halted(struct dap_driver *dap, uint8_t ap) {
+    uint32_t status = 0;
+    uint8_t ack = mem_read(dap, ap, dhcsr, &status, 1);
+    if (ack != transfer_response_ack_ok) return ack;
+    return (status & dhcsr_s_halt) != 0 ? ack : dap_cmd_response_error;
+}
+
+/* a core that isn't halted, or never completes a register transfer, still leaves the DP usable */
+static uint8_t core_reg_finish(struct dap_driver *dap, uint8_t ack) {
+    if (ack != dap_cmd_response_error && ack != transfer_response_ack_wait) return mem_command_finish(dap, ack);
+
+    uint8_t finish = mem_command_finish(dap, transfer_response_ack_ok);
+    return finish == transfer_response_ack_ok ? ack : finish;
+}
+
+int32_t dap_handle_cmd_vendor_core_reg_read(struct dap_driver *dap) {
+    uint8_t ap = 0;
+    if (ring_buf_get(&dap->buf.request, &ap, 1) != 1) return -EMSGSIZE;
+    uint8_t base = 0;
+    if (ring_buf_get(&dap->buf.request, &base, 1) != 1) return -EMSGSIZE;
+    uint32_t bitmap = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &bitmap) < 0) return -EMSGSIZE;
+
+    if (ring_buf_put(&dap->buf.response, &dap_cmd_vendor_core_reg_read, 1) != 1) return -ENOBUFS;
+
+    /* need pointers to these items because we will write to them after finding out how many registers were read */
+    uint8_t *response_header_ptr = NULL;
+    if (ring_buf_put_claim(&dap->buf.response, &response_header_ptr, 2) != 2) return -ENOBUFS;
+    if (ring_buf_put_finish(&dap->buf.response, 2) < 0) return -ENOBUFS;
+
+    uint8_t regsel[32];
+    uint8_t count = 0;
+    uint32_t completed = 0;
+    uint8_t ack = dap_cmd_response_error;
+    if (!core_reg_bitmap(base, bitmap, regsel, &count) || dap->swj.port == dap_port_disabled ||
+        ring_buf_space_get(&dap->buf.response) < count * 4) {
+        goto end;
+    }
+
+    uint32_t values[32];
+    ack = core_reg_check_halted(dap, ap);
+    if (ack == transfer_response_ack_ok) {
+        ack = core_reg_read(dap, ap, regsel, values, count, &completed);
+    }
+    ack = core_reg_finish(dap, ack);
+    /* a fault is only reported after the fact, so none of the values read can be trusted */
+    if (ack != transfer_response_ack_ok && ack != transfer_response_ack_wait) completed = 0;
+    for (uint32_t i = 0; i < completed; i++) {
+        ring_buf_put_le32(&dap->buf.response, values[i]);
+    }
+
+end:
+    response_header_ptr[0] = ack;
+    response_header_ptr[1] = (uint8_t) completed;
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_core_reg_write(struct dap_driver *dap) {
+    uint8_t ap = 0;
+    if (ring_buf_get(&dap->buf.request, &ap, 1) != 1) return -EMSGSIZE;
+    uint8_t base = 0;
+    if (ring_buf_get(&dap->buf.request, &base, 1) != 1) return -EMSGSIZE;
+    uint32_t bitmap = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &bitmap) < 0) return -EMSGSIZE;
+
+    /* one value follows for every register selected in the bitmap, in register order */
+    uint8_t regsel[32];
+    uint8_t count = 0;
+    bool valid = core_reg_bitmap(base, bitmap, regsel, &count);
+    uint32_t values[32];
+    for (uint8_t i = 0; i < count; i++) {
+        if (ring_buf_get_le32(&dap->buf.request, &values[i]) < 0) return -EMSGSIZE;
+    }
+
+    uint32_t completed = 0;
+    uint8_t ack = dap_cmd_response_error;
+    if (valid && dap->swj.port != dap_port_disabled) {
+        ack = core_reg_check_halted(dap, ap);
+        if (ack == transfer_response_ack_ok) {
+            ack = core_reg_write(dap, ap, regsel, values, count, &completed);
+        }
+        ack = core_reg_finish(dap, ack);
+    }
+
+    uint8_t response[] = {dap_cmd_vendor_core_reg_write, ack, (uint8_t) completed};
+    if (ring_buf_put(&dap->buf.response, response, 3) != 3) return -ENOBUFS;
+    return 0;
+}
@@ -0,0 +1,233 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/ring_buffer.h>
+
+#include "dap/dap.h"
+#include "util.h"
+
+LOG_MODULE_DECLARE(dap, CONFIG_DAP_LOG_LEVEL);
+
+/* dwt program counter sample register address */
+static const uint32_t dwt_pcsr = 0xe000101c;
+
+/* core register selector of the program counter */
+static const uint8_t dcrsr_regsel_pc = 15;
+
+/* reads of the debug halting status to wait for a requested halt */
+static const uint8_t pcsample_halt_retries = 8;
+
+static inline uint64_t pcsample_now_us(void) {
+    return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+/* briefly halts the core to read the program counter, for cores without a pc sample register */
+static uint8_t pcsample_take_halt(struct dap_driver *dap, uint32_t *pc, bool *taken) {
+    uint32_t status = 0;
+    uint8_t ack = mem_read(dap, dap->pcsample.ap, dhcsr, &status, 1);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    /* a core halted by the host is left alone, and not sampled */
+    *taken = false;
+    if ((status & dhcsr_s_halt) != 0) return ack;
+
+    uint32_t control = dhcsr_dbgkey | (status & dhcsr_c_maskints) | dhcsr_c_debugen;
+    uint32_t halt = control | dhcsr_c_halt;
+    ack = mem_write(dap, dap->pcsample.ap, dhcsr, &halt, 1);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    /* the register transfer is only valid once the core reports it has halted */
+    uint32_t halted = 0;
+    for (uint8_t i = 0; i < pcsample_halt_retries && (halted & dhcsr_s_halt) == 0; i++) {
+        ack = mem_read(dap, dap->pcsample.ap, dhcsr, &halted, 1);
+        if (ack != transfer_response_ack_ok) return ack;
+    }
+
+    /* a core that never halts, or never completes the register read, is resumed without a sample */
+    if ((halted & dhcsr_s_halt) != 0) {
+        uint32_t completed = 0;
+        ack = core_reg_read(dap, dap->pcsample.ap, &dcrsr_regsel_pc, pc, 1, &completed);
+        if (ack != transfer_response_ack_ok && ack != transfer_response_ack_wait) return ack;
+        *taken = completed == 1;
+    }
+
+    /* resume with the debug enable and interrupt masking the core had before */
+    control = dhcsr_dbgkey | (status & (dhcsr_c_debugen | dhcsr_c_maskints));
+    return mem_write(dap, dap->pcsample.ap, dhcsr, &control, 1);
+}
+
+static void pcsample_store(struct dap_driver *dap, uint32_t pc) {
+    dap->pcsample.samples++;
+
+    if (dap->pcsample.output == dap_pcsample_output_stream) {
+        if (ring_buf_space_get(&dap->buf.pcsample) < 4 || ring_buf_put_le32(&dap->buf.pcsample, pc) < 0) {
+            dap->pcsample.lost++;
+        }
+        return;
+    }
+
+    /* bins are found with a multiplicative hash of the pc, and a short linear probe from there */
+    const uint32_t bin_count = ARRAY_SIZE(dap->buf.pcsample_bins);
+    uint32_t index = ((pc >> 1) * 2654435761u) % bin_count;
+    for (uint8_t i = 0; i < DAP_PCSAMPLE_PROBES; i++) {
+        struct dap_pcsample_bin *bin = &dap->buf.pcsample_bins[(index + i) % bin_count];
+        if (bin->count == 0 || bin->pc == pc) {
+            bin->pc = pc;
+            bin->count++;
+            return;
+        }
+    }
+    dap->pcsample.lost++;
+}
+
+/* takes a single sample from whichever source the core has */
+static uint8_t pcsample_access(struct dap_driver *dap, void *context) {
+    ARG_UNUSED(context);
+
+    uint32_t pc = 0;
+    bool taken = false;
+    uint8_t ack = transfer_response_ack_ok;
+    if (dap->pcsample.source == dap_pcsample_source_pcsr) {
+        ack = mem_read(dap, dap->pcsample.ap, dwt_pcsr, &pc, 1);
+        taken = true;
+    } else {
+        ack = pcsample_take_halt(dap, &pc, &taken);
+    }
+    if (ack == transfer_response_ack_ok && taken) pcsample_store(dap, pc);
+    return ack;
+}
+
+void pcsample_reset(struct dap_driver *dap) {
+    dap->pcsample.state = dap_pcsample_state_stopped;
+    dap->pcsample.samples = 0;
+    dap->pcsample.lost = 0;
+    dap->pcsample.bin_cursor = 0;
+
+    memset(dap->buf.pcsample_bytes, 0, sizeof(dap->buf.pcsample_bytes));
+    ring_buf_reset(&dap->buf.pcsample);
+}
+
+void pcsample_poll(struct dap_driver *dap) {
+    if (dap->pcsample.state != dap_pcsample_state_running) return;
+
+    /* a single sample is taken for the latest due time, any due before it are counted as lost, since samples
+     * taken back to back would all show the core at the same moment */
+    uint64_t now = pcsample_now_us();
+    if (now < dap->pcsample.next_sample) return;
+    uint64_t missed = (now - dap->pcsample.next_sample) / dap->pcsample.interval_us;
+    dap->pcsample.lost += (uint32_t) MIN(missed, UINT32_MAX);
+    dap->pcsample.next_sample += (missed + 1) * dap->pcsample.interval_us;
+
+    if (dap->swj.port != dap_port_disabled) {
+        /* a sample due while the host has a sticky error flagged is lost */
+        bool deferred = false;
+        uint8_t ack = mem_shared_access(dap, dap->pcsample.ap, pcsample_access, NULL, &deferred);
+        if (deferred) {
+            dap->pcsample.lost++;
+        } else if (ack != transfer_response_ack_ok) {
+            LOG_ERR("pc sample failed with transfer response 0x%x", ack);
+            dap->pcsample.state = dap_pcsample_state_error;
+        }
+    }
+}
+
+k_timeout_t pcsample_poll_timeout(struct dap_driver *dap) {
+    if (dap->pcsample.state != dap_pcsample_state_running) return K_FOREVER;
+
+    uint64_t now = pcsample_now_us();
+    if (now >= dap->pcsample.next_sample) return K_NO_WAIT;
+    return K_USEC(dap->pcsample.next_sample - now);
+}
+
+int32_t dap_handle_cmd_vendor_pcsample_control(struct dap_driver *dap) {
+    uint8_t status = dap_cmd_response_ok;
+
+    /* control values */
+    const uint8_t control_stop = 0x00;
+    const uint8_t control_start = 0x01;
+
+    uint8_t control = 0;
+    if (ring_buf_get(&dap->buf.request, &control, 1) != 1) return -EMSGSIZE;
+    uint8_t ap = 0;
+    if (ring_buf_get(&dap->buf.request, &ap, 1) != 1) return -EMSGSIZE;
+    uint8_t source = 0;
+    if (ring_buf_get(&dap->buf.request, &source, 1) != 1) return -EMSGSIZE;
+    uint8_t output = 0;
+    if (ring_buf_get(&dap->buf.request, &output, 1) != 1) return -EMSGSIZE;
+    uint32_t interval_us = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &interval_us) < 0) return -EMSGSIZE;
+
+    if (control == control_stop) {
+        /* samples already taken stay available to the host until the next start */
+        if (dap->pcsample.state == dap_pcsample_state_running) {
+            dap->pcsample.state = dap_pcsample_state_stopped;
+        }
+    } else if (control == control_start) {
+        if ((source != dap_pcsample_source_pcsr && source != dap_pcsample_source_halt) ||
+            (output != dap_pcsample_output_stream && output != dap_pcsample_output_histogram) ||
+            interval_us == 0) {
+            status = dap_cmd_response_error;
+            goto end;
+        }
+
+        pcsample_reset(dap);
+        dap->pcsample.ap = ap;
+        dap->pcsample.source = source;
+        dap->pcsample.output = output;
+        dap->pcsample.interval_us = interval_us;
+        dap->pcsample.next_sample = pcsample_now_us();
+        dap->pcsample.state = dap_pcsample_state_running;
+    } else {
+        status = dap_cmd_response_error;
+    }
+
+end: ;
+    uint8_t response[] = {dap_cmd_vendor_pcsample_control, status};
+    if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_pcsample_data(struct dap_driver *dap) {
+    uint16_t max_count = 0;
+    if (ring_buf_get_le16(&dap->buf.request, &max_count) < 0) return -EMSGSIZE;
+
+    uint8_t header[] = {dap_cmd_vendor_pcsample_data, dap->pcsample.state};
+    if (ring_buf_put(&dap->buf.response, header, 2) != 2) return -ENOBUFS;
+
+    /* need a pointer to this item because we will write to it after finding out how much data to read */
+    uint8_t *response_count_ptr = NULL;
+    if (ring_buf_put_claim(&dap->buf.response, &response_count_ptr, 2) != 2) return -ENOBUFS;
+    if (ring_buf_put_finish(&dap->buf.response, 2) < 0) return -ENOBUFS;
+    if (ring_buf_put_le32(&dap->buf.response, dap->pcsample.samples) < 0) return -ENOBUFS;
+    if (ring_buf_put_le32(&dap->buf.response, dap->pcsample.lost) < 0) return -ENOBUFS;
+
+    uint16_t count = 0;
+    if (dap->pcsample.output == dap_pcsample_output_stream) {
+        /* samples are each a single pc */
+        while (count < max_count && ring_buf_space_get(&dap->buf.response) >= 4) {
+            uint8_t sample[4];
+            if (ring_buf_get(&dap->buf.pcsample, sample, 4) != 4) break;
+            ring_buf_put(&dap->buf.response, sample, 4);
+            count++;
+        }
+    } else {
+        /* bins are each a pc and sample count, and are emptied once read, a pc can end up in more than
+         * one bin over a run so the host merges bins with the same pc */
+        const uint16_t bin_count = ARRAY_SIZE(dap->buf.pcsample_bins);
+        for (uint16_t i = 0; i < bin_count && count < max_count; i++) {
+            if (ring_buf_space_get(&dap->buf.response) < 8) break;
+
+            struct dap_pcsample_bin *bin = &dap->buf.pcsample_bins[dap->pcsample.bin_cursor];
+            if (bin->count != 0) {
+                ring_buf_put_le32(&dap->buf.response, bin->pc);
+                ring_buf_put_le32(&dap->buf.response, bin->count);
+                bin->count = 0;
+                count++;
+            }
+            dap->pcsample.bin_cursor = (dap->pcsample.bin_cursor + 1) % bin_count;
+        }
+    }
+
+    sys_put_le16(count, response_count_ptr);
+    return 0;
+}
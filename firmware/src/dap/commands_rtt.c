@@ -0,0 +1,311 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/ring_buffer.h>
+
+#include "dap/dap.h"
+#include "util.h"
+
+LOG_MODULE_DECLARE(dap, CONFIG_DAP_LOG_LEVEL);
+
+/* control block id, padded with zeros to fill the 16 byte id field */
+static const uint8_t rtt_id[16] = "SEGGER RTT";
+
+/* control block layout, an id and buffer counts followed by all up then all down buffer descriptors */
+static const uint32_t rtt_cb_counts_offset = 16;
+static const uint32_t rtt_cb_desc_offset = 24;
+static const uint32_t rtt_desc_size = 24;
+static const uint32_t rtt_desc_buf_offset = 4;
+static const uint32_t rtt_desc_wroff_offset = 12;
+static const uint32_t rtt_desc_rdoff_offset = 16;
+
+static bool rtt_id_match(const uint32_t *words) {
+    for (uint8_t i = 0; i < 4; i++) {
+        if (words[i] != sys_get_le32(&rtt_id[i * 4])) return false;
+    }
+    return true;
+}
+
+/* reads the buffer descriptors of the configured channels from a located control block */
+static uint8_t rtt_attach(struct dap_driver *dap, uint32_t control_block) {
+    /* maximum number of up buffers, then down buffers */
+    uint32_t counts[2];
+    uint8_t ack = mem_read(dap, dap->rtt.ap, control_block + rtt_cb_counts_offset, counts, 2);
+    if (ack != transfer_response_ack_ok) return ack;
+    if (dap->rtt.up_channel >= counts[0]) {
+        LOG_ERR("rtt up channel %u not in control block", dap->rtt.up_channel);
+        dap->rtt.state = dap_rtt_state_error;
+        return ack;
+    }
+
+    /* buffer address then size, following the name pointer */
+    uint32_t desc[2];
+    dap->rtt.control_block = control_block;
+    dap->rtt.up_desc = control_block + rtt_cb_desc_offset + dap->rtt.up_channel * rtt_desc_size;
+    ack = mem_read(dap, dap->rtt.ap, dap->rtt.up_desc + rtt_desc_buf_offset, desc, 2);
+    if (ack != transfer_response_ack_ok) return ack;
+    dap->rtt.up_buf = desc[0];
+    dap->rtt.up_size = desc[1];
+
+    /* a target without the down channel can still send up-channel data */
+    dap->rtt.down_size = 0;
+    if (dap->rtt.down_channel < counts[1]) {
+        dap->rtt.down_desc = control_block + rtt_cb_desc_offset + (counts[0] + dap->rtt.down_channel) * rtt_desc_size;
+        ack = mem_read(dap, dap->rtt.ap, dap->rtt.down_desc + rtt_desc_buf_offset, desc, 2);
+        if (ack != transfer_response_ack_ok) return ack;
+        dap->rtt.down_buf = desc[0];
+        dap->rtt.down_size = desc[1];
+    }
+
+    LOG_INF("rtt control block found at 0x%08x", control_block);
+    dap->rtt.state = dap_rtt_state_running;
+    return ack;
+}
+
+static uint8_t rtt_search(struct dap_driver *dap, bool *busy) {
+    uint32_t words[DAP_RTT_SEARCH_WORDS];
+
+    if (dap->rtt.search_size == 0) {
+        /* the control block address is known, but it might not be initialized by the target yet */
+        uint8_t ack = mem_read(dap, dap->rtt.ap, dap->rtt.search_addr, words, 4);
+        if (ack != transfer_response_ack_ok || !rtt_id_match(words)) return ack;
+        return rtt_attach(dap, dap->rtt.search_addr);
+    }
+
+    uint32_t addr = dap->rtt.search_addr + dap->rtt.search_offset;
+    uint32_t count = MIN(DAP_RTT_SEARCH_WORDS, (dap->rtt.search_size - dap->rtt.search_offset) / 4);
+    uint8_t ack = mem_read(dap, dap->rtt.ap, addr, words, count);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    for (uint32_t i = 0; i + 4 <= count; i++) {
+        if (rtt_id_match(&words[i])) {
+            return rtt_attach(dap, addr + i * 4);
+        }
+    }
+
+    /* slices overlap by the id length less a word, so an id split between two slices is still found */
+    dap->rtt.search_offset += (count - 3) * 4;
+    if (dap->rtt.search_offset + sizeof(rtt_id) > dap->rtt.search_size) {
+        /* nothing found in the whole range, wait for the poll interval before starting over */
+        dap->rtt.search_offset = 0;
+    } else {
+        *busy = true;
+    }
+    return ack;
+}
+
+static uint8_t rtt_poll_up(struct dap_driver *dap, bool *busy) {
+    /* write offset then read offset */
+    uint32_t offsets[2];
+    uint8_t ack = mem_read(dap, dap->rtt.ap, dap->rtt.up_desc + rtt_desc_wroff_offset, offsets, 2);
+    if (ack != transfer_response_ack_ok) return ack;
+    uint32_t write = offsets[0];
+    uint32_t read = offsets[1];
+    if (write == read || write >= dap->rtt.up_size || read >= dap->rtt.up_size) return ack;
+
+    /* only the contiguous run before the buffer wraps is read at once, data the host has no room for
+     * is left in the target buffer until the next poll */
+    uint32_t available = write > read ? write - read : dap->rtt.up_size - read;
+    k_mutex_lock(&dap->rtt.lock, K_FOREVER);
+    uint32_t space = ring_buf_space_get(&dap->buf.rtt_up);
+    k_mutex_unlock(&dap->rtt.lock);
+    uint32_t len = MIN(MIN(available, space), DAP_RTT_POLL_BYTES);
+    if (len == 0) return ack;
+
+    uint8_t data[DAP_RTT_POLL_BYTES];
+    ack = mem_read_bytes(dap, dap->rtt.ap, dap->rtt.up_buf + read, data, len);
+    if (ack != transfer_response_ack_ok) return ack;
+    read = (read + len) % dap->rtt.up_size;
+    ack = mem_write(dap, dap->rtt.ap, dap->rtt.up_desc + rtt_desc_rdoff_offset, &read, 1);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    k_mutex_lock(&dap->rtt.lock, K_FOREVER);
+    ring_buf_put(&dap->buf.rtt_up, data, len);
+    k_mutex_unlock(&dap->rtt.lock);
+    k_sem_give(&dap->rtt.up_available);
+
+    dap->rtt.up_bytes += len;
+    *busy = true;
+    return ack;
+}
+
+static uint8_t rtt_poll_down(struct dap_driver *dap, bool *busy) {
+    k_mutex_lock(&dap->rtt.lock, K_FOREVER);
+    uint32_t pending = ring_buf_size_get(&dap->buf.rtt_down);
+    k_mutex_unlock(&dap->rtt.lock);
+    if (dap->rtt.down_size == 0 || pending == 0) return transfer_response_ack_ok;
+
+    /* write offset then read offset */
+    uint32_t offsets[2];
+    uint8_t ack = mem_read(dap, dap->rtt.ap, dap->rtt.down_desc + rtt_desc_wroff_offset, offsets, 2);
+    if (ack != transfer_response_ack_ok) return ack;
+    uint32_t write = offsets[0];
+    uint32_t read = offsets[1];
+    if (write >= dap->rtt.down_size || read >= dap->rtt.down_size) return ack;
+
+    /* one byte always stays free, so a full buffer can be told apart from an empty one */
+    uint32_t free = read > write ? read - write - 1 : dap->rtt.down_size - write - (read == 0 ? 1 : 0);
+    uint32_t len = MIN(MIN(free, pending), DAP_RTT_POLL_BYTES);
+    if (len == 0) return ack;
+
+    uint8_t data[DAP_RTT_POLL_BYTES];
+    k_mutex_lock(&dap->rtt.lock, K_FOREVER);
+    ring_buf_peek(&dap->buf.rtt_down, data, len);
+    k_mutex_unlock(&dap->rtt.lock);
+    ack = mem_write_bytes(dap, dap->rtt.ap, dap->rtt.down_buf + write, data, len);
+    if (ack != transfer_response_ack_ok) return ack;
+    write = (write + len) % dap->rtt.down_size;
+    ack = mem_write(dap, dap->rtt.ap, dap->rtt.down_desc + rtt_desc_wroff_offset, &write, 1);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    /* host data is only removed once it has made it to the target */
+    k_mutex_lock(&dap->rtt.lock, K_FOREVER);
+    ring_buf_get_skip(&dap->buf.rtt_down, len);
+    k_mutex_unlock(&dap->rtt.lock);
+
+    dap->rtt.down_bytes += len;
+    *busy = true;
+    return ack;
+}
+
+void rtt_reset(struct dap_driver *dap) {
+    dap->rtt.state = dap_rtt_state_stopped;
+    dap->rtt.control_block = 0;
+    dap->rtt.up_bytes = 0;
+    dap->rtt.down_bytes = 0;
+
+    k_mutex_lock(&dap->rtt.lock, K_FOREVER);
+    ring_buf_reset(&dap->buf.rtt_up);
+    ring_buf_reset(&dap->buf.rtt_down);
+    k_mutex_unlock(&dap->rtt.lock);
+    k_sem_reset(&dap->rtt.up_available);
+}
+
+/* searches for the control block, or moves data in both directions once it is found */
+static uint8_t rtt_poll_access(struct dap_driver *dap, void *context) {
+    bool *busy = context;
+    uint8_t ack = transfer_response_ack_ok;
+    if (dap->rtt.state == dap_rtt_state_searching) {
+        ack = rtt_search(dap, busy);
+    }
+    if (ack == transfer_response_ack_ok && dap->rtt.state == dap_rtt_state_running) {
+        ack = rtt_poll_up(dap, busy);
+    }
+    if (ack == transfer_response_ack_ok && dap->rtt.state == dap_rtt_state_running) {
+        ack = rtt_poll_down(dap, busy);
+    }
+    return ack;
+}
+
+void rtt_poll(struct dap_driver *dap) {
+    if (dap->rtt.state != dap_rtt_state_searching && dap->rtt.state != dap_rtt_state_running) return;
+
+    /* polls keep running back to back while there is work left, otherwise wait for the interval */
+    bool busy = false;
+    if (dap->swj.port != dap_port_disabled) {
+        /* a poll deferred by a sticky error from the host is tried again after the interval */
+        bool deferred = false;
+        uint8_t ack = mem_shared_access(dap, dap->rtt.ap, rtt_poll_access, &busy, &deferred);
+        if (ack != transfer_response_ack_ok && !deferred) {
+            LOG_ERR("rtt poll failed with transfer response 0x%x", ack);
+            dap->rtt.state = dap_rtt_state_error;
+        }
+    }
+
+    dap->rtt.next_poll = sys_timepoint_calc(busy ? K_NO_WAIT : K_MSEC(dap->rtt.interval_ms));
+}
+
+k_timeout_t rtt_poll_timeout(struct dap_driver *dap) {
+    if (dap->rtt.state != dap_rtt_state_searching && dap->rtt.state != dap_rtt_state_running) {
+        return K_FOREVER;
+    }
+    return sys_timepoint_timeout(dap->rtt.next_poll);
+}
+
+int32_t rtt_host_read(struct dap_driver *dap, uint8_t *buf, size_t len, k_timeout_t timeout) {
+    k_mutex_lock(&dap->rtt.lock, K_FOREVER);
+    uint32_t read = ring_buf_get(&dap->buf.rtt_up, buf, len);
+    k_mutex_unlock(&dap->rtt.lock);
+
+    if (read == 0 && k_sem_take(&dap->rtt.up_available, timeout) == 0) {
+        k_mutex_lock(&dap->rtt.lock, K_FOREVER);
+        read = ring_buf_get(&dap->buf.rtt_up, buf, len);
+        k_mutex_unlock(&dap->rtt.lock);
+    }
+    return read;
+}
+
+int32_t rtt_host_write(struct dap_driver *dap, const uint8_t *buf, size_t len) {
+    /* data for a down channel nothing will ever service is accepted and discarded, rather than left for the
+     * host to wait on */
+    uint8_t state = dap->rtt.state;
+    if (state != dap_rtt_state_searching && (state != dap_rtt_state_running || dap->rtt.down_size == 0)) {
+        return len;
+    }
+
+    k_mutex_lock(&dap->rtt.lock, K_FOREVER);
+    uint32_t written = ring_buf_put(&dap->buf.rtt_down, buf, len);
+    k_mutex_unlock(&dap->rtt.lock);
+    return written;
+}
+
+int32_t dap_handle_cmd_vendor_rtt_control(struct dap_driver *dap) {
+    uint8_t status = dap_cmd_response_ok;
+
+    /* control values */
+    const uint8_t control_stop = 0x00;
+    const uint8_t control_start = 0x01;
+
+    uint8_t control = 0;
+    if (ring_buf_get(&dap->buf.request, &control, 1) != 1) return -EMSGSIZE;
+    uint8_t ap = 0;
+    if (ring_buf_get(&dap->buf.request, &ap, 1) != 1) return -EMSGSIZE;
+    uint32_t addr = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &addr) < 0) return -EMSGSIZE;
+    uint32_t size = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &size) < 0) return -EMSGSIZE;
+    uint8_t up_channel = 0;
+    if (ring_buf_get(&dap->buf.request, &up_channel, 1) != 1) return -EMSGSIZE;
+    uint8_t down_channel = 0;
+    if (ring_buf_get(&dap->buf.request, &down_channel, 1) != 1) return -EMSGSIZE;
+    uint16_t interval_ms = 0;
+    if (ring_buf_get_le16(&dap->buf.request, &interval_ms) < 0) return -EMSGSIZE;
+
+    if (control == control_stop) {
+        rtt_reset(dap);
+    } else if (control == control_start) {
+        /* control blocks are word aligned, and a search range must hold at least the id */
+        if ((addr & 0x03) != 0 || (size & 0x03) != 0 || (size > 0 && size < sizeof(rtt_id)) ||
+            interval_ms == 0) {
+            status = dap_cmd_response_error;
+            goto end;
+        }
+
+        rtt_reset(dap);
+        dap->rtt.ap = ap;
+        dap->rtt.search_addr = addr;
+        dap->rtt.search_size = size;
+        dap->rtt.search_offset = 0;
+        dap->rtt.up_channel = up_channel;
+        dap->rtt.down_channel = down_channel;
+        dap->rtt.interval_ms = interval_ms;
+        dap->rtt.next_poll = sys_timepoint_calc(K_NO_WAIT);
+        dap->rtt.state = dap_rtt_state_searching;
+    } else {
+        status = dap_cmd_response_error;
+    }
+
+end: ;
+    uint8_t response[] = {dap_cmd_vendor_rtt_control, status};
+    if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_rtt_status(struct dap_driver *dap) {
+    uint8_t response[] = {dap_cmd_vendor_rtt_status, dap->rtt.state, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    sys_put_le32(dap->rtt.control_block, &response[2]);
+    sys_put_le32(dap->rtt.up_bytes, &response[6]);
+    sys_put_le32(dap->rtt.down_bytes, &response[10]);
+    if (ring_buf_put(&dap->buf.response, response, sizeof(response)) != sizeof(response)) return -ENOBUFS;
+    return 0;
+}
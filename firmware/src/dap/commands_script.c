@@ -0,0 +1,402 @@
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/ring_buffer.h>
+
+#include "dap/dap.h"
+#include "util.h"
+
+LOG_MODULE_DECLARE(dap, CONFIG_DAP_LOG_LEVEL);
+
+/* script opcodes, all operands follow the opcode byte, with multi-byte operands in little endian */
+enum script_op {
+    /* stop, successfully */
+    script_op_end = 0x00,
+    /* stop with a failure code: code8 */
+    script_op_fail = 0x01,
+    /* register and immediate operations: rd, imm32 (mov is rd, rs) */
+    script_op_load = 0x02,
+    script_op_mov = 0x03,
+    script_op_add = 0x04,
+    script_op_and = 0x05,
+    script_op_or = 0x06,
+    /* branches: target16, conditional branches are rs, imm32, target16, loop is rd, target16 */
+    script_op_jmp = 0x10,
+    script_op_jeq = 0x11,
+    script_op_jne = 0x12,
+    script_op_loop = 0x13,
+    /* failed accesses branch to target16 instead of stopping the script, 0xffff clears the target */
+    script_op_onfail = 0x14,
+    /* debug port accesses: addr8, reg */
+    script_op_dp_read = 0x20,
+    script_op_dp_write = 0x21,
+    /* access port accesses: ap8, addr8, reg */
+    script_op_ap_read = 0x22,
+    script_op_ap_write = 0x23,
+    /* memory word accesses: ap8, address register, data register */
+    script_op_mem_read = 0x24,
+    script_op_mem_write = 0x25,
+    /* swj sequence: count8 (0 is 256 bits), then the bits on swdio/tms, lsb first */
+    script_op_sequence = 0x30,
+    /* delay: us32 */
+    script_op_delay = 0x31,
+    /* drive nreset: level8 */
+    script_op_nreset = 0x32,
+    /* wait for nreset to reach a level: level8, timeout us32, timing out fails like an access */
+    script_op_nreset_wait = 0x33,
+};
+
+/* how a script run ended */
+static const uint8_t script_result_end = 0x00;
+static const uint8_t script_result_fail = 0x01;
+static const uint8_t script_result_steps = 0x02;
+static const uint8_t script_result_timeout = 0x03;
+static const uint8_t script_result_transfer = 0x04;
+static const uint8_t script_result_invalid = 0x05;
+
+/* no failure branch target set */
+static const uint16_t script_onfail_none = 0xffff;
+
+struct script_vm {
+    const uint8_t *program;
+    uint16_t pc;
+    uint16_t onfail;
+    uint32_t steps;
+    /* the run's time limit, which also bounds waits inside a single instruction */
+    k_timepoint_t end;
+    uint32_t regs[DAP_SCRIPT_REGS];
+    /* result of the run, with the failure code or transfer ack behind it */
+    uint8_t result;
+    uint8_t detail;
+};
+
+/* returns a pointer to the next len bytes of the program, or NULL if they run past its end */
+static const uint8_t *script_fetch(struct script_vm *vm, uint16_t len) {
+    if (vm->pc + len > DAP_SCRIPT_SIZE) return NULL;
+    const uint8_t *operands = &vm->program[vm->pc];
+    vm->pc += len;
+    return operands;
+}
+
+/* returns a wait of us microseconds, cut short to whatever is left of the run's time limit */
+static uint32_t script_wait_limit(struct script_vm *vm, uint32_t us) {
+    k_timeout_t remaining = sys_timepoint_timeout(vm->end);
+    return (uint32_t) MIN((uint64_t) us, k_ticks_to_us_floor64(remaining.ticks));
+}
+
+/* returns a pointer to the register named by the operand, or NULL if it doesn't exist */
+static uint32_t *script_reg(struct script_vm *vm, uint8_t reg) {
+    return reg < DAP_SCRIPT_REGS ? &vm->regs[reg] : NULL;
+}
+
+static void script_sequence(struct dap_driver *dap, const uint8_t *bits, uint16_t count) {
+    dap_forget_target_state(dap);
+    jtag_settle(dap);
+
+    for (uint16_t i = 0; i < count; i++) {
+        gpio_pin_set_dt(&dap->io.tms_swdio, (bits[i / 8] >> (i % 8)) & 0x01);
+        gpio_pin_set_dt(&dap->io.tck_swclk, 0);
+        busy_wait_nanos(dap->swj.delay_ns);
+        gpio_pin_set_dt(&dap->io.tck_swclk, 1);
+        busy_wait_nanos(dap->swj.delay_ns);
+    }
+    jtag_follow_tms(dap, bits, count);
+}
+
+/* runs a single access, returns false if the script stops because of it */
+static bool script_access(struct dap_driver *dap, struct script_vm *vm, uint8_t op, const uint8_t *operands) {
+    uint8_t ack = transfer_response_ack_ok;
+    uint32_t *reg = NULL;
+
+    if (op == script_op_dp_read || op == script_op_dp_write) {
+        if ((reg = script_reg(vm, operands[1])) == NULL) goto invalid;
+        if (op == script_op_dp_read) {
+            ack = dp_read(dap, operands[0], reg);
+        } else {
+            ack = dp_write(dap, operands[0], *reg);
+            /* a script selecting an AP is the same as the host doing it */
+            if (ack == transfer_response_ack_ok && (operands[0] & 0x0c) == dp_addr_select) {
+                dap->transfer.select = *reg;
+            }
+        }
+    } else if (op == script_op_ap_read || op == script_op_ap_write) {
+        if ((reg = script_reg(vm, operands[2])) == NULL) goto invalid;
+        if (op == script_op_ap_read) {
+            ack = ap_read(dap, operands[0], operands[1], reg);
+        } else {
+            ack = ap_write(dap, operands[0], operands[1], *reg);
+        }
+    } else {
+        uint32_t *addr = script_reg(vm, operands[1]);
+        if (addr == NULL || (reg = script_reg(vm, operands[2])) == NULL || (*addr & 0x03) != 0) goto invalid;
+        if (op == script_op_mem_read) {
+            ack = mem_read(dap, operands[0], *addr, reg, 1);
+        } else {
+            ack = mem_write(dap, operands[0], *addr, reg, 1);
+        }
+    }
+
+    /* an ap access only reports its own error through the sticky flag, check it so failures belong to the
+     * instruction that caused them */
+    if (ack == transfer_response_ack_ok && op != script_op_dp_read && op != script_op_dp_write) {
+        ack = dp_check_errors(dap);
+    }
+    if (ack == transfer_response_ack_ok) return true;
+
+    /* the failure branch gets a debug port with its sticky errors cleared */
+    vm->detail = ack;
+    if (vm->onfail != script_onfail_none) {
+        dp_clear_errors(dap);
+        vm->pc = vm->onfail;
+        return true;
+    }
+    vm->result = script_result_transfer;
+    return false;
+
+invalid:
+    vm->result = script_result_invalid;
+    return false;
+}
+
+/* runs a single instruction, returns false once the script stops */
+static bool script_step(struct dap_driver *dap, struct script_vm *vm) {
+    /* operand bytes following each opcode */
+    static const uint8_t access_operands[] = {2, 2, 3, 3, 3, 3};
+
+    const uint8_t *op = script_fetch(vm, 1);
+    if (op == NULL) goto invalid;
+    const uint8_t *operands = NULL;
+    uint32_t *reg = NULL;
+
+    switch (*op) {
+    case script_op_end:
+        vm->result = script_result_end;
+        return false;
+    case script_op_fail:
+        if ((operands = script_fetch(vm, 1)) == NULL) goto invalid;
+        vm->result = script_result_fail;
+        vm->detail = operands[0];
+        return false;
+    case script_op_load:
+    case script_op_add:
+    case script_op_and:
+    case script_op_or:
+        if ((operands = script_fetch(vm, 5)) == NULL) goto invalid;
+        if ((reg = script_reg(vm, operands[0])) == NULL) goto invalid;
+        uint32_t imm = sys_get_le32(&operands[1]);
+        if (*op == script_op_load) *reg = imm;
+        else if (*op == script_op_add) *reg += imm;
+        else if (*op == script_op_and) *reg &= imm;
+        else *reg |= imm;
+        return true;
+    case script_op_mov:
+        if ((operands = script_fetch(vm, 2)) == NULL) goto invalid;
+        if ((reg = script_reg(vm, operands[0])) == NULL || script_reg(vm, operands[1]) == NULL) goto invalid;
+        *reg = *script_reg(vm, operands[1]);
+        return true;
+    case script_op_jmp:
+        if ((operands = script_fetch(vm, 2)) == NULL) goto invalid;
+        vm->pc = sys_get_le16(operands);
+        return true;
+    case script_op_jeq:
+    case script_op_jne:
+        if ((operands = script_fetch(vm, 7)) == NULL) goto invalid;
+        if ((reg = script_reg(vm, operands[0])) == NULL) goto invalid;
+        if ((*reg == sys_get_le32(&operands[1])) == (*op == script_op_jeq)) {
+            vm->pc = sys_get_le16(&operands[5]);
+        }
+        return true;
+    case script_op_loop:
+        if ((operands = script_fetch(vm, 3)) == NULL) goto invalid;
+        if ((reg = script_reg(vm, operands[0])) == NULL) goto invalid;
+        if (--(*reg) != 0) {
+            vm->pc = sys_get_le16(&operands[1]);
+        }
+        return true;
+    case script_op_onfail:
+        if ((operands = script_fetch(vm, 2)) == NULL) goto invalid;
+        vm->onfail = sys_get_le16(operands);
+        return true;
+    case script_op_dp_read:
+    case script_op_dp_write:
+    case script_op_ap_read:
+    case script_op_ap_write:
+    case script_op_mem_read:
+    case script_op_mem_write:
+        if ((operands = script_fetch(vm, access_operands[*op - script_op_dp_read])) == NULL) goto invalid;
+        if (dap->swj.port == dap_port_disabled) goto invalid;
+        return script_access(dap, vm, *op, operands);
+    case script_op_sequence:
+        if ((operands = script_fetch(vm, 1)) == NULL) goto invalid;
+        uint16_t count = operands[0] == 0 ? 256 : operands[0];
+        const uint8_t *bits = script_fetch(vm, (count + 7) / 8);
+        if (bits == NULL) goto invalid;
+        script_sequence(dap, bits, count);
+        return true;
+    case script_op_delay:
+        if ((operands = script_fetch(vm, 4)) == NULL) goto invalid;
+        uint32_t delay_us = script_wait_limit(vm, sys_get_le32(operands));
+        delay_micros(delay_us);
+        if (delay_us == sys_get_le32(operands)) return true;
+        vm->result = script_result_timeout;
+        return false;
+    case script_op_nreset_wait:
+        if ((operands = script_fetch(vm, 5)) == NULL) goto invalid;
+        uint32_t wait_us = script_wait_limit(vm, sys_get_le32(&operands[1]));
+        if (swj_nreset_wait(dap, operands[0] == 0 ? 0 : 1, wait_us)) return true;
+        /* running into the time limit stops the script, rather than taking the failure branch */
+        if (wait_us != sys_get_le32(&operands[1])) {
+            vm->result = script_result_timeout;
+            return false;
+        }
+        vm->detail = 0;
+        if (vm->onfail != script_onfail_none) {
+            vm->pc = vm->onfail;
+            return true;
+        }
+        vm->result = script_result_timeout;
+        return false;
+    case script_op_nreset:
+        if ((operands = script_fetch(vm, 1)) == NULL) goto invalid;
+        gpio_pin_set_dt(&dap->io.nreset, operands[0] == 0 ? 0 : 1);
+        dap_forget_target_state(dap);
+        return true;
+    default:
+        break;
+    }
+
+invalid:
+    vm->result = script_result_invalid;
+    return false;
+}
+
+/* runs a script until it stops or hits either limit */
+static void script_execute(struct dap_driver *dap, struct script_vm *vm, uint32_t max_steps, uint32_t timeout_ms) {
+    /* both limits are checked before each instruction, and waits are cut short at the time limit */
+    vm->end = sys_timepoint_calc(K_MSEC(timeout_ms));
+    while (true) {
+        if (vm->steps >= max_steps) {
+            vm->result = script_result_steps;
+            break;
+        } else if (sys_timepoint_expired(vm->end)) {
+            vm->result = script_result_timeout;
+            break;
+        }
+        /* a stopped script reports the instruction it stopped at, rather than wherever decoding it ended */
+        uint16_t pc = vm->pc;
+        vm->steps++;
+        if (!script_step(dap, vm)) {
+            vm->pc = pc;
+            break;
+        }
+    }
+
+    /* the host's AP selection is put back, unless the script itself changed it */
+    if (vm->result == script_result_end && dap->swj.port != dap_port_disabled) {
+        uint8_t ack = mem_command_finish(dap, transfer_response_ack_ok);
+        if (ack != transfer_response_ack_ok) {
+            vm->result = script_result_transfer;
+            vm->detail = ack;
+        }
+    }
+}
+
+bool script_reset(struct dap_driver *dap) {
+    struct script_vm vm = {
+        .program = dap->script.program,
+        .pc = dap->script.reset.entry,
+        .onfail = script_onfail_none,
+        .result = script_result_invalid,
+    };
+    script_execute(dap, &vm, dap->script.reset.max_steps, dap->script.reset.timeout_ms);
+
+    if (vm.result != script_result_end) {
+        LOG_WRN("reset sequence stopped at 0x%x, result %u detail 0x%x", vm.pc, vm.result, vm.detail);
+        return false;
+    }
+    return true;
+}
+
+int32_t dap_handle_cmd_vendor_script_upload(struct dap_driver *dap) {
+    uint16_t offset = 0;
+    if (ring_buf_get_le16(&dap->buf.request, &offset) < 0) return -EMSGSIZE;
+    uint16_t len = 0;
+    if (ring_buf_get_le16(&dap->buf.request, &len) < 0) return -EMSGSIZE;
+
+    uint8_t status = dap_cmd_response_ok;
+    if (offset + len > DAP_SCRIPT_SIZE) {
+        status = dap_cmd_response_error;
+        /* process remaining request bytes */
+        uint8_t *temp = NULL;
+        if (ring_buf_get_claim(&dap->buf.request, &temp, len) != len) return -EMSGSIZE;
+        if (ring_buf_get_finish(&dap->buf.request, len) < 0) return -EMSGSIZE;
+    } else if (ring_buf_get(&dap->buf.request, &dap->script.program[offset], len) != len) {
+        return -EMSGSIZE;
+    }
+
+    uint8_t response[] = {dap_cmd_vendor_script_upload, status};
+    if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_script_run(struct dap_driver *dap) {
+    uint16_t entry = 0;
+    if (ring_buf_get_le16(&dap->buf.request, &entry) < 0) return -EMSGSIZE;
+    uint32_t max_steps = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &max_steps) < 0) return -EMSGSIZE;
+    uint32_t timeout_ms = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &timeout_ms) < 0) return -EMSGSIZE;
+
+    /* registers not given an initial value by the host start at zero */
+    struct script_vm vm = {
+        .program = dap->script.program,
+        .pc = entry,
+        .onfail = script_onfail_none,
+        .result = script_result_invalid,
+    };
+    uint8_t reg_count = 0;
+    if (ring_buf_get(&dap->buf.request, &reg_count, 1) != 1) return -EMSGSIZE;
+    for (uint8_t i = 0; i < reg_count; i++) {
+        uint32_t value = 0;
+        if (ring_buf_get_le32(&dap->buf.request, &value) < 0) return -EMSGSIZE;
+        if (i < DAP_SCRIPT_REGS) vm.regs[i] = value;
+    }
+
+    if (max_steps > 0 && timeout_ms > 0 && reg_count <= DAP_SCRIPT_REGS) {
+        script_execute(dap, &vm, max_steps, timeout_ms);
+    }
+
+    uint8_t status = vm.result == script_result_end ? dap_cmd_response_ok : dap_cmd_response_error;
+    uint8_t response[] = {dap_cmd_vendor_script_run, status, vm.result, vm.detail, 0, 0, 0, 0, 0, 0};
+    sys_put_le16(vm.pc, &response[4]);
+    sys_put_le32(vm.steps, &response[6]);
+    if (ring_buf_put(&dap->buf.response, response, sizeof(response)) != sizeof(response)) return -ENOBUFS;
+    for (uint8_t i = 0; i < DAP_SCRIPT_REGS; i++) {
+        if (ring_buf_put_le32(&dap->buf.response, vm.regs[i]) < 0) return -ENOBUFS;
+    }
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_script_reset(struct dap_driver *dap) {
+    uint16_t entry = 0;
+    if (ring_buf_get_le16(&dap->buf.request, &entry) < 0) return -EMSGSIZE;
+    uint32_t max_steps = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &max_steps) < 0) return -EMSGSIZE;
+    uint32_t timeout_ms = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &timeout_ms) < 0) return -EMSGSIZE;
+
+    /* the entry can point at any target's sequence in script memory, or at none to go back to no sequence */
+    uint8_t status = dap_cmd_response_ok;
+    if (entry != DAP_SCRIPT_ENTRY_NONE && (entry >= DAP_SCRIPT_SIZE || max_steps == 0 || timeout_ms == 0)) {
+        status = dap_cmd_response_error;
+    } else {
+        dap->script.reset.entry = entry;
+        dap->script.reset.max_steps = max_steps;
+        dap->script.reset.timeout_ms = timeout_ms;
+    }
+
+    uint8_t response[] = {dap_cmd_vendor_script_reset, status};
+    if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
+    return 0;
+}
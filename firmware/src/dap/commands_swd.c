@@ -1,6 +1,7 @@
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/sys/ring_buffer.h>
 
 #include "dap/dap.h"
@@ -60,6 +61,9 @@ int32_t dap_handle_cmd_swd_sequence(struct dap_driver *dap) {
     if (ring_buf_put_claim(&dap->buf.response, &response_status, 1) != 1) return -ENOBUFS;
     if (ring_buf_put_finish(&dap->buf.response, 1) < 0) return -ENOBUFS;
 
+    /* raw sequences leave the debug port in a state the transfer cache can't follow */
+    dap_forget_target_state(dap);
+
     uint8_t seq_count = 0;
     if (ring_buf_get(&dap->buf.request, &seq_count, 1) != 1) return -EMSGSIZE;
     for (uint8_t i = 0; i < seq_count; i++) {
@@ -136,3 +140,111 @@ int32_t dap_handle_cmd_swd_sequence(struct dap_driver *dap) {
     memcpy(response_status, &status, 1);
     return 0;
 }
+
+void swd_target_forget(struct dap_driver *dap) {
+    dap->swd.multidrop = false;
+    for (uint8_t i = 0; i < DAP_SWD_TARGET_COUNT; i++) {
+        dap->swd.targets[i].used = false;
+    }
+}
+
+/* returns the slot holding a target, or the slot it replaces if it isn't known */
+static uint8_t swd_target_slot(struct dap_driver *dap, uint32_t id) {
+    for (uint8_t i = 0; i < DAP_SWD_TARGET_COUNT; i++) {
+        if (dap->swd.targets[i].used && dap->swd.targets[i].id == id) return i;
+    }
+
+    uint8_t slot = dap->swd.next_target;
+    dap->swd.next_target = (slot + 1) % DAP_SWD_TARGET_COUNT;
+    struct dap_swd_target *target = &dap->swd.targets[slot];
+    target->id = id;
+    target->used = true;
+    target->select = 0;
+    for (uint8_t i = 0; i < DAP_TRANSFER_CACHE_APS; i++) {
+        target->aps[i].csw_valid = false;
+        target->aps[i].tar_valid = false;
+    }
+    return slot;
+}
+
+/* line reset, then a TARGETSEL write, every target deselects on the line reset and only the one matching the id
+ * selects itself again, with none of them driving the acknowledge */
+static void swd_targetsel(struct dap_driver *dap, uint32_t id) {
+    const uint8_t line_reset[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00};
+    swj_shift(dap, &dap->io.tms_swdio, line_reset, NULL, NULL, 64);
+
+    /* start, dp write to TARGETSEL, parity, stop then park bits */
+    const uint8_t header = 0x99;
+    swj_shift(dap, &dap->io.tms_swdio, &header, NULL, NULL, 8);
+
+    /* turnaround, the undriven acknowledge, and turnaround again */
+    FATAL_CHECK(
+        gpio_pin_configure_dt(&dap->io.tms_swdio, GPIO_INPUT) >= 0,
+        "tms swdio config failed"
+    );
+    for (uint8_t i = 0; i < dap->swd.turnaround_cycles * 2 + 3; i++) {
+        swd_swclk_cycle(dap);
+    }
+    FATAL_CHECK(
+        gpio_pin_configure_dt(&dap->io.tms_swdio, GPIO_INPUT | GPIO_OUTPUT) >= 0,
+        "tms swdio config failed"
+    );
+
+    /* write data and parity */
+    uint8_t data[5] = {0};
+    sys_put_le32(id, data);
+    data[4] = __builtin_parity(id);
+    swj_shift(dap, &dap->io.tms_swdio, data, NULL, NULL, 33);
+
+    /* idle cycles */
+    for (uint8_t i = 0; i < dap->transfer.idle_cycles; i++) {
+        swd_write_cycle(dap, 0);
+    }
+    gpio_pin_set_dt(&dap->io.tms_swdio, 1);
+}
+
+int32_t dap_handle_cmd_vendor_swd_targetsel(struct dap_driver *dap) {
+    uint8_t status = dap_cmd_response_ok;
+    uint32_t dpidr = 0;
+
+    uint32_t id = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &id) < 0) return -EMSGSIZE;
+    if (dap->swj.port != dap_port_swd) {
+        status = dap_cmd_response_error;
+        goto end;
+    }
+
+    /* the state of the target being left is kept for when it is next selected */
+    if (dap->swd.multidrop) {
+        struct dap_swd_target *target = &dap->swd.targets[dap->swd.target];
+        target->select = dap->transfer.select;
+        memcpy(target->aps, dap->transfer.cache.aps, sizeof(target->aps));
+    }
+    uint8_t slot = swd_target_slot(dap, id);
+    swd_targetsel(dap, id);
+
+    /* the aps of the newly selected target are as it was left, but SELECT has to be written again after a line
+     * reset, which also makes the cached ap entries usable again */
+    struct dap_swd_target *target = &dap->swd.targets[slot];
+    dap->transfer.select = target->select;
+    dap->transfer.cache.select_valid = false;
+    memcpy(dap->transfer.cache.aps, target->aps, sizeof(target->aps));
+    dap->swd.multidrop = true;
+    dap->swd.target = slot;
+
+    /* a selected target must be read from before anything else, which also tells if it exists at all */
+    uint8_t ack = dp_read(dap, dp_addr_dpidr, &dpidr);
+    if (ack != transfer_response_ack_ok) {
+        LOG_WRN("multi-drop target 0x%x didn't respond after selection, ack 0x%x", id, ack);
+        status = dap_cmd_response_error;
+        dpidr = 0;
+        dap->swd.multidrop = false;
+        target->used = false;
+    }
+
+end: ;
+    uint8_t response[] = {dap_cmd_vendor_swd_targetsel, status, 0, 0, 0, 0};
+    sys_put_le32(dpidr, &response[2]);
+    if (ring_buf_put(&dap->buf.response, response, sizeof(response)) != sizeof(response)) return -ENOBUFS;
+    return 0;
+}
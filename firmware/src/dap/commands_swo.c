@@ -13,11 +13,179 @@ LOG_MODULE_DECLARE(dap, CONFIG_DAP_LOG_LEVEL);
 static const uint8_t swo_mode_uart = 0x01;
 static const uint8_t swo_mode_manchester = 0x02;
 
+/* idle time between received bytes after which a new timestamped chunk is started */
+static const uint32_t swo_chunk_gap_us = 100;
+/* timestamp (4 bytes), dropped byte count (4 bytes), then data length (2 bytes) */
+static const uint8_t swo_chunk_header_size = 10;
+
+/* swo detection needs a minimum number of edge intervals to make a reasonable estimate */
+static const uint8_t swo_detect_min_intervals = 8;
+/* edges are timed from a gpio interrupt, whose latency is a large part of a bit period at faster rates, so
+ * above this rate the host needs to know and configure the baudrate itself */
+static const uint32_t swo_detect_max_baudrate = 200000;
+/* longest run of equal bits in a uart frame (start bit plus 8 data bits, or 8 data bits plus stop bit) */
+static const uint8_t swo_uart_max_run_bits = 9;
+
+/* returns the rate the swo uart generates for a requested baudrate, assuming the driver truncates the
+ * divisor, or 0 if the rate can't be generated at all */
+static uint32_t swo_actual_baudrate(struct dap_driver *dap, uint32_t baudrate) {
+    if (dap->io.swo_uart_clock == 0 || baudrate == 0) return baudrate;
+
+    uint64_t clocks_per_divisor = (uint64_t) dap->io.swo_uart_oversampling;
+    uint64_t divisor = dap->io.swo_uart_clock / (clocks_per_divisor * baudrate);
+    if (divisor == 0) return 0;
+    return (uint32_t) (dap->io.swo_uart_clock / (clocks_per_divisor * divisor));
+}
+
+/* returns the generated baudrate closest to a measured rate */
+static uint32_t swo_nearest_baudrate(struct dap_driver *dap, uint32_t baudrate) {
+    if (dap->io.swo_uart_clock == 0 || baudrate == 0) return baudrate;
+
+    uint64_t clocks_per_divisor = (uint64_t) dap->io.swo_uart_oversampling;
+    uint64_t divisor = DIV_ROUND_CLOSEST(dap->io.swo_uart_clock, clocks_per_divisor * baudrate);
+    if (divisor == 0) divisor = 1;
+    return (uint32_t) (dap->io.swo_uart_clock / (clocks_per_divisor * divisor));
+}
+
+static int32_t swo_uart_configure(struct dap_driver *dap, uint32_t baudrate) {
+    struct uart_config uart_config = {
+        .baudrate = baudrate,
+        .parity = UART_CFG_PARITY_NONE,
+        .stop_bits = UART_CFG_STOP_BITS_1,
+        .data_bits = UART_CFG_DATA_BITS_8,
+        .flow_ctrl = UART_CFG_FLOW_CTRL_NONE,
+    };
+    return uart_configure(dap->io.swo_uart, &uart_config);
+}
+
+static inline uint32_t swo_timestamp(void) {
+    return (uint32_t) k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static void swo_watermark_check(struct dap_driver *dap) {
+    uint32_t fill = dap->swo.write_index - dap->swo.read_index;
+    if (!dap->swo.above_watermark && fill >= dap->swo.high_watermark) {
+        dap->swo.above_watermark = true;
+        LOG_DBG("swo buffer reached high watermark with %u bytes", fill);
+    } else if (dap->swo.above_watermark && fill <= dap->swo.low_watermark) {
+        dap->swo.above_watermark = false;
+        LOG_DBG("swo buffer drained to low watermark with %u bytes", fill);
+    }
+}
+
+void swo_buffer_reset(struct dap_driver *dap) {
+    ring_buf_reset(&dap->buf.swo);
+    dap->swo.dropped = 0;
+    dap->swo.above_watermark = false;
+    dap->swo.write_index = 0;
+    dap->swo.read_index = 0;
+    dap->swo.last_rx = 0;
+    dap->swo.pending_dropped = 0;
+    dap->swo.chunk_count = 0;
+    dap->buf.swo_region_count = 0;
+}
+
+void swo_response_release(struct dap_driver *dap, bool sent) {
+    if (dap->buf.swo_region_count == 0) return;
+
+    uint32_t claimed = 0;
+    for (uint8_t i = 0; i < dap->buf.swo_region_count; i++) {
+        claimed += dap->buf.swo_regions[i].len;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&dap->swo.lock);
+    /* a finish of 0 bytes returns the claimed data to the buffer */
+    swo_buffer_get_finish(dap, sent ? claimed : 0);
+    dap->buf.swo_region_count = 0;
+    k_spin_unlock(&dap->swo.lock, key);
+}
+
+int32_t swo_buffer_put_finish(struct dap_driver *dap, uint32_t size) {
+    int32_t ret = ring_buf_put_finish(&dap->buf.swo, size);
+    if (ret != 0 || size == 0) return ret;
+
+    /* start a new chunk after an idle gap or lost data, when there are no free chunks the new
+     * data just extends the newest chunk */
+    uint32_t now = swo_timestamp();
+    if (dap->swo.timestamps &&
+        dap->swo.chunk_count < DAP_SWO_CHUNK_COUNT && (
+            dap->swo.chunk_count == 0 ||
+            dap->swo.pending_dropped > 0 ||
+            (now - dap->swo.last_rx) > swo_chunk_gap_us
+        )) {
+        struct dap_swo_chunk *chunk = &dap->swo.chunks[dap->swo.chunk_count++];
+        chunk->start = dap->swo.write_index;
+        chunk->timestamp = now;
+        chunk->dropped = dap->swo.pending_dropped;
+        dap->swo.pending_dropped = 0;
+    }
+    dap->swo.write_index += size;
+    dap->swo.last_rx = now;
+
+    swo_watermark_check(dap);
+    return 0;
+}
+
+int32_t swo_buffer_get_finish(struct dap_driver *dap, uint32_t size) {
+    int32_t ret = ring_buf_get_finish(&dap->buf.swo, size);
+    if (ret != 0) return ret;
+
+    dap->swo.read_index += size;
+    /* forget every chunk that has been completely removed, but keep any unreported dropped count */
+    uint8_t removed = 0;
+    uint32_t dropped = 0;
+    while (removed < dap->swo.chunk_count) {
+        uint32_t end = (removed + 1 < dap->swo.chunk_count) ?
+            dap->swo.chunks[removed + 1].start :
+            dap->swo.write_index;
+        if ((int32_t) (end - dap->swo.read_index) > 0) break;
+        dropped += dap->swo.chunks[removed].dropped;
+        removed++;
+    }
+    if (removed > 0) {
+        dap->swo.chunk_count -= removed;
+        memmove(
+            &dap->swo.chunks[0],
+            &dap->swo.chunks[removed],
+            dap->swo.chunk_count * sizeof(struct dap_swo_chunk)
+        );
+        if (dap->swo.chunk_count > 0) {
+            dap->swo.chunks[0].dropped += dropped;
+        } else {
+            dap->swo.pending_dropped += dropped;
+        }
+    }
+
+    swo_watermark_check(dap);
+    return 0;
+}
+
+void swo_detect_edge(const struct device *port, struct gpio_callback *cb, gpio_port_pins_t pins) {
+    ARG_UNUSED(port);
+    ARG_UNUSED(pins);
+
+    struct dap_driver *dap = CONTAINER_OF(cb, struct dap_driver, swo.detect.callback);
+    uint32_t now = k_cycle_get_32();
+
+    /* an edge latched while the interrupt was being disabled comes after every interval is filled */
+    if (dap->swo.detect.edges > DAP_SWO_DETECT_COUNT) return;
+    if (dap->swo.detect.edges > 0) {
+        dap->swo.detect.intervals[dap->swo.detect.edges - 1] = now - dap->swo.detect.last_edge;
+    }
+    dap->swo.detect.last_edge = now;
+    dap->swo.detect.edges++;
+
+    if (dap->swo.detect.edges > DAP_SWO_DETECT_COUNT) {
+        gpio_pin_interrupt_configure_dt(&dap->io.tdo, GPIO_INT_DISABLE);
+        k_sem_give(&dap->swo.detect.done);
+    }
+}
+
 void swo_capture_control(struct dap_driver *dap, bool enable) {
     if (enable) {
         dap->swo.capture = true;
         dap->swo.overrun = false;
-        ring_buf_reset(&dap->buf.swo);
+        swo_buffer_reset(dap);
         uart_irq_err_enable(dap->io.swo_uart);
         uart_irq_rx_enable(dap->io.swo_uart);
     } else {
@@ -83,15 +251,9 @@ int32_t dap_handle_cmd_swo_baudrate(struct dap_driver *dap) {
     
     /* if currently in UART mode then re-configure the driver */
     if (dap->swo.mode == swo_mode_uart) {
-        struct uart_config uart_config = {
-            .baudrate = baudrate,
-            .parity = UART_CFG_PARITY_NONE,
-            .stop_bits = UART_CFG_STOP_BITS_1,
-            .data_bits = UART_CFG_DATA_BITS_8,
-            .flow_ctrl = UART_CFG_FLOW_CTRL_NONE,
-        };
-        if (uart_configure(dap->io.swo_uart, &uart_config) == 0) {
-            dap->swo.baudrate = baudrate;
+        if (swo_uart_configure(dap, baudrate) == 0) {
+            /* the uart can only generate discrete divisions of its clock, report the actual rate */
+            dap->swo.baudrate = swo_actual_baudrate(dap, baudrate);
         } else {
             /* a rate of 0 indicates the baudrate was not configured */
             dap->swo.baudrate = 0;
@@ -173,26 +335,207 @@ int32_t dap_handle_cmd_swo_data(struct dap_driver *dap) {
     if (ring_buf_put_claim(&dap->buf.response, &response_count_ptr, 2) != 2) return -ENOBUFS;
     if (ring_buf_put_finish(&dap->buf.response, 2) < 0) return -ENOBUFS;
 
-    /* actual count of bytes retreived from the SWO buffer */
+    /* actual count of bytes written into the response, including any chunk headers */
     uint16_t count = 0;
+    int32_t ret = 0;
+
+    k_spinlock_key_t key = k_spin_lock(&dap->swo.lock);
+
+    /* if nothing follows this command in the response, the swo data doesn't need to be copied, the buffer
+     * regions are claimed and handed directly to the transport, and only released after the send */
+    if (!dap->swo.timestamps && ring_buf_is_empty(&dap->buf.request)) {
+        /* transports gather the claimed regions behind the response into a single packet, so they can't
+         * make up more than what is left of one packet after the response header */
+        uint32_t claim_max = DAP_MAX_PACKET_SIZE - MIN(ring_buf_size_get(&dap->buf.response), DAP_MAX_PACKET_SIZE);
+        claim_max = MIN(claim_max, max_count);
+        while (count < claim_max && dap->buf.swo_region_count < ARRAY_SIZE(dap->buf.swo_regions)) {
+            struct dap_transport_buf *region = &dap->buf.swo_regions[dap->buf.swo_region_count];
+            region->len = ring_buf_get_claim(&dap->buf.swo, &region->data, claim_max - count);
+            if (region->len == 0) break;
+            dap->buf.swo_region_count++;
+            count += (uint16_t) region->len;
+        }
+    }
+
+    while (dap->buf.swo_region_count == 0 && count < max_count && ring_buf_size_get(&dap->buf.swo) > 0) {
+        uint32_t read_size = MIN(max_count - count, ring_buf_space_get(&dap->buf.response));
+
+        if (dap->swo.timestamps) {
+            /* only start a chunk if there is room for at least one byte of data after the header */
+            if (dap->swo.chunk_count == 0 || read_size <= swo_chunk_header_size) break;
+
+            struct dap_swo_chunk *chunk = &dap->swo.chunks[0];
+            uint32_t chunk_end = (dap->swo.chunk_count > 1) ?
+                dap->swo.chunks[1].start :
+                dap->swo.write_index;
+            read_size = MIN(read_size - swo_chunk_header_size, chunk_end - dap->swo.read_index);
+
+            uint8_t header[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+            sys_put_le32(chunk->timestamp, &header[0]);
+            sys_put_le32(chunk->dropped, &header[4]);
+            sys_put_le16((uint16_t) read_size, &header[8]);
+            if (ring_buf_put(&dap->buf.response, header, sizeof(header)) != sizeof(header)) {
+                ret = -ENOBUFS;
+                break;
+            }
+            /* the dropped count has now been reported, following headers of this chunk just show 0 */
+            chunk->dropped = 0;
+            count += sizeof(header);
+        } else {
+            read_size = MIN(read_size, ring_buf_size_get(&dap->buf.swo));
+            if (read_size == 0) break;
+        }
 
-    /* we may need to process a claim multiple times, in case our copies overlap a ring buffer gap */
-    do {
-        uint8_t *swo_ptr;
-        uint32_t swo_read_size = ring_buf_get_claim(&dap->buf.swo, &swo_ptr, max_count);
-        uint8_t *response_ptr;
-        uint32_t response_write_size = ring_buf_put_claim(&dap->buf.response, &response_ptr, swo_read_size);
-        memcpy(response_ptr, swo_ptr, response_write_size);
-        int32_t get_ret = ring_buf_get_finish(&dap->buf.swo, response_write_size);
-        int32_t put_ret = ring_buf_put_finish(&dap->buf.response, response_write_size);
-        if (get_ret != 0 || put_ret != 0) { return -ENOBUFS; }
-        count += (uint16_t) response_write_size;
-    } while (
-        count < max_count &&
-        ring_buf_size_get(&dap->buf.swo) > 0 &&
-        ring_buf_space_get(&dap->buf.response) > 0
-    );
+        /* we may need to process a claim multiple times, in case our copies overlap a ring buffer gap */
+        while (read_size > 0) {
+            uint8_t *swo_ptr;
+            uint32_t swo_read_size = ring_buf_get_claim(&dap->buf.swo, &swo_ptr, read_size);
+            uint8_t *response_ptr;
+            uint32_t response_write_size = ring_buf_put_claim(&dap->buf.response, &response_ptr, swo_read_size);
+            memcpy(response_ptr, swo_ptr, response_write_size);
+            int32_t get_ret = swo_buffer_get_finish(dap, response_write_size);
+            int32_t put_ret = ring_buf_put_finish(&dap->buf.response, response_write_size);
+            if (get_ret != 0 || put_ret != 0 || response_write_size == 0) {
+                ret = -ENOBUFS;
+                break;
+            }
+            read_size -= response_write_size;
+            count += (uint16_t) response_write_size;
+        }
+        if (ret < 0) break;
+    }
+    k_spin_unlock(&dap->swo.lock, key);
+    if (ret < 0) return ret;
 
     sys_put_le16(count, response_count_ptr);
     return 0;
 }
+
+int32_t dap_handle_cmd_vendor_swo_configure(struct dap_driver *dap) {
+    /* configuration flags */
+    const uint8_t flags_timestamps = 0x01;
+
+    uint8_t status = dap_cmd_response_ok;
+
+    uint8_t policy = 0;
+    uint8_t flags = 0;
+    uint16_t high_watermark = 0;
+    uint16_t low_watermark = 0;
+    if (ring_buf_get(&dap->buf.request, &policy, 1) != 1) return -EMSGSIZE;
+    if (ring_buf_get(&dap->buf.request, &flags, 1) != 1) return -EMSGSIZE;
+    if (ring_buf_get_le16(&dap->buf.request, &high_watermark) < 0) return -EMSGSIZE;
+    if (ring_buf_get_le16(&dap->buf.request, &low_watermark) < 0) return -EMSGSIZE;
+
+    /* the buffer layout can't change underneath active capture, so only allow changes while disabled */
+    if (dap->swo.capture ||
+        (policy != dap_swo_overflow_drop_new && policy != dap_swo_overflow_overwrite_oldest) ||
+        (flags & ~flags_timestamps) != 0 ||
+        high_watermark > DAP_SWO_RING_BUF_SIZE ||
+        low_watermark > high_watermark) {
+        status = dap_cmd_response_error;
+        goto end;
+    }
+
+    dap->swo.overflow_policy = policy;
+    dap->swo.timestamps = (flags & flags_timestamps) != 0;
+    dap->swo.high_watermark = high_watermark;
+    dap->swo.low_watermark = low_watermark;
+
+end: ;
+    uint8_t response[] = {dap_cmd_vendor_swo_configure, status};
+    if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_swo_statistics(struct dap_driver *dap) {
+    if (ring_buf_put(&dap->buf.response, &dap_cmd_vendor_swo_statistics, 1) != 1) return -ENOBUFS;
+
+    uint8_t trace_capture = dap->swo.capture ? 0x01 : 0x00;
+    uint8_t trace_watermark = dap->swo.above_watermark ? 0x02 : 0x00;
+    uint8_t trace_error = dap->swo.error ? 0x40 : 0x00;
+    uint8_t trace_overrun = dap->swo.overrun ? 0x80 : 0x00;
+    uint8_t trace_status = trace_capture | trace_watermark | trace_error | trace_overrun;
+
+    k_spinlock_key_t key = k_spin_lock(&dap->swo.lock);
+    uint32_t trace_count = ring_buf_size_get(&dap->buf.swo);
+    uint32_t dropped = dap->swo.dropped;
+    k_spin_unlock(&dap->swo.lock, key);
+
+    if (ring_buf_put(&dap->buf.response, &trace_status, 1) != 1) return -ENOBUFS;
+    if (ring_buf_put_le32(&dap->buf.response, trace_count) < 0) return -ENOBUFS;
+    if (ring_buf_put_le32(&dap->buf.response, dropped) < 0) return -ENOBUFS;
+
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_swo_baudrate_detect(struct dap_driver *dap) {
+    uint16_t timeout_ms = 0;
+    if (ring_buf_get_le16(&dap->buf.request, &timeout_ms) < 0) return -EMSGSIZE;
+    if (ring_buf_put(&dap->buf.response, &dap_cmd_vendor_swo_baudrate_detect, 1) != 1) return -ENOBUFS;
+
+    /* a rate of 0 indicates the baudrate could not be detected */
+    uint32_t baudrate = 0;
+    if (dap->swj.port != dap_port_swd || dap->swo.mode != swo_mode_uart) goto end;
+
+    /* pause any capture, and time the swo line edges through the gpio function of the tdo/swo pin */
+    uart_irq_rx_disable(dap->io.swo_uart);
+    if (dap_configure_pin(&dap->pinctrl.jtag_state_pins) != 0) {
+        /* the pin was never taken from the uart, so capture carries on as it was */
+        if (dap->swo.capture) uart_irq_rx_enable(dap->io.swo_uart);
+        goto end;
+    }
+    FATAL_CHECK(gpio_pin_configure_dt(&dap->io.tdo, GPIO_INPUT) >= 0, "tdo config failed");
+
+    dap->swo.detect.edges = 0;
+    k_sem_reset(&dap->swo.detect.done);
+    gpio_pin_interrupt_configure_dt(&dap->io.tdo, GPIO_INT_EDGE_BOTH);
+    k_sem_take(&dap->swo.detect.done, K_MSEC(timeout_ms));
+    gpio_pin_interrupt_configure_dt(&dap->io.tdo, GPIO_INT_DISABLE);
+
+    FATAL_CHECK(dap_configure_pin(&dap->pinctrl.swd_state_pins) == 0, "tdo/swo pinctrl failed");
+    if (dap->swo.capture) uart_irq_rx_enable(dap->io.swo_uart);
+
+    uint8_t intervals = MIN(dap->swo.detect.edges > 0 ? dap->swo.detect.edges - 1 : 0, DAP_SWO_DETECT_COUNT);
+    if (intervals < swo_detect_min_intervals) {
+        LOG_WRN("only %u swo edges seen, can't detect baudrate", dap->swo.detect.edges);
+        goto end;
+    }
+
+    /* the shortest interval between edges is the first estimate of a single bit period */
+    uint32_t bit_cycles = UINT32_MAX;
+    for (uint8_t i = 0; i < intervals; i++) {
+        bit_cycles = MIN(bit_cycles, dap->swo.detect.intervals[i]);
+    }
+    if (bit_cycles == 0) goto end;
+
+    /* refine the estimate using every interval that could lie within a single frame, as a whole number
+     * of bit periods, which averages out the error from any single edge */
+    uint64_t total_cycles = 0;
+    uint32_t total_bits = 0;
+    for (uint8_t i = 0; i < intervals; i++) {
+        uint32_t bits = DIV_ROUND_CLOSEST(dap->swo.detect.intervals[i], bit_cycles);
+        if (bits <= swo_uart_max_run_bits) {
+            total_cycles += dap->swo.detect.intervals[i];
+            total_bits += bits;
+        }
+    }
+    uint32_t measured = (uint32_t) ((uint64_t) sys_clock_hw_cycles_per_sec() * total_bits / total_cycles);
+    if (measured > swo_detect_max_baudrate) {
+        LOG_WRN("measured swo baudrate %u is too fast to detect reliably", measured);
+        goto end;
+    }
+
+    /* configure the uart with the rate it can generate closest to the measurement */
+    baudrate = swo_nearest_baudrate(dap, measured);
+    LOG_INF("measured swo baudrate %u, using %u", measured, baudrate);
+    if (swo_uart_configure(dap, baudrate) == 0) {
+        dap->swo.baudrate = baudrate;
+    } else {
+        baudrate = 0;
+        dap->swo.baudrate = 0;
+    }
+
+end: ;
+    if (ring_buf_put_le32(&dap->buf.response, baudrate) < 0) return -ENOBUFS;
+    return 0;
+}
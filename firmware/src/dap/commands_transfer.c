@@ -8,31 +8,8 @@
 
 LOG_MODULE_DECLARE(dap, CONFIG_DAP_LOG_LEVEL);
 
-/* jtag ir instructions */
-static const uint8_t jtag_ir_abort = 0x08;
-static const uint8_t jtag_ir_dpacc = 0x0a;
-static const uint8_t jtag_ir_apacc = 0x0b;
-
-/* debug port addresses */
-static const uint8_t dp_addr_rdbuff = 0x0c;
-
-/* dap transfer request bits */
-static const uint8_t transfer_request_apndp = 0x01;
-static const uint8_t transfer_request_rnw = 0x02;
-static const uint8_t transfer_request_match_value = 0x10;
-static const uint8_t transfer_request_match_mask = 0x20;
-
-static const uint8_t transfer_request_apndp_shift = 0x00;
-static const uint8_t transfer_request_rnw_shift = 0x01;
-static const uint8_t transfer_request_a2_shift = 0x02;
-static const uint8_t transfer_request_a3_shift = 0x03;
-
-/* dap transfer response bits */
-static const uint8_t transfer_response_ack_ok = 0x01;
-static const uint8_t transfer_response_ack_wait = 0x02;
-static const uint8_t transfer_response_fault = 0x04;
-static const uint8_t transfer_response_error = 0x08;
-static const uint8_t transfer_response_value_mismatch = 0x10;
+/* longest a single match read polls for */
+static const uint32_t transfer_match_timeout_max_us = 3000000;
 
 int32_t dap_handle_cmd_transfer_configure(struct dap_driver *dap) {
     if (ring_buf_get(&dap->buf.request, &dap->transfer.idle_cycles, 1) != 1) return -EMSGSIZE;
@@ -44,28 +21,39 @@ int32_t dap_handle_cmd_transfer_configure(struct dap_driver *dap) {
     return 0;
 }
 
-uint8_t jtag_transfer(struct dap_driver *dap, uint8_t request, uint32_t *transfer_data) {
-    /* assumes we are starting in idle tap state, move to select-dr-scan */
-    gpio_pin_set_dt(&dap->io.tms_swdio, 1);
-    jtag_tck_cycle(dap);
-
-    /* capture-dr, then shift-dr */
-    gpio_pin_set_dt(&dap->io.tms_swdio, 0);
-    jtag_tck_cycle(dap);
-    jtag_tck_cycle(dap);
+/* gets one bit out of an lsb first bit string */
+static inline uint8_t transfer_bit(const uint8_t *bits, uint16_t offset) {
+    return (bits[offset / 8] >> (offset % 8)) & 0x01;
+}
 
-    /* bypass for every tap before the current index */
-    for (uint8_t i = 0; i < dap->jtag.index; i++) {
-        jtag_tck_cycle(dap);
+uint8_t jtag_transfer(struct dap_driver *dap, uint8_t request, uint32_t *transfer_data) {
+    uint8_t after_index = dap->jtag.count - dap->jtag.index - 1;
+
+    /* the scan is the bypass bits for every tap before the current index and the request bits, then the data and
+     * the bypass bits after the index, each shifted a word at a time with the bypass bits already set */
+    uint8_t head[DIV_ROUND_UP(DAP_JTAG_MAX_DEVICE_COUNT + 3, 8)];
+    uint8_t head_captured[sizeof(head)] = {0};
+    uint16_t head_bits = dap->jtag.index + 3;
+    memset(head, 0xff, DIV_ROUND_UP(head_bits, 8));
+    uint8_t request_bits = ((request >> transfer_request_rnw_shift) & 0x01) |
+        (((request >> transfer_request_a2_shift) & 0x01) << 1) |
+        (((request >> transfer_request_a3_shift) & 0x01) << 2);
+    for (uint8_t i = 0; i < 3; i++) {
+        uint16_t offset = dap->jtag.index + i;
+        head[offset / 8] &= ~BIT(offset % 8);
+        head[offset / 8] |= ((request_bits >> i) & 0x01) << (offset % 8);
     }
 
+    jtag_goto_state(dap, jtag_state_shift_dr);
+
     /* set RnW, A2, and A3, and get previous ack[0..2]. ack[0] and ack[1] are swapped here
      * because the bottom two bits of the JTAG ack response are flipped from the dap transfer
      * ack response (i.e. jtag ack ok/fault = 0x2, dap ack ok/fault = 0x1) */
+    swj_shift(dap, &dap->io.tdi, head, &dap->io.tdo, head_captured, head_bits);
     uint8_t ack = 0;
-    ack |= jtag_tdio_cycle(dap, request >> transfer_request_rnw_shift) << 1;
-    ack |= jtag_tdio_cycle(dap, request >> transfer_request_a2_shift) << 0;
-    ack |= jtag_tdio_cycle(dap, request >> transfer_request_a3_shift) << 2;
+    ack |= transfer_bit(head_captured, dap->jtag.index) << 1;
+    ack |= transfer_bit(head_captured, dap->jtag.index + 1) << 0;
+    ack |= transfer_bit(head_captured, dap->jtag.index + 2) << 2;
 
     if (ack != transfer_response_ack_ok) {
         /* exit-1-dr */
@@ -74,61 +62,33 @@ uint8_t jtag_transfer(struct dap_driver *dap, uint8_t request, uint32_t *transfe
         goto end;
     }
 
-    uint32_t dr = 0;
+    /* reads ignore the data shifted in, so tdi just stays where the last request bit left it */
+    uint8_t tail[4 + DIV_ROUND_UP(DAP_JTAG_MAX_DEVICE_COUNT, 8)];
+    uint8_t tail_captured[sizeof(tail)] = {0};
+    uint16_t tail_bits = 32 + after_index;
+    memset(tail, 0xff, DIV_ROUND_UP(tail_bits, 8));
     if ((request & transfer_request_rnw) != 0) {
-        /* get bits 0..30 */
-        for (uint8_t i = 0; i < 31; i++) {
-            dr |= jtag_tdo_cycle(dap) << i;
-        }
-
-        uint8_t after_index = dap->jtag.count - dap->jtag.index - 1;
-        if (after_index > 0) {
-            /* get bit 31, then bypass after index */
-            dr |= jtag_tdo_cycle(dap) << 31;
-            for (uint8_t i = 0; i < after_index - 1; i++) {
-                jtag_tck_cycle(dap);
-            }
-            /* bypass, then exit-1-dr */
-            gpio_pin_set_dt(&dap->io.tms_swdio, 1);
-            jtag_tck_cycle(dap);
-        } else {
-            /* get bit 31, then exit-1-dr */
-            gpio_pin_set_dt(&dap->io.tms_swdio, 1);
-            dr |= jtag_tdo_cycle(dap) << 31;
-        }
-
-        *transfer_data = dr;
+        sys_put_le32(((request >> transfer_request_a3_shift) & 0x01) != 0 ? UINT32_MAX : 0, tail);
     } else {
-        dr = *transfer_data;
-
-        /* set bits 0..30 */
-        for (uint8_t i = 0; i < 31; i++) {
-            jtag_tdi_cycle(dap, dr);
-            dr >>= 1;
-        }
+        sys_put_le32(*transfer_data, tail);
+    }
 
-        uint8_t after_index = dap->jtag.count - dap->jtag.index - 1;
-        if (after_index > 0) {
-            /* set bit 31, then bypass after index */
-            jtag_tdi_cycle(dap, dr);
-            for (uint8_t i = 0; i < after_index - 1; i++) {
-                jtag_tck_cycle(dap);
-            }
-            /* bypass, then exit-1-dr */
-            gpio_pin_set_dt(&dap->io.tms_swdio, 1);
-            jtag_tck_cycle(dap);
-        } else {
-            /* set bit 31, then exit-1-dr */
-            gpio_pin_set_dt(&dap->io.tms_swdio, 1);
-            jtag_tdi_cycle(dap, dr);
-        }
+    /* everything but the last bit, which moves to exit-1-dr */
+    swj_shift(dap, &dap->io.tdi, tail, &dap->io.tdo, tail_captured, tail_bits - 1);
+    gpio_pin_set_dt(&dap->io.tms_swdio, 1);
+    uint8_t last = jtag_tdio_cycle(dap, transfer_bit(tail, tail_bits - 1));
+    if ((request & transfer_request_rnw) != 0) {
+        *transfer_data = sys_get_le32(tail_captured) | (after_index == 0 ? (uint32_t) last << 31 : 0);
     }
 
 end:
-    /* update-dr, then idle */
-    jtag_tck_cycle(dap);
-    gpio_pin_set_dt(&dap->io.tms_swdio, 0);
-    jtag_tck_cycle(dap);
+    dap->jtag.state = jtag_state_exit1_dr;
+    jtag_goto_state(dap, jtag_state_update_dr);
+
+    /* without idle cycles, the next scan goes straight from update-dr to select-dr-scan */
+    if (dap->transfer.idle_cycles > 0) {
+        jtag_goto_state(dap, jtag_state_run_test_idle);
+    }
     gpio_pin_set_dt(&dap->io.tdi, 1);
 
     /* idle for configured cycles */
@@ -258,8 +218,159 @@ uint8_t swd_transfer(struct dap_driver *dap, uint8_t request, uint32_t *transfer
     }
 }
 
-static inline uint8_t port_transfer(struct dap_driver *dap, uint8_t request, uint32_t *transfer_data) {
+void transfer_cache_invalidate(struct dap_driver *dap) {
+    dap->transfer.cache.select_valid = false;
+    for (uint8_t i = 0; i < DAP_TRANSFER_CACHE_APS; i++) {
+        dap->transfer.cache.aps[i].csw_valid = false;
+        dap->transfer.cache.aps[i].tar_valid = false;
+    }
+}
+
+/* returns the cache entry of the AP the cached SELECT points at, or NULL if SELECT isn't known */
+static struct dap_ap_cache *transfer_cache_ap(struct dap_driver *dap) {
+    if (!dap->transfer.cache.select_valid) return NULL;
+
+    uint8_t ap = dap->transfer.cache.select >> 24;
+    struct dap_ap_cache *entry = &dap->transfer.cache.aps[ap % DAP_TRANSFER_CACHE_APS];
+    if (entry->ap != ap) {
+        entry->ap = ap;
+        entry->csw_valid = false;
+        entry->tar_valid = false;
+    }
+    return entry;
+}
+
+bool transfer_cache_get(struct dap_driver *dap, uint8_t ap, uint8_t addr, uint32_t *value) {
+    if (!dap->transfer.cache.enabled) return false;
+
+    struct dap_ap_cache *entry = &dap->transfer.cache.aps[ap % DAP_TRANSFER_CACHE_APS];
+    if (entry->ap != ap) return false;
+    if (addr == ap_addr_csw && entry->csw_valid) {
+        *value = entry->csw;
+        return true;
+    } else if (addr == ap_addr_tar && entry->tar_valid) {
+        *value = entry->tar;
+        return true;
+    }
+    return false;
+}
+
+/* returns true if a write would leave a register with the value it already holds */
+static bool transfer_cache_hit(struct dap_driver *dap, uint8_t request, uint32_t data) {
+    if ((request & transfer_request_rnw) != 0) return false;
+
+    if ((request & transfer_request_apndp) == 0) {
+        return (request & 0x0c) == dp_addr_select && dap->transfer.cache.select_valid &&
+            dap->transfer.cache.select == data;
+    }
+
+    struct dap_ap_cache *entry = transfer_cache_ap(dap);
+    if (entry == NULL) return false;
+    uint8_t addr = (dap->transfer.cache.select & 0xf0) | (request & 0x0c);
+    return (addr == ap_addr_csw && entry->csw_valid && entry->csw == data) ||
+        (addr == ap_addr_tar && entry->tar_valid && entry->tar == data);
+}
+
+/* follows the register state changes made by a completed transfer */
+static void transfer_cache_update(struct dap_driver *dap, uint8_t request, uint32_t data, uint8_t ack) {
+    /* any error could have left a register with a different value than the one written */
+    if (ack != transfer_response_ack_ok) {
+        transfer_cache_invalidate(dap);
+        return;
+    }
+
+    uint8_t addr = request & 0x0c;
+    bool write = (request & transfer_request_rnw) == 0;
+    if ((request & transfer_request_apndp) == 0) {
+        if (!write) return;
+        if (addr == dp_addr_select) {
+            dap->transfer.cache.select = data;
+            dap->transfer.cache.select_valid = true;
+        } else {
+            /* aborts, power control changes and target selection can all reset AP state */
+            transfer_cache_invalidate(dap);
+        }
+        return;
+    }
+
+    struct dap_ap_cache *entry = transfer_cache_ap(dap);
+    if (entry == NULL) return;
+    addr |= dap->transfer.cache.select & 0xf0;
+    if (addr == ap_addr_csw && write) {
+        entry->csw = data;
+        entry->csw_valid = true;
+    } else if (addr == ap_addr_tar && write) {
+        entry->tar = data;
+        entry->tar_valid = true;
+    } else if (addr == ap_addr_drw && entry->tar_valid) {
+        /* single auto increment is followed within a 1KiB block, crossing a block or any other
+         * increment mode leaves the transfer address unknown */
+        if (!entry->csw_valid || (entry->csw & csw_addrinc_mask) == csw_addrinc_packed) {
+            entry->tar_valid = false;
+        } else if ((entry->csw & csw_addrinc_mask) == csw_addrinc_single) {
+            uint32_t tar = entry->tar + (1 << (entry->csw & csw_size_mask));
+            entry->tar_valid = ((tar ^ entry->tar) & ~(mem_tar_block_size - 1)) == 0;
+            entry->tar = tar;
+        }
+    }
+}
+
+void transfer_wait_reset(struct dap_driver *dap) {
+    dap->transfer.wait.ap = 0;
+    dap->transfer.wait.waits = 0;
+    dap->transfer.wait.exhausted = 0;
+    for (uint8_t i = 0; i < DAP_TRANSFER_WAIT_APS; i++) {
+        dap->transfer.wait.aps[i].ap = i;
+        dap->transfer.wait.aps[i].idle = 0;
+    }
+}
+
+/* returns the learned WAIT latency entry of the currently selected AP */
+static struct dap_ap_wait *transfer_wait_ap(struct dap_driver *dap) {
+    uint8_t ap = dap->transfer.wait.ap;
+    struct dap_ap_wait *entry = &dap->transfer.wait.aps[ap % DAP_TRANSFER_WAIT_APS];
+    if (entry->ap != ap) {
+        entry->ap = ap;
+        entry->idle = 0;
+    }
+    return entry;
+}
+
+/* clocks the bus without starting a transfer */
+static void port_idle(struct dap_driver *dap, uint32_t cycles) {
+    if (dap->swj.port == dap_port_jtag) {
+        /* without idle cycles a scan ends in update-dr, where clocking with tms high would walk the tap towards
+         * test-logic-reset */
+        jtag_goto_state(dap, jtag_state_run_test_idle);
+        gpio_pin_set_dt(&dap->io.tms_swdio, 0);
+        for (uint32_t i = 0; i < cycles; i++) {
+            jtag_tck_cycle(dap);
+        }
+    } else if (dap->swj.port == dap_port_swd) {
+        for (uint32_t i = 0; i < cycles; i++) {
+            swd_write_cycle(dap, 0);
+        }
+        gpio_pin_set_dt(&dap->io.tms_swdio, 1);
+    }
+}
+
+uint8_t port_transfer(struct dap_driver *dap, uint8_t request, uint32_t *transfer_data) {
+    if (dap->transfer.cache.enabled) {
+        /* each jtag device on the chain has its own DP */
+        if (dap->swj.port == dap_port_jtag && dap->transfer.cache.index != dap->jtag.index) {
+            transfer_cache_invalidate(dap);
+            dap->transfer.cache.index = dap->jtag.index;
+        }
+        if (transfer_cache_hit(dap, request, *transfer_data)) {
+            dap->transfer.cache.elided++;
+            return transfer_response_ack_ok;
+        }
+    }
+
     uint8_t transfer_ack = transfer_response_fault;
+    /* idle cycles before the next retry, and in total since the first WAIT */
+    uint32_t idle = 0;
+    uint32_t waited = 0;
     for (uint32_t i = 0; i < dap->transfer.wait_retries + 1; i++) {
         if (dap->swj.port == dap_port_jtag) {
             transfer_ack = jtag_transfer(dap, request, transfer_data);
@@ -267,20 +378,83 @@ static inline uint8_t port_transfer(struct dap_driver *dap, uint8_t request, uin
             transfer_ack = swd_transfer(dap, request, transfer_data);
         }
         if (transfer_ack != transfer_response_ack_wait) { break; }
+
+        dap->transfer.wait.waits++;
+        if (!dap->transfer.wait.enabled || i == dap->transfer.wait_retries) { continue; }
+        /* the first retry waits as long as the AP usually needs, later ones back off exponentially */
+        idle = idle == 0 ? CLAMP(transfer_wait_ap(dap)->idle, 1, DAP_TRANSFER_WAIT_MAX_IDLE) :
+            MIN(idle * 2, DAP_TRANSFER_WAIT_MAX_IDLE);
+        port_idle(dap, idle);
+        waited += idle;
     }
 
+    if (transfer_ack == transfer_response_ack_wait) {
+        dap->transfer.wait.exhausted++;
+    } else if (waited > 0) {
+        /* a single retry may have waited longer than needed, so creep down, rounding up so even a short
+         * latency reaches 0, but catch up quickly when it took several */
+        struct dap_ap_wait *entry = transfer_wait_ap(dap);
+        if (waited == CLAMP(entry->idle, 1, DAP_TRANSFER_WAIT_MAX_IDLE)) {
+            entry->idle -= DIV_ROUND_UP(entry->idle, 8);
+        } else {
+            /* the total waited can be many times the longest single wait */
+            uint32_t learned = ((uint32_t) entry->idle + waited + 1) / 2;
+            entry->idle = (uint16_t) MIN(learned, DAP_TRANSFER_WAIT_MAX_IDLE);
+        }
+    }
+    if (transfer_ack == transfer_response_ack_ok && (request & 0x0c) == dp_addr_select &&
+        (request & (transfer_request_apndp | transfer_request_rnw)) == 0) {
+        dap->transfer.wait.ap = *transfer_data >> 24;
+    }
+
+    if (dap->transfer.cache.enabled) {
+        transfer_cache_update(dap, request, *transfer_data, transfer_ack);
+    }
     return transfer_ack;
 }
 
-static inline void port_set_ir(struct dap_driver *dap, uint32_t *last_ir, uint32_t desired_ir) {
-    if (dap->swj.port == dap_port_jtag && (last_ir == NULL || *last_ir != desired_ir)) {
-        if (last_ir != NULL) {
-            *last_ir = desired_ir;
-        }
+void port_set_ir(struct dap_driver *dap, uint32_t desired_ir) {
+    if (dap->swj.port == dap_port_jtag) {
         jtag_set_ir(dap, desired_ir);
     }
 }
 
+/* reads until the masked value matches, either a fixed number of times or until the match timeout */
+static uint8_t transfer_match_read(struct dap_driver *dap, uint8_t request, uint32_t match_value, uint32_t *data) {
+    uint8_t ack = transfer_response_fault;
+
+    if (dap->transfer.match_timeout_us == 0) {
+        for (uint32_t i = 0; i < dap->transfer.match_retries + 1; i++) {
+            ack = port_transfer(dap, request, data);
+            if (ack != transfer_response_ack_ok || (*data & dap->transfer.match_mask) == match_value) break;
+        }
+        return ack;
+    }
+
+    /* a slow target is polled at a falling rate, sleeping between reads instead of occupying the bus */
+    k_timepoint_t end = sys_timepoint_calc(K_USEC(dap->transfer.match_timeout_us));
+    uint32_t interval_us = dap->transfer.match_interval_us;
+    while (true) {
+        ack = port_transfer(dap, request, data);
+        if (ack != transfer_response_ack_ok || (*data & dap->transfer.match_mask) == match_value) break;
+        if (sys_timepoint_expired(end)) break;
+
+        if (interval_us > 0) k_sleep(K_USEC(interval_us));
+        uint32_t interval_max_us = MAX(dap->transfer.match_interval_us, dap->transfer.match_interval_max_us);
+        interval_us = interval_us > interval_max_us / 2 ? interval_max_us : interval_us * 2;
+    }
+    return ack;
+}
+
+/* background work on the probe shares the DP with the host, so it needs to know which AP and bank
+ * the host has selected in order to restore it afterwards */
+static inline void transfer_track_select(struct dap_driver *dap, uint8_t request, uint32_t transfer_data) {
+    if ((request & (transfer_request_apndp | transfer_request_rnw)) == 0 &&
+        (request & 0x0c) == dp_addr_select) {
+        dap->transfer.select = transfer_data;
+    }
+}
+
 int32_t dap_handle_cmd_transfer(struct dap_driver *dap) {
     if (ring_buf_put(&dap->buf.response, &dap_cmd_transfer, 1) != 1) return -ENOBUFS;
     /* need a pointer to these items because we will write to them after trying the rest of the command */
@@ -293,8 +467,6 @@ int32_t dap_handle_cmd_transfer(struct dap_driver *dap) {
     /* transfer acknowledge and data storage */
     uint8_t transfer_ack = 0;
     uint32_t transfer_data = 0;
-    /* cache current ir value, only change tap ir value when needed */
-    uint32_t last_ir = 0;
     /* set after a read request is made, to capture data on the next transfer (or at end) */
     bool read_pending = false;
     bool ack_pending = false;
@@ -331,12 +503,12 @@ int32_t dap_handle_cmd_transfer(struct dap_driver *dap) {
         /* TODO: for now we are just going to do the simple thing and read the previously posted value,
          * without posting the next read if available */
         if (read_pending) {
-            port_set_ir(dap, &last_ir, jtag_ir_dpacc);
+            port_set_ir(dap, jtag_ir_dpacc);
             transfer_ack = port_transfer(dap, transfer_request_rnw | dp_addr_rdbuff , &transfer_data);
             read_pending = false;
             if (transfer_ack != transfer_response_ack_ok) { break; }
 
-            if (ring_buf_put_le32(&dap->buf.request, transfer_data) < 0) return -ENOBUFS;
+            if (ring_buf_put_le32(&dap->buf.response, transfer_data) < 0) return -ENOBUFS;
         }
 
         if ((request & transfer_request_rnw) != 0) {
@@ -344,7 +516,7 @@ int32_t dap_handle_cmd_transfer(struct dap_driver *dap) {
                 /* read with match value */
                 /* match value already stored in transfer_data, but shift it here to free up transfer_data */
                 uint32_t match_value = transfer_data;
-                port_set_ir(dap, &last_ir, request_ir);
+                port_set_ir(dap, request_ir);
                 /* if using the SWD transport and reading from the DP, we don't need to post a read request
                  * first, it will be immediately available on the later read value, otherwise post first */
                 if (dap->swj.port == dap_port_jtag || (request & transfer_request_apndp) != 0) {
@@ -353,25 +525,19 @@ int32_t dap_handle_cmd_transfer(struct dap_driver *dap) {
                     if (transfer_ack != transfer_response_ack_ok) { break; }
                 }
                 /* get and check read value */
-                for (uint32_t i = 0; i < dap->transfer.match_retries + 1; i++) {
-                    transfer_ack = port_transfer(dap, request, &transfer_data);
-                    if (transfer_ack != transfer_response_ack_ok ||
-                        (transfer_data & dap->transfer.match_mask) == match_value) {
-                        break;
-                    }
-                }
+                transfer_ack = transfer_match_read(dap, request, match_value, &transfer_data);
                 if ((transfer_data & dap->transfer.match_mask) != match_value) {
                     transfer_ack |= transfer_response_value_mismatch;
                 }
                 if (transfer_ack != transfer_response_ack_ok) { break; }
             } else {
                 /* normal read request */
-                port_set_ir(dap, &last_ir, request_ir);
+                port_set_ir(dap, request_ir);
                 transfer_ack = port_transfer(dap, request, &transfer_data);
                 if (transfer_ack != transfer_response_ack_ok) { break; }
                 /* on SWD reads to DP there is no nead to post the read, the correct data has been received */
                 if (dap->swj.port == dap_port_swd && (request & transfer_request_apndp) == 0) {
-                    if (ring_buf_put_le32(&dap->buf.request, transfer_data) < 0) return -ENOBUFS;
+                    if (ring_buf_put_le32(&dap->buf.response, transfer_data) < 0) return -ENOBUFS;
                 } else {
                     read_pending = true;
                 }
@@ -383,10 +549,13 @@ int32_t dap_handle_cmd_transfer(struct dap_driver *dap) {
                 transfer_ack = transfer_response_ack_ok;
             } else {
                 /* normal write request */
-                port_set_ir(dap, &last_ir, request_ir);
+                port_set_ir(dap, request_ir);
+                uint32_t elided = dap->transfer.cache.elided;
                 transfer_ack = port_transfer(dap, request, &transfer_data);
                 if (transfer_ack != transfer_response_ack_ok) { break; }
-                ack_pending = true;
+                transfer_track_select(dap, request, transfer_data);
+                /* a write skipped by the transfer cache has no ack to check */
+                if (dap->transfer.cache.elided == elided) ack_pending = true;
             }
         }
 
@@ -415,10 +584,10 @@ end:
 
     /* perform final read to get last transfer ack and collect pending data if needed */
     if (transfer_ack == transfer_response_ack_ok && (read_pending || ack_pending)) {
-        port_set_ir(dap, &last_ir, jtag_ir_dpacc);
+        port_set_ir(dap, jtag_ir_dpacc);
         transfer_ack = port_transfer(dap, dp_addr_rdbuff | transfer_request_rnw, &transfer_data);
         if (transfer_ack == transfer_response_ack_ok && read_pending) {
-            if (ring_buf_put_le32(&dap->buf.request, transfer_data) < 0) return -ENOBUFS;
+            if (ring_buf_put_le32(&dap->buf.response, transfer_data) < 0) return -ENOBUFS;
         }
 
         memcpy(response_response_ptr, &transfer_ack, 1);
@@ -462,7 +631,7 @@ int32_t dap_handle_cmd_transfer_block(struct dap_driver *dap) {
     }
 
     uint32_t request_ir = (request & transfer_request_apndp) ? jtag_ir_apacc : jtag_ir_dpacc;
-    port_set_ir(dap, NULL, request_ir);
+    port_set_ir(dap, request_ir);
 
     if ((request & transfer_request_rnw) != 0) {
         /* for JTAG transfers and SWD transfers to the AP, we must first post the read request */
@@ -478,7 +647,7 @@ int32_t dap_handle_cmd_transfer_block(struct dap_driver *dap) {
              * so we don't post any further transactions */
             if (count == 0) {
                 if (dap->swj.port == dap_port_jtag || (request & transfer_request_apndp) != 0) {
-                    port_set_ir(dap, &request_ir, jtag_ir_dpacc);
+                    port_set_ir(dap, jtag_ir_dpacc);
                     request = dp_addr_rdbuff | transfer_request_rnw;
                 }
             }
@@ -496,10 +665,11 @@ int32_t dap_handle_cmd_transfer_block(struct dap_driver *dap) {
             if (ring_buf_get(&dap->buf.request, (uint8_t*) &transfer_data, 4) != 4) return -EMSGSIZE;
             transfer_ack = port_transfer(dap, request, &transfer_data);
             if (transfer_ack != transfer_response_ack_ok) { goto end; }
+            transfer_track_select(dap, request, transfer_data);
             completed_count++;
         }
         /* get ack of last write */
-        port_set_ir(dap, &request_ir, jtag_ir_dpacc);
+        port_set_ir(dap, jtag_ir_dpacc);
         request = dp_addr_rdbuff | transfer_request_rnw;
         transfer_ack = port_transfer(dap, request, &transfer_data);
     }
@@ -547,7 +717,7 @@ int32_t dap_handle_cmd_write_abort(struct dap_driver *dap) {
         dap->jtag.index = index;
     }
 
-    port_set_ir(dap, NULL, jtag_ir_abort);
+    port_set_ir(dap, jtag_ir_abort);
     /* DP write, address 0x0, */
     port_transfer(dap, 0x00, &abort);
 
@@ -556,3 +726,77 @@ end: ;
     if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
     return 0;
 }
+
+int32_t dap_handle_cmd_vendor_transfer_cache(struct dap_driver *dap) {
+    /* control values */
+    const uint8_t control_disable = 0x00;
+    const uint8_t control_enable = 0x01;
+
+    uint8_t control = 0;
+    if (ring_buf_get(&dap->buf.request, &control, 1) != 1) return -EMSGSIZE;
+
+    /* the response holds the number of writes skipped since the last time the cache was controlled */
+    uint8_t response[] = {dap_cmd_vendor_transfer_cache, dap_cmd_response_ok, 0, 0, 0, 0};
+    sys_put_le32(dap->transfer.cache.elided, &response[2]);
+
+    if (control == control_disable || control == control_enable) {
+        /* nothing cached while disabled can be trusted once enabled again */
+        transfer_cache_invalidate(dap);
+        dap->transfer.cache.enabled = control == control_enable;
+        dap->transfer.cache.elided = 0;
+    } else {
+        response[1] = dap_cmd_response_error;
+    }
+
+    if (ring_buf_put(&dap->buf.response, response, sizeof(response)) != sizeof(response)) return -ENOBUFS;
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_transfer_match(struct dap_driver *dap) {
+    uint32_t timeout_us = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &timeout_us) < 0) return -EMSGSIZE;
+    uint32_t interval_us = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &interval_us) < 0) return -EMSGSIZE;
+    uint32_t interval_max_us = 0;
+    if (ring_buf_get_le32(&dap->buf.request, &interval_max_us) < 0) return -EMSGSIZE;
+
+    /* a zero timeout goes back to the retry count from DAP_TransferConfigure. the thread can't do anything
+     * else while polling, so a single read is limited to the same maximum wait as DAP_SWJ_Pins, and no sleep
+     * between reads is longer than that */
+    timeout_us = MIN(timeout_us, transfer_match_timeout_max_us);
+    dap->transfer.match_timeout_us = timeout_us;
+    dap->transfer.match_interval_us = MIN(interval_us, timeout_us);
+    dap->transfer.match_interval_max_us = MIN(interval_max_us, timeout_us);
+
+    uint8_t response[] = {dap_cmd_vendor_transfer_match, dap_cmd_response_ok};
+    if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_transfer_wait(struct dap_driver *dap) {
+    /* control values */
+    const uint8_t control_disable = 0x00;
+    const uint8_t control_enable = 0x01;
+
+    uint8_t control = 0;
+    if (ring_buf_get(&dap->buf.request, &control, 1) != 1) return -EMSGSIZE;
+
+    /* the response holds the counters and learned latencies since the last time backoff was controlled */
+    uint8_t response[2 + 8 + DAP_TRANSFER_WAIT_APS * 3] = {dap_cmd_vendor_transfer_wait, dap_cmd_response_ok};
+    sys_put_le32(dap->transfer.wait.waits, &response[2]);
+    sys_put_le32(dap->transfer.wait.exhausted, &response[6]);
+    for (uint8_t i = 0; i < DAP_TRANSFER_WAIT_APS; i++) {
+        response[10 + i * 3] = dap->transfer.wait.aps[i].ap;
+        sys_put_le16(dap->transfer.wait.aps[i].idle, &response[11 + i * 3]);
+    }
+
+    if (control == control_disable || control == control_enable) {
+        transfer_wait_reset(dap);
+        dap->transfer.wait.enabled = control == control_enable;
+    } else {
+        response[1] = dap_cmd_response_error;
+    }
+
+    if (ring_buf_put(&dap->buf.response, response, sizeof(response)) != sizeof(response)) return -ENOBUFS;
+    return 0;
+}
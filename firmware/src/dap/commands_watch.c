@@ -0,0 +1,236 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/ring_buffer.h>
+
+#include "dap/dap.h"
+#include "util.h"
+
+LOG_MODULE_DECLARE(dap, CONFIG_DAP_LOG_LEVEL);
+
+/* watch conditions, each compares the masked value of a target word */
+static const uint8_t watch_condition_equal = 0x00;
+static const uint8_t watch_condition_not_equal = 0x01;
+static const uint8_t watch_condition_changed = 0x02;
+
+/* watch index of the event raised when polling fails, with the transfer ack as its value */
+static const uint8_t watch_error_index = 0xff;
+
+/* queues an event for the host, dropping it if the buffer is full */
+static void watch_event(struct dap_driver *dap, uint8_t index, uint32_t value) {
+    uint8_t event[DAP_WATCH_EVENT_SIZE] = {index};
+    sys_put_le32(value, &event[1]);
+    sys_put_le32(k_uptime_get_32(), &event[5]);
+
+    k_mutex_lock(&dap->watch.lock, K_FOREVER);
+    if (ring_buf_space_get(&dap->buf.watch) >= sizeof(event)) {
+        ring_buf_put(&dap->buf.watch, event, sizeof(event));
+        dap->watch.events++;
+        k_sem_give(&dap->watch.available);
+    } else {
+        dap->watch.dropped++;
+    }
+    k_mutex_unlock(&dap->watch.lock);
+}
+
+/* a watched word, and the value read from it */
+struct watch_read_context {
+    const struct dap_watch *watch;
+    uint32_t value;
+};
+
+static uint8_t watch_read(struct dap_driver *dap, void *context) {
+    struct watch_read_context *read = context;
+    return mem_read(dap, read->watch->ap, read->watch->addr, &read->value, 1);
+}
+
+/* reads a single watched word, raising an event when its condition becomes true */
+static uint8_t watch_check(struct dap_driver *dap, uint8_t index, bool *deferred) {
+    struct dap_watch *watch = &dap->watch.watches[index];
+
+    struct watch_read_context read = {.watch = watch};
+    uint8_t ack = mem_shared_access(dap, watch->ap, watch_read, &read, deferred);
+    if (ack != transfer_response_ack_ok || *deferred) return ack;
+
+    uint32_t value = read.value & watch->mask;
+    bool tripped = false;
+    if (watch->condition == watch_condition_equal) {
+        tripped = value == watch->match;
+    } else if (watch->condition == watch_condition_not_equal) {
+        tripped = value != watch->match;
+    } else {
+        tripped = watch->primed && value != watch->last;
+    }
+
+    /* only the change into a tripped condition is an event, a target that stays halted raises one event */
+    if (tripped && (!watch->tripped || watch->condition == watch_condition_changed)) {
+        watch_event(dap, index, value);
+    }
+    watch->tripped = tripped;
+    watch->last = value;
+    watch->primed = true;
+    return ack;
+}
+
+void watch_reset(struct dap_driver *dap) {
+    dap->watch.state = dap_watch_state_stopped;
+    dap->watch.channel = dap_watch_channel_command;
+    dap->watch.interval_ms = 0;
+    dap->watch.events = 0;
+    dap->watch.dropped = 0;
+    for (uint8_t i = 0; i < DAP_WATCH_COUNT; i++) {
+        dap->watch.watches[i].enabled = false;
+    }
+
+    k_mutex_lock(&dap->watch.lock, K_FOREVER);
+    ring_buf_reset(&dap->buf.watch);
+    k_mutex_unlock(&dap->watch.lock);
+    k_sem_reset(&dap->watch.available);
+}
+
+void watch_poll(struct dap_driver *dap) {
+    if (dap->watch.state != dap_watch_state_running) return;
+
+    if (dap->swj.port != dap_port_disabled) {
+        /* the rest of the checks wait for the next interval once one is deferred by a sticky error from the host */
+        bool deferred = false;
+        uint8_t ack = transfer_response_ack_ok;
+        for (uint8_t i = 0; i < DAP_WATCH_COUNT && ack == transfer_response_ack_ok && !deferred; i++) {
+            if (dap->watch.watches[i].enabled) ack = watch_check(dap, i, &deferred);
+        }
+
+        if (ack != transfer_response_ack_ok && !deferred) {
+            LOG_ERR("watch poll failed with transfer response 0x%x", ack);
+            dap->watch.state = dap_watch_state_error;
+            watch_event(dap, watch_error_index, ack);
+        }
+    }
+
+    dap->watch.next_poll = sys_timepoint_calc(K_MSEC(dap->watch.interval_ms));
+}
+
+k_timeout_t watch_poll_timeout(struct dap_driver *dap) {
+    if (dap->watch.state != dap_watch_state_running) return K_FOREVER;
+    return sys_timepoint_timeout(dap->watch.next_poll);
+}
+
+int32_t watch_host_read(struct dap_driver *dap, uint8_t channel, uint8_t *buf, size_t len, k_timeout_t timeout) {
+    /* events are only ever removed whole, so the buffer always starts on an event */
+    len -= len % DAP_WATCH_EVENT_SIZE;
+
+    k_mutex_lock(&dap->watch.lock, K_FOREVER);
+    bool delivered = dap->watch.channel == channel || channel == dap_watch_channel_command;
+    uint32_t read = delivered ? ring_buf_get(&dap->buf.watch, buf, len) : 0;
+    k_mutex_unlock(&dap->watch.lock);
+    if (read > 0 || len == 0) return read;
+
+    /* a channel that isn't receiving events just waits out its timeout, leaving any wakeup for the one that is */
+    if (!delivered) {
+        k_sleep(timeout);
+    } else if (k_sem_take(&dap->watch.available, timeout) == 0) {
+        k_mutex_lock(&dap->watch.lock, K_FOREVER);
+        read = ring_buf_get(&dap->buf.watch, buf, len);
+        k_mutex_unlock(&dap->watch.lock);
+    }
+    return read;
+}
+
+void watch_host_drop(struct dap_driver *dap, uint32_t count) {
+    k_mutex_lock(&dap->watch.lock, K_FOREVER);
+    dap->watch.dropped += count;
+    k_mutex_unlock(&dap->watch.lock);
+}
+
+int32_t dap_handle_cmd_vendor_watch_control(struct dap_driver *dap) {
+    uint8_t status = dap_cmd_response_ok;
+
+    /* control values */
+    const uint8_t control_stop = 0x00;
+    const uint8_t control_set = 0x01;
+    const uint8_t control_start = 0x02;
+
+    uint8_t control = 0;
+    if (ring_buf_get(&dap->buf.request, &control, 1) != 1) return -EMSGSIZE;
+
+    if (control == control_stop) {
+        watch_reset(dap);
+    } else if (control == control_set) {
+        uint8_t index = 0;
+        if (ring_buf_get(&dap->buf.request, &index, 1) != 1) return -EMSGSIZE;
+        uint8_t ap = 0;
+        if (ring_buf_get(&dap->buf.request, &ap, 1) != 1) return -EMSGSIZE;
+        uint8_t condition = 0;
+        if (ring_buf_get(&dap->buf.request, &condition, 1) != 1) return -EMSGSIZE;
+        uint32_t addr = 0;
+        if (ring_buf_get_le32(&dap->buf.request, &addr) < 0) return -EMSGSIZE;
+        uint32_t mask = 0;
+        if (ring_buf_get_le32(&dap->buf.request, &mask) < 0) return -EMSGSIZE;
+        uint32_t match = 0;
+        if (ring_buf_get_le32(&dap->buf.request, &match) < 0) return -EMSGSIZE;
+
+        /* watches are changed while stopped, so each poll sees a consistent set */
+        if (index >= DAP_WATCH_COUNT || condition > watch_condition_changed || (addr & 0x03) != 0 ||
+            dap->watch.state == dap_watch_state_running) {
+            status = dap_cmd_response_error;
+            goto end;
+        }
+
+        struct dap_watch *watch = &dap->watch.watches[index];
+        watch->enabled = true;
+        watch->ap = ap;
+        watch->condition = condition;
+        watch->addr = addr;
+        watch->mask = mask;
+        watch->match = match & mask;
+        watch->primed = false;
+        watch->tripped = false;
+    } else if (control == control_start) {
+        uint8_t channel = 0;
+        if (ring_buf_get(&dap->buf.request, &channel, 1) != 1) return -EMSGSIZE;
+        uint16_t interval_ms = 0;
+        if (ring_buf_get_le16(&dap->buf.request, &interval_ms) < 0) return -EMSGSIZE;
+
+        if (channel > dap_watch_channel_tcp || interval_ms == 0) {
+            status = dap_cmd_response_error;
+            goto end;
+        }
+
+        /* a restart re-arms every watch against the current target state */
+        for (uint8_t i = 0; i < DAP_WATCH_COUNT; i++) {
+            dap->watch.watches[i].primed = false;
+            dap->watch.watches[i].tripped = false;
+        }
+        dap->watch.channel = channel;
+        dap->watch.interval_ms = interval_ms;
+        dap->watch.next_poll = sys_timepoint_calc(K_NO_WAIT);
+        dap->watch.state = dap_watch_state_running;
+    } else {
+        status = dap_cmd_response_error;
+    }
+
+end: ;
+    uint8_t response[] = {dap_cmd_vendor_watch_control, status};
+    if (ring_buf_put(&dap->buf.response, response, 2) != 2) return -ENOBUFS;
+    return 0;
+}
+
+int32_t dap_handle_cmd_vendor_watch_events(struct dap_driver *dap) {
+    uint8_t response[] = {dap_cmd_vendor_watch_events, dap->watch.state, 0, 0, 0, 0};
+    sys_put_le32(dap->watch.dropped, &response[2]);
+    if (ring_buf_put(&dap->buf.response, response, sizeof(response)) != sizeof(response)) return -ENOBUFS;
+
+    /* as many pending events as fit in the response, from whichever channel they were meant for */
+    uint8_t *count = NULL;
+    if (ring_buf_put_claim(&dap->buf.response, &count, 1) != 1) return -ENOBUFS;
+    if (ring_buf_put_finish(&dap->buf.response, 1) < 0) return -ENOBUFS;
+    *count = 0;
+
+    uint8_t *events = NULL;
+    uint32_t space = MIN(DAP_MAX_PACKET_SIZE - sizeof(response) - 1, UINT8_MAX * DAP_WATCH_EVENT_SIZE);
+    space = ring_buf_put_claim(&dap->buf.response, &events, space);
+    int32_t read = watch_host_read(dap, dap_watch_channel_command, events, space, K_NO_WAIT);
+    if (ring_buf_put_finish(&dap->buf.response, read) < 0) return -ENOBUFS;
+    *count = read / DAP_WATCH_EVENT_SIZE;
+
+    return 0;
+}
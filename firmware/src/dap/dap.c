@@ -26,6 +26,8 @@ static struct dap_driver dap = {
         .led_connect = GPIO_DT_SPEC_GET(DAP_DT_NODE, led_connect_gpios),
         .led_running = GPIO_DT_SPEC_GET(DAP_DT_NODE, led_running_gpios),
         .swo_uart = DEVICE_DT_GET(DT_PHANDLE(DAP_DT_NODE, swo_uart)),
+        .swo_uart_clock = DT_PROP_OR(DAP_DT_NODE, swo_uart_clock_frequency, 0),
+        .swo_uart_oversampling = DT_PROP(DAP_DT_NODE, swo_uart_oversampling),
     },
     .pinctrl = {
         .jtag_state_pins = (pinctrl_soc_pin_t) Z_PINCTRL_STATE_PINS_INIT(DAP_DT_NODE, pinctrl_jtag),
@@ -49,15 +51,36 @@ static void swo_uart_isr(const struct device *dev, void *user_data) {
     }
 
     while (uart_irq_update(dev) && uart_irq_rx_ready(dev)) {
+        k_spinlock_key_t key = k_spin_lock(&dap->swo.lock);
+
         uint8_t *ptr;
         uint32_t space = ring_buf_put_claim(&dap->buf.swo, &ptr, DAP_SWO_RING_BUF_SIZE);
+        /* the oldest data can't be discarded while a response is still sending it */
+        if (space == 0 &&
+            dap->swo.overflow_policy == dap_swo_overflow_overwrite_oldest &&
+            dap->buf.swo_region_count == 0) {
+            /* make room for the next byte by discarding the oldest byte in the buffer */
+            uint8_t *oldest;
+            ring_buf_get_claim(&dap->buf.swo, &oldest, 1);
+            swo_buffer_get_finish(dap, 1);
+            dap->swo.overrun = true;
+            dap->swo.dropped++;
+            if (dap->swo.chunk_count > 0) {
+                dap->swo.chunks[0].dropped++;
+            } else {
+                dap->swo.pending_dropped++;
+            }
+            space = ring_buf_put_claim(&dap->buf.swo, &ptr, 1);
+        }
         if (space == 0) {
             dap->swo.overrun = true;
             uint8_t drop;
             LOG_ERR("buffer full, dropping swo data");
             while (uart_fifo_read(dev, &drop, 1) > 0) {
-                continue;
+                dap->swo.dropped++;
+                dap->swo.pending_dropped++;
             }
+            k_spin_unlock(&dap->swo.lock, key);
             break;
         }
 
@@ -67,7 +90,9 @@ static void swo_uart_isr(const struct device *dev, void *user_data) {
             read = 0;
         }
         /* should never fail since we always read less than the claim size */
-        FATAL_CHECK(ring_buf_put_finish(&dap->buf.swo, read) == 0, "swo buffer read fail");  
+        FATAL_CHECK(swo_buffer_put_finish(dap, read) == 0, "swo buffer read fail");
+
+        k_spin_unlock(&dap->swo.lock, key);
     }
 
     return;
@@ -79,7 +104,8 @@ int32_t dap_reset(struct dap_driver *dap) {
     /* config the pinctrl settings for the tdo/swo pin, default to tdo functionality */
     FATAL_CHECK(dap_configure_pin(&dap->pinctrl.jtag_state_pins) == 0, "tdo/swo pinctrl failed");
 
-    /* jtag / swd gpios must be in a safe state on reset */
+    /* jtag / swd gpios must be in a safe state on reset, with any tap left between scans back in idle */
+    jtag_settle(dap);
     FATAL_CHECK(gpio_pin_configure_dt(&dap->io.tck_swclk, GPIO_INPUT) >= 0, "tck swclk config failed");
     FATAL_CHECK(gpio_pin_configure_dt(&dap->io.tms_swdio, GPIO_INPUT) >= 0, "tms swdio config failed");
     FATAL_CHECK(gpio_pin_configure_dt(&dap->io.tdo, GPIO_INPUT) >= 0, "tdo config failed");
@@ -97,6 +123,10 @@ int32_t dap_reset(struct dap_driver *dap) {
     memset(dap->jtag.ir_length, 0, sizeof(dap->jtag.ir_length));
     memset(dap->jtag.ir_before, 0, sizeof(dap->jtag.ir_before));
     memset(dap->jtag.ir_after, 0, sizeof(dap->jtag.ir_after));
+    dap->jtag.state = jtag_state_run_test_idle;
+    dap->jtag.host_placed = false;
+    dap->jtag.stream_remaining = 0;
+    dap->mem.read_remaining = 0;
     dap->swd.turnaround_cycles = 1;
     dap->swd.data_phase = false;
     dap->swo.transport = 0;
@@ -105,10 +135,18 @@ int32_t dap_reset(struct dap_driver *dap) {
     dap->swo.capture = false;
     dap->swo.error = false;
     dap->swo.overrun = false;
+    dap->swo.overflow_policy = dap_swo_overflow_drop_new;
+    dap->swo.high_watermark = DAP_SWO_RING_BUF_SIZE * 3 / 4;
+    dap->swo.low_watermark = DAP_SWO_RING_BUF_SIZE / 4;
+    dap->swo.timestamps = false;
     dap->transfer.idle_cycles = 0;
     dap->transfer.wait_retries = 100;
     dap->transfer.match_retries = 0;
+    dap->transfer.match_timeout_us = 0;
+    dap->transfer.match_interval_us = 0;
+    dap->transfer.match_interval_max_us = 0;
     dap->transfer.match_mask = 0;
+    dap->transfer.select = 0;
 
     dap->led.connected = false;
     dap->led.running = false;
@@ -129,11 +167,25 @@ int32_t dap_reset(struct dap_driver *dap) {
 
     ring_buf_reset(&dap->buf.request);
     ring_buf_reset(&dap->buf.response);
-    ring_buf_reset(&dap->buf.swo);
+    swo_buffer_reset(dap);
+    rtt_reset(dap);
+    pcsample_reset(dap);
+    flash_reset(dap);
+    watch_reset(dap);
+    dap_forget_target_state(dap);
+    dap->transfer.cache.enabled = IS_ENABLED(CONFIG_DAP_TRANSFER_CACHE);
+    transfer_wait_reset(dap);
+    dap->transfer.wait.enabled = IS_ENABLED(CONFIG_DAP_TRANSFER_WAIT_BACKOFF);
 
     return 0;
 }
 
+void dap_forget_target_state(struct dap_driver *dap) {
+    transfer_cache_invalidate(dap);
+    jtag_ir_invalidate(dap);
+    swd_target_forget(dap);
+}
+
 int32_t dap_handle_request(struct dap_driver *dap) {
     /* this will usually just run once, unless an atomic command is being used */
     uint8_t num_commands = 1;
@@ -190,6 +242,34 @@ int32_t dap_handle_request(struct dap_driver *dap) {
         else if (command == dap_cmd_swo_data) { ret = dap_handle_cmd_swo_data(dap); }
         else if (command == dap_cmd_swd_sequence) { ret = dap_handle_cmd_swd_sequence(dap); }
         else if (command == dap_cmd_swo_extended_status) { ret = dap_handle_cmd_swo_extended_status(dap); } 
+        else if (command == dap_cmd_vendor_swo_configure) { ret = dap_handle_cmd_vendor_swo_configure(dap); }
+        else if (command == dap_cmd_vendor_swo_statistics) { ret = dap_handle_cmd_vendor_swo_statistics(dap); }
+        else if (command == dap_cmd_vendor_swo_baudrate_detect) { ret = dap_handle_cmd_vendor_swo_baudrate_detect(dap); }
+        else if (command == dap_cmd_vendor_rtt_control) { ret = dap_handle_cmd_vendor_rtt_control(dap); }
+        else if (command == dap_cmd_vendor_rtt_status) { ret = dap_handle_cmd_vendor_rtt_status(dap); }
+        else if (command == dap_cmd_vendor_pcsample_control) { ret = dap_handle_cmd_vendor_pcsample_control(dap); }
+        else if (command == dap_cmd_vendor_pcsample_data) { ret = dap_handle_cmd_vendor_pcsample_data(dap); }
+        else if (command == dap_cmd_vendor_mem_read) { ret = dap_handle_cmd_vendor_mem_read(dap); }
+        else if (command == dap_cmd_vendor_mem_write) { ret = dap_handle_cmd_vendor_mem_write(dap); }
+        else if (command == dap_cmd_vendor_mem_crc32) { ret = dap_handle_cmd_vendor_mem_crc32(dap); }
+        else if (command == dap_cmd_vendor_transfer_cache) { ret = dap_handle_cmd_vendor_transfer_cache(dap); }
+        else if (command == dap_cmd_vendor_core_reg_read) { ret = dap_handle_cmd_vendor_core_reg_read(dap); }
+        else if (command == dap_cmd_vendor_core_reg_write) { ret = dap_handle_cmd_vendor_core_reg_write(dap); }
+        else if (command == dap_cmd_vendor_flash_control) { ret = dap_handle_cmd_vendor_flash_control(dap); }
+        else if (command == dap_cmd_vendor_flash_data) { ret = dap_handle_cmd_vendor_flash_data(dap); }
+        else if (command == dap_cmd_vendor_script_upload) { ret = dap_handle_cmd_vendor_script_upload(dap); }
+        else if (command == dap_cmd_vendor_script_run) { ret = dap_handle_cmd_vendor_script_run(dap); }
+        else if (command == dap_cmd_vendor_transfer_match) { ret = dap_handle_cmd_vendor_transfer_match(dap); }
+        else if (command == dap_cmd_vendor_transfer_wait) { ret = dap_handle_cmd_vendor_transfer_wait(dap); }
+        else if (command == dap_cmd_vendor_watch_control) { ret = dap_handle_cmd_vendor_watch_control(dap); }
+        else if (command == dap_cmd_vendor_watch_events) { ret = dap_handle_cmd_vendor_watch_events(dap); }
+        else if (command == dap_cmd_vendor_jtag_detect) { ret = dap_handle_cmd_vendor_jtag_detect(dap); }
+        else if (command == dap_cmd_vendor_jtag_idcodes) { ret = dap_handle_cmd_vendor_jtag_idcodes(dap); }
+        else if (command == dap_cmd_vendor_bscan_upload) { ret = dap_handle_cmd_vendor_bscan_upload(dap); }
+        else if (command == dap_cmd_vendor_bscan_run) { ret = dap_handle_cmd_vendor_bscan_run(dap); }
+        else if (command == dap_cmd_vendor_jtag_stream) { ret = dap_handle_cmd_vendor_jtag_stream(dap); }
+        else if (command == dap_cmd_vendor_swd_targetsel) { ret = dap_handle_cmd_vendor_swd_targetsel(dap); }
+        else if (command == dap_cmd_vendor_script_reset) { ret = dap_handle_cmd_vendor_script_reset(dap); }
         else {
             /* for dap_cmd_uart_*, no intention of support, since the same functionality can be found 
              * over the CDC-ACM virtual com port interface. any other command is totally unknown. */
@@ -208,6 +288,24 @@ int32_t dap_handle_request(struct dap_driver *dap) {
     return 0;
 }
 
+/* returns the time until the next piece of background work is due, from any of the background engines */
+static k_timeout_t dap_background_timeout(struct dap_driver *dap) {
+    k_timeout_t timeouts[] = {rtt_poll_timeout(dap), pcsample_poll_timeout(dap), watch_poll_timeout(dap)};
+    k_timeout_t timeout = K_FOREVER;
+    for (uint8_t i = 0; i < ARRAY_SIZE(timeouts); i++) {
+        if (K_TIMEOUT_EQ(timeouts[i], K_FOREVER)) continue;
+        if (K_TIMEOUT_EQ(timeout, K_FOREVER) || timeouts[i].ticks < timeout.ticks) timeout = timeouts[i];
+    }
+    return timeout;
+}
+
+/* runs every background engine that is due */
+static void dap_background_poll(struct dap_driver *dap) {
+    if (K_TIMEOUT_EQ(rtt_poll_timeout(dap), K_NO_WAIT)) rtt_poll(dap);
+    if (K_TIMEOUT_EQ(pcsample_poll_timeout(dap), K_NO_WAIT)) pcsample_poll(dap);
+    if (K_TIMEOUT_EQ(watch_poll_timeout(dap), K_NO_WAIT)) watch_poll(dap);
+}
+
 void dap_thread_fn(void *arg1, void *arg2, void *arg3) {
     ARG_UNUSED(arg2);
     ARG_UNUSED(arg3);
@@ -235,29 +333,68 @@ void dap_thread_fn(void *arg1, void *arg2, void *arg3) {
             uint8_t *request;
             uint32_t request_len = ring_buf_put_claim(&dap->buf.request, &request, DAP_MAX_PACKET_SIZE);
             
-            if ((ret = dap->transport->recv(request, request_len)) < 0) {
-                /* shutdown is an expected condition */
-                if (ret != -ESHUTDOWN) LOG_ERR("transport receive failed with error %d", ret);
-                dap_reset(dap);
-                continue;
-            }
-            ring_buf_put_finish(&dap->buf.request, ret);
+            /* background work runs in the gaps between requests, so the receive only waits until it is due,
+             * except in the middle of a jtag stream, where any other scan would corrupt the stream, and in the
+             * middle of a memory read, which carries on as long as nothing else arrives */
+            k_timeout_t timeout = dap->jtag.stream_remaining > 0 ? K_FOREVER :
+                dap->mem.read_remaining > 0 ? K_NO_WAIT : dap_background_timeout(dap);
+            ret = dap->transport->recv(request, request_len, timeout);
+            if (ret == -EAGAIN && dap->mem.read_remaining > 0) {
+                /* the rest of a memory read is sent without waiting for any more requests */
+                ring_buf_put_finish(&dap->buf.request, 0);
+                dap_background_poll(dap);
+                ring_buf_reset(&dap->buf.response);
+                ret = mem_read_stream_data(dap);
+            } else {
+                if (ret == -EAGAIN) {
+                    ring_buf_put_finish(&dap->buf.request, 0);
+                    dap_background_poll(dap);
+                    continue;
+                } else if (ret < 0) {
+                    /* shutdown is an expected condition */
+                    if (ret != -ESHUTDOWN) LOG_ERR("transport receive failed with error %d", ret);
+                    dap_reset(dap);
+                    continue;
+                }
+                ring_buf_put_finish(&dap->buf.request, ret);
+
+                /* any request from the host ends a memory read still being sent, then is handled as usual */
+                dap->mem.read_remaining = 0;
 
-            /* not ready to process command, start the next receive */
-            if (*request == dap_cmd_queue_commands) continue;
+                /* packets of a jtag stream are all tdi data, rather than commands */
+                bool streaming = dap->jtag.stream_remaining > 0;
+                /* not ready to process command, start the next receive */
+                if (!streaming && *request == dap_cmd_queue_commands) continue;
 
-            /* transport sends rely on having the full length of the response ring buffer from one pointer */
-            ring_buf_reset(&dap->buf.response);
-            if ((ret = dap_handle_request(dap)) < 0) {
+                /* transport sends rely on having the full length of the response ring buffer from one pointer */
+                ring_buf_reset(&dap->buf.response);
+                ret = streaming ? jtag_stream_data(dap) : dap_handle_request(dap);
+            }
+            if (ret < 0) {
                 /* commands that failed or aren't implemented get a simple 0xff reponse byte */
                 ring_buf_reset(&dap->buf.response);
+                swo_response_release(dap, false);
+                dap->mem.read_remaining = 0;
                 uint8_t response = dap_cmd_response_error;
                 FATAL_CHECK(ring_buf_put(&dap->buf.response, &response, 1) == 1, "response buf is size 0");
+            } else if (ret > 0) {
+                /* only the last packet of a stream is answered, start the next receive */
+                ring_buf_reset(&dap->buf.request);
+                continue;
+            }
+
+            /* any swo data claimed by the response is sent straight from the swo buffer, after the
+             * rest of the response data */
+            struct dap_transport_buf response[DAP_TRANSPORT_MAX_BUFS];
+            size_t response_count = 1;
+            response[0].len = ring_buf_get_claim(&dap->buf.response, &response[0].data, DAP_RING_BUF_SIZE);
+            size_t response_len = response[0].len;
+            for (uint8_t i = 0; i < dap->buf.swo_region_count; i++) {
+                response[response_count++] = dap->buf.swo_regions[i];
+                response_len += dap->buf.swo_regions[i].len;
             }
 
-            uint8_t *response;
-            uint32_t response_len = ring_buf_get_claim(&dap->buf.response, &response, DAP_RING_BUF_SIZE);
-            if ((ret = dap->transport->send(response, response_len)) < 0) {
+            if ((ret = dap->transport->send(response, response_count)) < 0) {
                 /* shutdown is an expected condition */
                 if (ret != -ESHUTDOWN) LOG_ERR("transport send failed with error %d", ret);
                 dap_reset(dap);
@@ -265,7 +402,8 @@ void dap_thread_fn(void *arg1, void *arg2, void *arg3) {
             } else if (ret < response_len) {
                 LOG_ERR("transport send dropped %d bytes", response_len - ret);
             }
-            ring_buf_get_finish(&dap->buf.response, ret);
+            ring_buf_get_finish(&dap->buf.response, MIN(ret, response[0].len));
+            swo_response_release(dap, true);
 
             /* transport receives rely on having the full length of the request ring buffer from one pointer */
             ring_buf_reset(&dap->buf.request);
@@ -273,6 +411,22 @@ void dap_thread_fn(void *arg1, void *arg2, void *arg3) {
     }
 }
 
+int32_t dap_rtt_read(uint8_t *buf, size_t len, k_timeout_t timeout) {
+    return rtt_host_read(&dap, buf, len, timeout);
+}
+
+int32_t dap_rtt_write(const uint8_t *buf, size_t len) {
+    return rtt_host_write(&dap, buf, len);
+}
+
+int32_t dap_watch_read(uint8_t channel, uint8_t *buf, size_t len, k_timeout_t timeout) {
+    return watch_host_read(&dap, channel, buf, len, timeout);
+}
+
+void dap_watch_drop(uint32_t count) {
+    watch_host_drop(&dap, count);
+}
+
 K_THREAD_DEFINE(
     dap_thread,
     KB(4),
@@ -310,9 +464,29 @@ int32_t dap_init(void) {
     uart_irq_tx_disable(dap.io.swo_uart);
     uart_irq_callback_user_data_set(dap.io.swo_uart, swo_uart_isr, (void*) &dap);
 
+    /* swo pin edge interrupts are only enabled while detecting the swo baudrate */
+    k_sem_init(&dap.swo.detect.done, 0, 1);
+    gpio_init_callback(&dap.swo.detect.callback, swo_detect_edge, BIT(dap.io.tdo.pin));
+    FATAL_CHECK(gpio_add_callback_dt(&dap.io.tdo, &dap.swo.detect.callback) >= 0, "tdo callback failed");
+
+    /* as are nreset pin edge interrupts while waiting on the pin */
+    k_sem_init(&dap.swj.nreset.edge, 0, 1);
+    gpio_init_callback(&dap.swj.nreset.callback, swj_nreset_edge, BIT(dap.io.nreset.pin));
+    FATAL_CHECK(gpio_add_callback_dt(&dap.io.nreset, &dap.swj.nreset.callback) >= 0, "nreset callback failed");
+
     ring_buf_init(&dap.buf.request, sizeof(dap.buf.request_bytes), dap.buf.request_bytes);
     ring_buf_init(&dap.buf.response, sizeof(dap.buf.response_bytes), dap.buf.response_bytes);
     ring_buf_init(&dap.buf.swo, sizeof(dap.buf.swo_bytes), dap.buf.swo_bytes);
+    ring_buf_init(&dap.buf.rtt_up, sizeof(dap.buf.rtt_up_bytes), dap.buf.rtt_up_bytes);
+    ring_buf_init(&dap.buf.rtt_down, sizeof(dap.buf.rtt_down_bytes), dap.buf.rtt_down_bytes);
+    ring_buf_init(&dap.buf.pcsample, sizeof(dap.buf.pcsample_bytes), dap.buf.pcsample_bytes);
+    ring_buf_init(&dap.buf.watch, sizeof(dap.buf.watch_bytes), dap.buf.watch_bytes);
+    k_mutex_init(&dap.rtt.lock);
+    k_sem_init(&dap.rtt.up_available, 0, 1);
+    k_mutex_init(&dap.watch.lock);
+    k_sem_init(&dap.watch.available, 0, 1);
+    /* like the script program, the reset sequence outlives host connections */
+    dap.script.reset.entry = DAP_SCRIPT_ENTRY_NONE;
 
     if ((ret = dap_reset(&dap)) < 0) return ret;
 
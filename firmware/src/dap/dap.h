@@ -12,11 +12,49 @@
 #define DAP_RING_BUF_SIZE       (2048)
 /* size of the swo uart buffer in bytes */
 #define DAP_SWO_RING_BUF_SIZE   (2048)
+/* maximum number of timestamped chunks tracked in the swo buffer */
+#define DAP_SWO_CHUNK_COUNT     (16)
+/* number of swo edge intervals measured for baudrate detection */
+#define DAP_SWO_DETECT_COUNT    (32)
+/* size of each of the rtt host channel buffers in bytes */
+#define DAP_RTT_RING_BUF_SIZE   (1024)
+/* words of target memory scanned for the rtt control block in each poll */
+#define DAP_RTT_SEARCH_WORDS    (32)
+/* maximum bytes moved in each rtt direction in each poll */
+#define DAP_RTT_POLL_BYTES      (64)
+/* size of the pc sample buffer in bytes, shared by the sample stream and the histogram bins */
+#define DAP_PCSAMPLE_BUF_SIZE   (2048)
+/* maximum number of histogram bins checked for a matching or free bin */
+#define DAP_PCSAMPLE_PROBES     (8)
+/* number of APs with register state tracked by the transfer cache */
+#define DAP_TRANSFER_CACHE_APS  (4)
+/* number of APs with a learned WAIT latency */
+#define DAP_TRANSFER_WAIT_APS   (4)
+/* most idle cycles inserted before a single retry after a WAIT response */
+#define DAP_TRANSFER_WAIT_MAX_IDLE  (4096)
+/* number of multi-drop SWD targets whose debug port state is kept while another one is selected */
+#define DAP_SWD_TARGET_COUNT    (4)
+/* number of registers the background watcher can check */
+#define DAP_WATCH_COUNT         (4)
+/* size of the buffer holding watch events until the host reads them */
+#define DAP_WATCH_RING_BUF_SIZE (252)
+/* size of a single watch event: watch index, masked value, and probe uptime in milliseconds */
+#define DAP_WATCH_EVENT_SIZE    (9)
+/* size of the on-probe script program memory */
+#define DAP_SCRIPT_SIZE         (1024)
+/* number of general purpose registers available to scripts */
+#define DAP_SCRIPT_REGS         (8)
+/* script entry point meaning no script is set */
+#define DAP_SCRIPT_ENTRY_NONE   (0xffff)
+/* size of the on-probe boundary scan vector memory */
+#define DAP_BSCAN_SIZE          (4096)
 /* maximum size for any single transport transfer */
 #define DAP_MAX_PACKET_SIZE     (512)
 
 /* maximum number of devices supported on the JTAG chain */
-#define DAP_JTAG_MAX_DEVICE_COUNT   4
+#define DAP_JTAG_MAX_DEVICE_COUNT   CONFIG_DAP_JTAG_MAX_DEVICE_COUNT
+/* longest instruction register supported for a single device on the JTAG chain */
+#define DAP_JTAG_MAX_IR_LENGTH      (32)
 
 /* default SWD/JTAG clock rate in Hz */
 static const uint32_t dap_default_swj_clock_rate = 1000000;
@@ -26,10 +64,191 @@ static const uint8_t dap_port_disabled = 0;
 static const uint8_t dap_port_jtag = 1;
 static const uint8_t dap_port_swd = 2;
 
+/* behaviour of swo capture when the swo buffer is full */
+static const uint8_t dap_swo_overflow_drop_new = 0x00;
+static const uint8_t dap_swo_overflow_overwrite_oldest = 0x01;
+
+/* state of the background rtt poller */
+static const uint8_t dap_rtt_state_stopped = 0x00;
+static const uint8_t dap_rtt_state_searching = 0x01;
+static const uint8_t dap_rtt_state_running = 0x02;
+static const uint8_t dap_rtt_state_error = 0x03;
+
+/* state of the pc sampler */
+static const uint8_t dap_pcsample_state_stopped = 0x00;
+static const uint8_t dap_pcsample_state_running = 0x01;
+static const uint8_t dap_pcsample_state_error = 0x02;
+
+/* state of the flash algorithm runner */
+static const uint8_t dap_flash_state_stopped = 0x00;
+static const uint8_t dap_flash_state_running = 0x01;
+static const uint8_t dap_flash_state_error = 0x02;
+
+/* state of the background watcher */
+static const uint8_t dap_watch_state_stopped = 0x00;
+static const uint8_t dap_watch_state_running = 0x01;
+static const uint8_t dap_watch_state_error = 0x02;
+
+/* where watch events are delivered, the vendor watch events command reads them on any channel */
+static const uint8_t dap_watch_channel_command = 0x00;
+static const uint8_t dap_watch_channel_usb = 0x01;
+static const uint8_t dap_watch_channel_tcp = 0x02;
+
+/* where each pc sample is read from */
+static const uint8_t dap_pcsample_source_pcsr = 0x00;
+static const uint8_t dap_pcsample_source_halt = 0x01;
+
+/* how pc samples are kept until the host reads them */
+static const uint8_t dap_pcsample_output_stream = 0x00;
+static const uint8_t dap_pcsample_output_histogram = 0x01;
+
+/* jtag ir instructions */
+static const uint8_t jtag_ir_abort = 0x08;
+static const uint8_t jtag_ir_dpacc = 0x0a;
+static const uint8_t jtag_ir_apacc = 0x0b;
+static const uint8_t jtag_ir_idcode = 0x0e;
+/* instruction held by every device not being accessed, all ones regardless of ir length */
+static const uint32_t jtag_ir_bypass = 0xffffffff;
+
+/* jtag tap controller states, in IEEE 1149.1 order */
+static const uint8_t jtag_state_test_logic_reset = 0;
+static const uint8_t jtag_state_run_test_idle = 1;
+static const uint8_t jtag_state_select_dr_scan = 2;
+static const uint8_t jtag_state_capture_dr = 3;
+static const uint8_t jtag_state_shift_dr = 4;
+static const uint8_t jtag_state_exit1_dr = 5;
+static const uint8_t jtag_state_pause_dr = 6;
+static const uint8_t jtag_state_exit2_dr = 7;
+static const uint8_t jtag_state_update_dr = 8;
+static const uint8_t jtag_state_select_ir_scan = 9;
+static const uint8_t jtag_state_capture_ir = 10;
+static const uint8_t jtag_state_shift_ir = 11;
+static const uint8_t jtag_state_exit1_ir = 12;
+static const uint8_t jtag_state_pause_ir = 13;
+static const uint8_t jtag_state_exit2_ir = 14;
+static const uint8_t jtag_state_update_ir = 15;
+
+/* debug port addresses */
+static const uint8_t dp_addr_abort = 0x00;
+static const uint8_t dp_addr_dpidr = 0x00;
+static const uint8_t dp_addr_ctrl_stat = 0x04;
+static const uint8_t dp_addr_select = 0x08;
+static const uint8_t dp_addr_rdbuff = 0x0c;
+static const uint8_t dp_addr_targetsel = 0x0c;
+
+/* mem-ap register addresses */
+static const uint8_t ap_addr_csw = 0x00;
+static const uint8_t ap_addr_tar = 0x04;
+static const uint8_t ap_addr_drw = 0x0c;
+static const uint8_t ap_addr_bd0 = 0x10;
+
+/* mem-ap control status word fields */
+static const uint32_t csw_size_mask = 0x07;
+static const uint32_t csw_size_byte = 0x00;
+static const uint32_t csw_size_word = 0x02;
+static const uint32_t csw_addrinc_mask = 0x30;
+static const uint32_t csw_addrinc_single = 0x10;
+static const uint32_t csw_addrinc_packed = 0x20;
+
+/* transfer address auto increment is only guaranteed to work within a 1KiB block */
+static const uint32_t mem_tar_block_size = 0x400;
+
+/* cortex-m core debug register addresses, all within a single 16 byte bank */
+static const uint32_t dhcsr = 0xe000edf0;
+static const uint32_t dcrsr = 0xe000edf4;
+static const uint32_t dcrdr = 0xe000edf8;
+
+/* debug halting control and status register fields */
+static const uint32_t dhcsr_dbgkey = 0xa05f0000;
+static const uint32_t dhcsr_c_debugen = 0x00000001;
+static const uint32_t dhcsr_c_halt = 0x00000002;
+static const uint32_t dhcsr_c_maskints = 0x00000008;
+static const uint32_t dhcsr_s_regrdy = 0x00010000;
+static const uint32_t dhcsr_s_halt = 0x00020000;
+
+/* debug core register selector fields */
+static const uint32_t dcrsr_regsel_mask = 0x7f;
+static const uint32_t dcrsr_regwnr = 0x00010000;
+
+/* dap transfer request bits */
+static const uint8_t transfer_request_apndp = 0x01;
+static const uint8_t transfer_request_rnw = 0x02;
+static const uint8_t transfer_request_match_value = 0x10;
+static const uint8_t transfer_request_match_mask = 0x20;
+
+static const uint8_t transfer_request_apndp_shift = 0x00;
+static const uint8_t transfer_request_rnw_shift = 0x01;
+static const uint8_t transfer_request_a2_shift = 0x02;
+static const uint8_t transfer_request_a3_shift = 0x03;
+
+/* dap transfer response bits */
+static const uint8_t transfer_response_ack_ok = 0x01;
+static const uint8_t transfer_response_ack_wait = 0x02;
+static const uint8_t transfer_response_fault = 0x04;
+static const uint8_t transfer_response_error = 0x08;
+static const uint8_t transfer_response_value_mismatch = 0x10;
+
 /* possible status responses to commands */
 static const uint8_t dap_cmd_response_ok = 0x00;
 static const uint8_t dap_cmd_response_error = 0xff;
 
+/* a run of swo bytes received together, along with the probe time of the first byte */
+struct dap_swo_chunk {
+    /* running swo buffer index of the first byte in the chunk */
+    uint32_t start;
+    /* probe uptime in microseconds when the first byte was received */
+    uint32_t timestamp;
+    /* number of bytes discarded directly before this chunk */
+    uint32_t dropped;
+};
+
+/* number of pc samples taken at a single pc */
+struct dap_pcsample_bin {
+    uint32_t pc;
+    /* a count of 0 marks an unused bin */
+    uint32_t count;
+};
+
+/* last known MEM-AP register state on the wire */
+struct dap_ap_cache {
+    /* index of the AP this entry belongs to */
+    uint8_t ap;
+    bool csw_valid;
+    bool tar_valid;
+    uint32_t csw;
+    uint32_t tar;
+};
+
+struct dap_watch {
+    bool enabled;
+    /* index of the MEM-AP the watched word is read through */
+    uint8_t ap;
+    uint8_t condition;
+    uint32_t addr;
+    uint32_t mask;
+    uint32_t match;
+    /* masked value and condition result from the previous poll, only valid once primed */
+    bool primed;
+    bool tripped;
+    uint32_t last;
+};
+
+struct dap_ap_wait {
+    /* index of the AP this entry belongs to */
+    uint8_t ap;
+    /* typical number of idle cycles the AP needs before it stops answering WAIT */
+    uint16_t idle;
+};
+
+struct dap_swd_target {
+    /* TARGETSEL value of the target, only valid if used is set */
+    uint32_t id;
+    bool used;
+    /* host SELECT value and AP transfer cache entries, put back when the target is selected again */
+    uint32_t select;
+    struct dap_ap_cache aps[DAP_TRANSFER_CACHE_APS];
+};
+
 struct dap_driver {
     struct {
         struct gpio_dt_spec tck_swclk;
@@ -42,6 +261,10 @@ struct dap_driver {
         struct gpio_dt_spec led_running;
 
         const struct device *swo_uart;
+        /* input clock of the swo uart baud rate generator in hz, or 0 if unknown */
+        uint32_t swo_uart_clock;
+        /* swo uart baud rate generator clocks per bit */
+        uint8_t swo_uart_oversampling;
     } io;
     struct {
         pinctrl_soc_pin_t jtag_state_pins;
@@ -56,6 +279,11 @@ struct dap_driver {
         uint32_t clock;
         /* nanosecond pin delay based off above clock rate */
         uint32_t delay_ns;
+        /* nreset pin edges, interrupts are only enabled while waiting on the pin */
+        struct {
+            struct gpio_callback callback;
+            struct k_sem edge;
+        } nreset;
     } swj;
     struct {
         /* number of devices in chain */
@@ -68,12 +296,27 @@ struct dap_driver {
         uint16_t ir_before[DAP_JTAG_MAX_DEVICE_COUNT];
         /* ir length after each device in the chain */
         uint16_t ir_after[DAP_JTAG_MAX_DEVICE_COUNT];
+        /* instruction each device in the chain currently holds, only valid if ir_valid is set */
+        uint32_t ir[DAP_JTAG_MAX_DEVICE_COUNT];
+        bool ir_valid;
+        /* tap controller state the chain was left in, such as update-dr after a transfer */
+        uint8_t state;
+        /* set while the tap is wherever a host sequence left it, where the next host sequence expects it */
+        bool host_placed;
+        /* tdi bits of a stream into shift-dr still expected from the host, every packet is stream data while set */
+        uint32_t stream_remaining;
     } jtag;
     struct {
         /* turnaround clock period of the SWD bus */
         uint8_t turnaround_cycles;
         /* whether or not to generate a data phase */
         bool data_phase;
+        /* set while a multi-drop target selected by the probe is the one on the wire, in the target slot */
+        bool multidrop;
+        uint8_t target;
+        /* slot the next target not already known replaces */
+        uint8_t next_target;
+        struct dap_swd_target targets[DAP_SWD_TARGET_COUNT];
     } swd;
     struct {
         /* transport for swo data to host */
@@ -88,6 +331,40 @@ struct dap_driver {
         bool error;
         /* true if the swo buffer has overrun, clears on swo enable */
         bool overrun;
+        /* behaviour when the swo buffer is full */
+        uint8_t overflow_policy;
+        /* total number of bytes discarded due to a full buffer, clears on swo enable */
+        uint32_t dropped;
+        /* buffer fill levels in bytes that trigger the high and low watermark notifications */
+        uint16_t high_watermark;
+        uint16_t low_watermark;
+        /* set once the fill level reaches the high watermark, until it falls back to the low watermark */
+        bool above_watermark;
+        /* if true then swo data is returned in chunks, each with a timestamp header */
+        bool timestamps;
+        /* running indices of bytes written to and removed from the swo buffer */
+        uint32_t write_index;
+        uint32_t read_index;
+        /* probe uptime in microseconds of the last received byte */
+        uint32_t last_rx;
+        /* bytes discarded since the last chunk was created, assigned to the next chunk */
+        uint32_t pending_dropped;
+        /* timestamped chunks currently in the swo buffer, oldest first */
+        struct dap_swo_chunk chunks[DAP_SWO_CHUNK_COUNT];
+        uint8_t chunk_count;
+        /* protects the swo buffer and chunk state between the uart isr and the dap thread */
+        struct k_spinlock lock;
+        /* swo pin edge measurements for baudrate detection */
+        struct {
+            struct gpio_callback callback;
+            struct k_sem done;
+            /* cycle count at the most recent edge */
+            uint32_t last_edge;
+            /* number of edges seen so far */
+            uint8_t edges;
+            /* cycle counts between consecutive edges */
+            uint32_t intervals[DAP_SWO_DETECT_COUNT];
+        } detect;
     } swo;
     struct {
         /* number of extra idle cycles after each transfer */
@@ -96,9 +373,160 @@ struct dap_driver {
         uint16_t wait_retries;
         /* number of retries on reads with value match */
         uint16_t match_retries;
+        /* if non-zero, reads with value match retry for this long instead of match_retries times */
+        uint32_t match_timeout_us;
+        /* delay between timed match reads, doubling after each mismatch up to the maximum */
+        uint32_t match_interval_us;
+        uint32_t match_interval_max_us;
         /* read match mask */
         uint32_t match_mask;
+        /* last value written to the DP SELECT register by the host */
+        uint32_t select;
+        /* WAIT response handling, retries are spaced out by idle cycles learned for each AP */
+        struct {
+            bool enabled;
+            /* AP selected by the last SELECT write on the wire, whose entry the next WAIT uses */
+            uint8_t ap;
+            struct dap_ap_wait aps[DAP_TRANSFER_WAIT_APS];
+            /* WAIT responses, and transfers that still answered WAIT after every retry */
+            uint32_t waits;
+            uint32_t exhausted;
+        } wait;
+        /* last known DP and AP register state on the wire, used to skip writes that change nothing */
+        struct {
+            bool enabled;
+            bool select_valid;
+            uint32_t select;
+            /* jtag device the cached state belongs to */
+            uint8_t index;
+            /* ap entries, indexed by the low bits of the ap index */
+            struct dap_ap_cache aps[DAP_TRANSFER_CACHE_APS];
+            /* number of writes skipped */
+            uint32_t elided;
+        } cache;
     } transfer;
+    struct {
+        /* access port, access size and next address of a memory read still being sent to the host */
+        uint8_t read_ap;
+        uint8_t read_size;
+        uint32_t read_addr;
+        /* bytes of the read left to send, every response is read data while set */
+        uint32_t read_remaining;
+    } mem;
+    struct {
+        /* current state of the background poller */
+        uint8_t state;
+        /* index of the MEM-AP used for all rtt accesses */
+        uint8_t ap;
+        /* start and size of the control block search range, a size of 0 uses the start directly */
+        uint32_t search_addr;
+        uint32_t search_size;
+        /* offset of the next search slice into the search range */
+        uint32_t search_offset;
+        /* target address of the located control block */
+        uint32_t control_block;
+        /* channel indices forwarded to and from the host */
+        uint8_t up_channel;
+        uint8_t down_channel;
+        /* target addresses of the up and down buffer descriptors */
+        uint32_t up_desc;
+        uint32_t down_desc;
+        /* target buffer address and size, read once from each buffer descriptor */
+        uint32_t up_buf;
+        uint32_t up_size;
+        uint32_t down_buf;
+        uint32_t down_size;
+        /* time between polls while the target buffers are empty */
+        uint16_t interval_ms;
+        k_timepoint_t next_poll;
+        /* total bytes moved in each direction */
+        uint32_t up_bytes;
+        uint32_t down_bytes;
+        /* protects the host channel buffers between the dap thread and the channel transport */
+        struct k_mutex lock;
+        /* signalled whenever new up-channel data is available to the host */
+        struct k_sem up_available;
+    } rtt;
+    struct {
+        /* current state of the sampler */
+        uint8_t state;
+        /* index of the MEM-AP used to reach the core */
+        uint8_t ap;
+        /* sample source and output format */
+        uint8_t source;
+        uint8_t output;
+        /* time between samples */
+        uint32_t interval_us;
+        /* probe uptime in microseconds when the next sample is due */
+        uint64_t next_sample;
+        /* total samples taken */
+        uint32_t samples;
+        /* samples discarded because the buffer was full, or no histogram bin was free */
+        uint32_t lost;
+        /* histogram bin the next host read starts from */
+        uint16_t bin_cursor;
+    } pcsample;
+    struct {
+        /* current state of the runner */
+        uint8_t state;
+        /* index of the MEM-AP used to reach the core */
+        uint8_t ap;
+        /* algorithm entry point of ProgramPage, and the register state every algorithm call starts with */
+        uint32_t program_page;
+        uint32_t static_base;
+        uint32_t stack_pointer;
+        /* address of a breakpoint instruction the algorithm returns to */
+        uint32_t breakpoint;
+        /* target ram page buffers, one is filled while the algorithm programs the other */
+        uint32_t buffers[2];
+        uint8_t buffer;
+        uint32_t page_size;
+        /* value unwritten bytes of a partial page are padded with */
+        uint8_t erased;
+        /* longest time a single algorithm call may run */
+        uint32_t timeout_ms;
+        /* flash address of the page being filled, and the number of bytes in it so far */
+        uint32_t address;
+        uint32_t offset;
+        /* set while the algorithm is programming a page, with the flash address of that page */
+        bool busy;
+        uint32_t busy_address;
+        /* transfer ack and algorithm result of the last failure, and the flash address it failed at */
+        uint8_t ack;
+        uint32_t result;
+        uint32_t error_address;
+    } flash;
+    struct {
+        /* current state of the watcher */
+        uint8_t state;
+        /* channel events are delivered to */
+        uint8_t channel;
+        struct dap_watch watches[DAP_WATCH_COUNT];
+        /* time between polls */
+        uint16_t interval_ms;
+        k_timepoint_t next_poll;
+        /* events raised, and events discarded because the event buffer was full */
+        uint32_t events;
+        uint32_t dropped;
+        /* protects the event buffer between the dap thread and the event channels */
+        struct k_mutex lock;
+        /* signalled whenever a new event is available */
+        struct k_sem available;
+    } watch;
+    struct {
+        /* bytecode uploaded by the host, kept until overwritten */
+        uint8_t program[DAP_SCRIPT_SIZE];
+        /* reset sequence run by DAP_ResetTarget and its limits, also kept until overwritten */
+        struct {
+            uint16_t entry;
+            uint32_t max_steps;
+            uint32_t timeout_ms;
+        } reset;
+    } script;
+    struct {
+        /* boundary scan vectors uploaded by the host, kept until overwritten */
+        uint8_t vectors[DAP_BSCAN_SIZE];
+    } bscan;
 
     struct {
         bool combined : 1;
@@ -114,6 +542,23 @@ struct dap_driver {
         struct ring_buf response;
         uint8_t swo_bytes[DAP_SWO_RING_BUF_SIZE];
         struct ring_buf swo;
+        /* regions of the swo buffer claimed by the current response, sent directly after the response buffer */
+        struct dap_transport_buf swo_regions[DAP_TRANSPORT_MAX_BUFS - 1];
+        uint8_t swo_region_count;
+        /* rtt data read from the target and waiting for the host, and vice-versa */
+        uint8_t rtt_up_bytes[DAP_RTT_RING_BUF_SIZE];
+        struct ring_buf rtt_up;
+        uint8_t rtt_down_bytes[DAP_RTT_RING_BUF_SIZE];
+        struct ring_buf rtt_down;
+        /* pc samples waiting for the host, as a stream of samples or as histogram bins */
+        union {
+            uint8_t pcsample_bytes[DAP_PCSAMPLE_BUF_SIZE];
+            struct dap_pcsample_bin pcsample_bins[DAP_PCSAMPLE_BUF_SIZE / sizeof(struct dap_pcsample_bin)];
+        };
+        struct ring_buf pcsample;
+        /* watch events waiting for the host, always whole events */
+        uint8_t watch_bytes[DAP_WATCH_RING_BUF_SIZE];
+        struct ring_buf watch;
     } buf;
 
     struct dap_transport *transport;
@@ -148,6 +593,34 @@ static const uint8_t dap_cmd_swd_sequence = 0x1d;
 static const uint8_t dap_cmd_swo_extended_status = 0x1e;
 static const uint8_t dap_cmd_queue_commands = 0x7e;
 static const uint8_t dap_cmd_execute_commands = 0x7f;
+static const uint8_t dap_cmd_vendor_swo_configure = 0x80;
+static const uint8_t dap_cmd_vendor_swo_statistics = 0x81;
+static const uint8_t dap_cmd_vendor_swo_baudrate_detect = 0x82;
+static const uint8_t dap_cmd_vendor_rtt_control = 0x83;
+static const uint8_t dap_cmd_vendor_rtt_status = 0x84;
+static const uint8_t dap_cmd_vendor_pcsample_control = 0x85;
+static const uint8_t dap_cmd_vendor_pcsample_data = 0x86;
+static const uint8_t dap_cmd_vendor_mem_read = 0x87;
+static const uint8_t dap_cmd_vendor_mem_write = 0x88;
+static const uint8_t dap_cmd_vendor_mem_crc32 = 0x89;
+static const uint8_t dap_cmd_vendor_transfer_cache = 0x8a;
+static const uint8_t dap_cmd_vendor_core_reg_read = 0x8b;
+static const uint8_t dap_cmd_vendor_core_reg_write = 0x8c;
+static const uint8_t dap_cmd_vendor_flash_control = 0x8d;
+static const uint8_t dap_cmd_vendor_flash_data = 0x8e;
+static const uint8_t dap_cmd_vendor_script_upload = 0x8f;
+static const uint8_t dap_cmd_vendor_script_run = 0x90;
+static const uint8_t dap_cmd_vendor_transfer_match = 0x91;
+static const uint8_t dap_cmd_vendor_transfer_wait = 0x92;
+static const uint8_t dap_cmd_vendor_watch_control = 0x93;
+static const uint8_t dap_cmd_vendor_watch_events = 0x94;
+static const uint8_t dap_cmd_vendor_jtag_detect = 0x95;
+static const uint8_t dap_cmd_vendor_jtag_idcodes = 0x96;
+static const uint8_t dap_cmd_vendor_bscan_upload = 0x97;
+static const uint8_t dap_cmd_vendor_bscan_run = 0x98;
+static const uint8_t dap_cmd_vendor_jtag_stream = 0x99;
+static const uint8_t dap_cmd_vendor_swd_targetsel = 0x9a;
+static const uint8_t dap_cmd_vendor_script_reset = 0x9b;
 
 /* command handlers */
 int32_t dap_handle_cmd_info(struct dap_driver *dap);
@@ -176,6 +649,44 @@ int32_t dap_handle_cmd_swo_status(struct dap_driver *dap);
 int32_t dap_handle_cmd_swo_data(struct dap_driver *dap);
 int32_t dap_handle_cmd_swd_sequence(struct dap_driver *dap);
 int32_t dap_handle_cmd_swo_extended_status(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_swo_configure(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_swo_statistics(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_swo_baudrate_detect(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_rtt_control(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_rtt_status(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_pcsample_control(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_pcsample_data(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_mem_read(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_mem_write(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_mem_crc32(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_transfer_cache(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_core_reg_read(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_core_reg_write(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_flash_control(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_flash_data(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_script_upload(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_script_run(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_transfer_match(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_transfer_wait(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_watch_control(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_watch_events(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_jtag_detect(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_jtag_idcodes(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_bscan_upload(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_bscan_run(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_jtag_stream(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_swd_targetsel(struct dap_driver *dap);
+int32_t dap_handle_cmd_vendor_script_reset(struct dap_driver *dap);
+
+/** @brief clocks bits lsb first out of a pin, sampling another pin into capture if it isn't NULL */
+void swj_shift(
+    struct dap_driver *dap,
+    const struct gpio_dt_spec *out,
+    const uint8_t *data,
+    const struct gpio_dt_spec *in,
+    uint8_t *capture,
+    uint16_t bits
+);
 
 /** @brief performs single tck clock cycle */
 void jtag_tck_cycle(struct dap_driver *dap);
@@ -185,8 +696,19 @@ void jtag_tdi_cycle(struct dap_driver *dap, uint8_t tdi);
 uint8_t jtag_tdo_cycle(struct dap_driver *dap);
 /** @brief performs clock cycle with tdi data output and tdo data retreival */
 uint8_t jtag_tdio_cycle(struct dap_driver *dap, uint8_t tdi);
-/** @brief sets JTAG IR instruction */
+/** @brief sets JTAG IR instruction, skipped if the chain already holds it */
 void jtag_set_ir(struct dap_driver *dap, uint32_t ir);
+/** @brief forgets the instructions held by the JTAG chain, after anything that could have changed them */
+void jtag_ir_invalidate(struct dap_driver *dap);
+/** @brief moves the JTAG tap controllers to a new state with the fewest possible tck cycles */
+void jtag_goto_state(struct dap_driver *dap, uint8_t state);
+/** @brief tracks the JTAG tap controllers through tms bits a raw sequence clocked out, lsb first */
+void jtag_follow_tms(struct dap_driver *dap, const uint8_t *tms, uint16_t count);
+/** @brief returns the JTAG tap controllers to run-test/idle, where host sequences expect to find them after
+ * the probe's own scans */
+void jtag_settle(struct dap_driver *dap);
+/** @brief shifts a packet of jtag stream data, returning 1 if more is expected before the stream is answered */
+int32_t jtag_stream_data(struct dap_driver *dap);
 
 /** @brief reads single SWD bit */
 uint8_t swd_read_cycle(struct dap_driver *dap);
@@ -194,9 +716,130 @@ uint8_t swd_read_cycle(struct dap_driver *dap);
 void swd_write_cycle(struct dap_driver *dap, uint8_t swdio);
 /** @brief performs single swclk clock cycle */
 void swd_swclk_cycle(struct dap_driver *dap);
+/** @brief forgets every multi-drop target, after the wire was driven in a way the probe can't follow */
+void swd_target_forget(struct dap_driver *dap);
+
+/** @brief forgets everything the probe tracks about the target's debug port, after anything that could
+ * have changed it behind the probe's back */
+void dap_forget_target_state(struct dap_driver *dap);
+/** @brief performs a single DP or AP transfer on the current port, retrying on WAIT responses */
+uint8_t port_transfer(struct dap_driver *dap, uint8_t request, uint32_t *transfer_data);
+/** @brief sets the JTAG IR on the JTAG port, does nothing on the SWD port */
+void port_set_ir(struct dap_driver *dap, uint32_t desired_ir);
+
+/** @brief forgets all cached DP and AP register state, after anything that could have changed it */
+void transfer_cache_invalidate(struct dap_driver *dap);
+/** @brief forgets the learned WAIT latencies and clears the WAIT counters */
+void transfer_wait_reset(struct dap_driver *dap);
+/** @brief gets the cached value of a MEM-AP CSW or TAR register, returns false if it isn't known */
+bool transfer_cache_get(struct dap_driver *dap, uint8_t ap, uint8_t addr, uint32_t *value);
+
+/** @brief reads a DP register, returns the transfer ack */
+uint8_t dp_read(struct dap_driver *dap, uint8_t addr, uint32_t *data);
+/** @brief writes a DP register, returns the transfer ack */
+uint8_t dp_write(struct dap_driver *dap, uint8_t addr, uint32_t data);
+/** @brief reads an AP register, selecting the AP and register bank first */
+uint8_t ap_read(struct dap_driver *dap, uint8_t ap, uint8_t addr, uint32_t *data);
+/** @brief writes an AP register, selecting the AP and register bank first */
+uint8_t ap_write(struct dap_driver *dap, uint8_t ap, uint8_t addr, uint32_t data);
+/** @brief reads words of target memory through a MEM-AP, addr must be word aligned */
+uint8_t mem_read(struct dap_driver *dap, uint8_t ap, uint32_t addr, uint32_t *data, uint32_t count);
+/** @brief writes words of target memory through a MEM-AP, addr must be word aligned */
+uint8_t mem_write(struct dap_driver *dap, uint8_t ap, uint32_t addr, const uint32_t *data, uint32_t count);
+/** @brief reads target memory with accesses of 1 << size bytes, addr and len must be size aligned */
+uint8_t mem_read_sized(struct dap_driver *dap, uint8_t ap, uint32_t addr, uint8_t size, uint8_t *data, uint32_t len);
+/** @brief writes target memory with accesses of 1 << size bytes, addr and len must be size aligned */
+uint8_t mem_write_sized(struct dap_driver *dap, uint8_t ap, uint32_t addr, uint8_t size, const uint8_t *data, uint32_t len);
+/** @brief reads bytes of target memory through a MEM-AP, with no alignment requirements */
+uint8_t mem_read_bytes(struct dap_driver *dap, uint8_t ap, uint32_t addr, uint8_t *data, uint32_t len);
+/** @brief writes bytes of target memory through a MEM-AP, with no alignment requirements */
+uint8_t mem_write_bytes(struct dap_driver *dap, uint8_t ap, uint32_t addr, const uint8_t *data, uint32_t len);
+/** @brief an access the probe makes on its own, passed the context given to mem_shared_access */
+typedef uint8_t (*mem_shared_access_t)(struct dap_driver *dap, void *context);
+/** @brief runs a probe access on a MEM-AP the host is also using, restoring the AP state and the host's AP
+ * selection afterwards, and clearing sticky errors if the access fails. deferred is set, and nothing is
+ * accessed, while the host has a sticky error of its own flagged */
+uint8_t mem_shared_access(struct dap_driver *dap, uint8_t ap, mem_shared_access_t access, void *context,
+    bool *deferred);
+/** @brief reads registers of a halted cortex-m core, a register transfer the core never completes is
+ * reported as a wait, completed is set to the number of registers read */
+uint8_t core_reg_read(struct dap_driver *dap, uint8_t ap, const uint8_t *regsel, uint32_t *values, uint32_t count,
+    uint32_t *completed);
+/** @brief writes registers of a halted cortex-m core, a register transfer the core never completes is
+ * reported as a wait, completed is set to the number of registers written */
+uint8_t core_reg_write(struct dap_driver *dap, uint8_t ap, const uint8_t *regsel, const uint32_t *values,
+    uint32_t count, uint32_t *completed);
+/** @brief returns a fault if the DP has a sticky error flagged */
+uint8_t dp_check_errors(struct dap_driver *dap);
+/** @brief clears any sticky DP errors left behind by a failed transfer */
+void dp_clear_errors(struct dap_driver *dap);
+/** @brief ends a probe command that accessed memory, reporting a sticky error from its last access and
+ * restoring the host's AP selection */
+uint8_t mem_command_finish(struct dap_driver *dap, uint8_t ack);
+/** @brief reads the next packet of a memory read that didn't fit in its first response */
+int32_t mem_read_stream_data(struct dap_driver *dap);
+
+/** @brief stops the rtt poller and empties the host channel buffers */
+void rtt_reset(struct dap_driver *dap);
+/** @brief runs a single bounded slice of rtt work, between host requests */
+void rtt_poll(struct dap_driver *dap);
+/** @brief returns the time until the rtt poller next needs to run */
+k_timeout_t rtt_poll_timeout(struct dap_driver *dap);
+/** @brief moves up-channel data into buf, waiting up to timeout for it to arrive */
+int32_t rtt_host_read(struct dap_driver *dap, uint8_t *buf, size_t len, k_timeout_t timeout);
+/** @brief queues down-channel data from the host, returns the number of bytes accepted, discarding any while no
+ * down channel is being serviced */
+int32_t rtt_host_write(struct dap_driver *dap, const uint8_t *buf, size_t len);
+
+/** @brief stops the pc sampler and discards all samples */
+void pcsample_reset(struct dap_driver *dap);
+/** @brief takes any pc samples that are due, between host requests */
+void pcsample_poll(struct dap_driver *dap);
+/** @brief returns the time until the next pc sample is due */
+k_timeout_t pcsample_poll_timeout(struct dap_driver *dap);
+
+/** @brief stops the flash algorithm runner and forgets its configuration */
+void flash_reset(struct dap_driver *dap);
+
+/** @brief runs the reset sequence script set by the host, returns true if it ran to its end */
+bool script_reset(struct dap_driver *dap);
+
+/** @brief stops the watcher, forgets every watch and discards pending events */
+void watch_reset(struct dap_driver *dap);
+/** @brief checks every watch once, between host requests */
+void watch_poll(struct dap_driver *dap);
+/** @brief returns the time until the watcher next needs to run */
+k_timeout_t watch_poll_timeout(struct dap_driver *dap);
+/** @brief moves whole events for the given channel into buf, waiting up to timeout for one to arrive */
+int32_t watch_host_read(struct dap_driver *dap, uint8_t channel, uint8_t *buf, size_t len, k_timeout_t timeout);
+/** @brief counts events an event channel read but couldn't deliver as dropped */
+void watch_host_drop(struct dap_driver *dap, uint32_t count);
+
+/** @brief moves rtt up-channel data from the dap driver into buf, waiting up to timeout */
+int32_t dap_rtt_read(uint8_t *buf, size_t len, k_timeout_t timeout);
+/** @brief queues rtt down-channel data for the dap driver, returns the number of bytes accepted */
+int32_t dap_rtt_write(const uint8_t *buf, size_t len);
+/** @brief moves whole watch events for the given channel from the dap driver into buf, waiting up to timeout */
+int32_t dap_watch_read(uint8_t channel, uint8_t *buf, size_t len, k_timeout_t timeout);
+/** @brief counts watch events read from the dap driver that never reached the host as dropped */
+void dap_watch_drop(uint32_t count);
 
 /** @brief enables SWO uart capture */
 void swo_capture_control(struct dap_driver *dap, bool enable);
+/** @brief records SWO pin edges during baudrate detection */
+void swo_detect_edge(const struct device *port, struct gpio_callback *cb, gpio_port_pins_t pins);
+/** @brief signals nRESET pin edges while waiting on the pin */
+void swj_nreset_edge(const struct device *port, struct gpio_callback *cb, gpio_port_pins_t pins);
+/** @brief waits until nRESET reaches a level or the timeout passes, returns true if the level was reached */
+bool swj_nreset_wait(struct dap_driver *dap, uint8_t level, uint32_t timeout_us);
+/** @brief empties the SWO buffer and clears all tracked chunk and overflow state */
+void swo_buffer_reset(struct dap_driver *dap);
+/** @brief releases SWO buffer regions claimed by a response, removing the data if it was sent */
+void swo_response_release(struct dap_driver *dap, bool sent);
+/** @brief finishes a SWO buffer put claim and tracks the new data, must hold the SWO lock */
+int32_t swo_buffer_put_finish(struct dap_driver *dap, uint32_t size);
+/** @brief finishes a SWO buffer get claim and tracks the removed data, must hold the SWO lock */
+int32_t swo_buffer_get_finish(struct dap_driver *dap, uint32_t size);
 
 /** @brief configure a dap_driver pinctrl state */
 static inline int32_t dap_configure_pin(const pinctrl_soc_pin_t *pinctrl_state) {
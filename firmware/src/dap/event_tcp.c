@@ -0,0 +1,107 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/socket.h>
+
+#include "dap/dap.h"
+
+LOG_MODULE_REGISTER(dap_event_tcp, CONFIG_DAP_LOG_LEVEL);
+
+/* how long to wait for an event before checking whether the client is still there */
+static const int32_t event_tcp_poll_ms = 100;
+
+static uint8_t event_tcp_buf[DAP_WATCH_EVENT_SIZE * 8];
+
+static int32_t event_tcp_listen(void) {
+    int32_t sock;
+
+    /* an IPv6 socket will still allow IPv4 connections using an IPv4-mapped IPv6 address */
+    struct sockaddr_in6 sock_addr = {
+        .sin6_family = AF_INET6,
+        .sin6_addr = IN6ADDR_ANY_INIT,
+        .sin6_port = sys_cpu_to_be16(CONFIG_DAP_EVENT_TCP_PORT),
+    };
+
+    if ((sock = zsock_socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+        LOG_ERR("socket initialize failed with error %d", errno);
+        return -1 * errno;
+    }
+    if (zsock_bind(sock, (struct sockaddr*) &sock_addr, sizeof(sock_addr)) < 0) {
+        LOG_ERR("socket bind failed with error %d", errno);
+        zsock_close(sock);
+        return -1 * errno;
+    }
+    if (zsock_listen(sock, 1) < 0) {
+        LOG_ERR("socket listen failed with error %d", errno);
+        zsock_close(sock);
+        return -1 * errno;
+    }
+
+    return sock;
+}
+
+/* sends watch events to a single connected client as they are raised, until the client goes away */
+static void event_tcp_serve(int32_t sock) {
+    while (1) {
+        /* the client never sends anything, so readable means it closed the connection */
+        struct zsock_pollfd poll_fd = { .fd = sock, .events = ZSOCK_POLLIN };
+        if (zsock_poll(&poll_fd, 1, 0) < 0) {
+            LOG_ERR("socket poll failed with error %d", errno);
+            return;
+        }
+        if ((poll_fd.revents & (ZSOCK_POLLIN | ZSOCK_POLLHUP | ZSOCK_POLLERR)) != 0) return;
+
+        int32_t read = dap_watch_read(
+            dap_watch_channel_tcp,
+            event_tcp_buf,
+            sizeof(event_tcp_buf),
+            K_MSEC(event_tcp_poll_ms)
+        );
+        if (read <= 0) continue;
+
+        int32_t sent = zsock_send(sock, event_tcp_buf, read, 0);
+        if (sent < read) {
+            /* events the client didn't get whole are lost along with the connection */
+            LOG_ERR("socket send failed with error %d", errno);
+            dap_watch_drop(DIV_ROUND_UP(read - MAX(sent, 0), DAP_WATCH_EVENT_SIZE));
+            return;
+        }
+    }
+}
+
+static void event_tcp_thread_fn(void *arg1, void *arg2, void *arg3) {
+    ARG_UNUSED(arg1);
+    ARG_UNUSED(arg2);
+    ARG_UNUSED(arg3);
+
+    int32_t bind_sock;
+    while ((bind_sock = event_tcp_listen()) < 0) {
+        k_sleep(K_SECONDS(1));
+    }
+
+    while (1) {
+        struct sockaddr conn_addr;
+        socklen_t conn_addr_len = sizeof(conn_addr);
+        int32_t conn_sock = zsock_accept(bind_sock, &conn_addr, &conn_addr_len);
+        if (conn_sock < 0) {
+            LOG_ERR("socket accept failed with error %d", errno);
+            k_sleep(K_SECONDS(1));
+            continue;
+        }
+
+        LOG_DBG("event client connected");
+        event_tcp_serve(conn_sock);
+        zsock_close(conn_sock);
+    }
+}
+
+K_THREAD_DEFINE(
+    dap_event_tcp_thread,
+    KB(2),
+    event_tcp_thread_fn,
+    NULL,
+    NULL,
+    NULL,
+    CONFIG_MAIN_THREAD_PRIORITY + 2,
+    0,
+    0
+);
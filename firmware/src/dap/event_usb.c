@@ -0,0 +1,156 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/usb/usb_device.h>
+#include <usb_descriptor.h>
+
+#include "dap/dap.h"
+#include "usb_msos.h"
+
+LOG_MODULE_REGISTER(dap_event_usb, CONFIG_DAP_LOG_LEVEL);
+
+#define DAP_EVENT_USB_INTERFACE_STRING "Rice DAP Events v1"
+USBD_STRING_DESCR_USER_DEFINE(primary) struct {
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bString[USB_BSTRING_LENGTH(DAP_EVENT_USB_INTERFACE_STRING)];
+} __packed dap_event_interface_string_descriptor = {
+	.bLength = USB_STRING_DESCRIPTOR_LENGTH(DAP_EVENT_USB_INTERFACE_STRING),
+	.bDescriptorType = USB_DESC_STRING,
+	.bString = DAP_EVENT_USB_INTERFACE_STRING,
+};
+
+/* whole events that fit in a single interrupt packet */
+#define DAP_EVENT_USB_PACKET_SIZE   (64)
+static uint8_t event_usb_buf[DAP_EVENT_USB_PACKET_SIZE - DAP_EVENT_USB_PACKET_SIZE % DAP_WATCH_EVENT_SIZE];
+
+static void event_usb_interface_config(struct usb_desc_header *head, uint8_t bInterfaceNumber) {
+	struct usb_if_descriptor *intf = (struct usb_if_descriptor*) head;
+	intf->bInterfaceNumber = bInterfaceNumber;
+	intf->iInterface = usb_get_str_descriptor_idx(&dap_event_interface_string_descriptor);
+
+    /* dap events occupy the 'third' function in the MS OS descriptors */
+	usb_msos_set_func2_interface(bInterfaceNumber);
+}
+
+static K_SEM_DEFINE(event_usb_thread_wake, 0, 1);
+
+static volatile bool event_usb_configured = false;
+static void event_usb_status_cb(struct usb_cfg_data *cfg, enum usb_dc_status_code status, const uint8_t *param) {
+    if (status == USB_DC_CONFIGURED) {
+        event_usb_configured = true;
+    } else if (status == USB_DC_SUSPEND ||
+               status == USB_DC_RESET ||
+               status == USB_DC_DISCONNECTED ||
+               status == USB_DC_ERROR) {
+
+        event_usb_configured = false;
+        /* wake the thread potentially waiting on a write */
+        k_sem_give(&event_usb_thread_wake);
+    }
+}
+
+static void event_usb_send_cb(uint8_t ep, int32_t size, void *priv) {
+    ARG_UNUSED(ep);
+    ARG_UNUSED(size);
+    ARG_UNUSED(priv);
+
+    k_sem_give(&event_usb_thread_wake);
+}
+
+struct event_usb_descriptor {
+    struct usb_if_descriptor if0;
+	struct usb_ep_descriptor if0_in_ep;
+} USBD_CLASS_DESCR_DEFINE(primary, 0) event_usb_descriptor = {
+    .if0 = {
+        .bLength = sizeof(struct usb_if_descriptor),
+        .bDescriptorType = USB_DESC_INTERFACE,
+        .bInterfaceNumber = 0,
+        .bAlternateSetting = 0,
+        .bNumEndpoints = 1,
+        .bInterfaceClass = USB_BCC_VENDOR,
+        .bInterfaceSubClass = 0,
+        .bInterfaceProtocol = 0,
+        .iInterface = 0,
+    },
+    .if0_in_ep = {
+        .bLength = sizeof(struct usb_ep_descriptor),
+        .bDescriptorType = USB_DESC_ENDPOINT,
+        .bEndpointAddress = AUTO_EP_IN,
+        .bmAttributes = USB_DC_EP_INTERRUPT,
+        .wMaxPacketSize = DAP_EVENT_USB_PACKET_SIZE,
+        .bInterval = 1,
+    },
+};
+
+static struct usb_ep_cfg_data event_usb_ep_data[] = {
+    { .ep_cb = usb_transfer_ep_callback, .ep_addr = AUTO_EP_IN },
+};
+
+USBD_DEFINE_CFG_DATA(event_usb_cfg) = {
+    .usb_device_description = NULL,
+    .interface_config = event_usb_interface_config,
+    .interface_descriptor = &event_usb_descriptor.if0,
+    .cb_usb_status = event_usb_status_cb,
+    .interface = {
+        .class_handler = NULL,
+        .custom_handler = usb_msos_custom_handle_req,
+        .vendor_handler = usb_msos_vendor_handle_req,
+    },
+    .num_endpoints = ARRAY_SIZE(event_usb_ep_data),
+    .endpoint = event_usb_ep_data,
+};
+
+/* sends watch events to the host as they are raised, each batch of events in a single interrupt packet */
+static void event_usb_thread_fn(void *arg1, void *arg2, void *arg3) {
+    ARG_UNUSED(arg1);
+    ARG_UNUSED(arg2);
+    ARG_UNUSED(arg3);
+
+    while (1) {
+        if (!event_usb_configured) {
+            k_sleep(K_MSEC(50));
+            continue;
+        }
+
+        int32_t read = dap_watch_read(dap_watch_channel_usb, event_usb_buf, sizeof(event_usb_buf), K_MSEC(100));
+        if (read <= 0) continue;
+
+        int32_t ret = usb_transfer(
+            event_usb_ep_data[0].ep_addr,
+            event_usb_buf,
+            read,
+            USB_TRANS_WRITE,
+            event_usb_send_cb,
+            NULL
+        );
+        if (ret < 0) {
+            LOG_ERR("event transfer failed with error %d", ret);
+            dap_watch_drop(read / DAP_WATCH_EVENT_SIZE);
+            continue;
+        }
+
+        /* the events have already left the probe's buffer, so a transfer cancelled by the host going away
+         * loses them, and they are counted as dropped */
+        while (usb_transfer_is_busy(event_usb_ep_data[0].ep_addr)) {
+            k_sem_take(&event_usb_thread_wake, K_MSEC(100));
+
+            if (!event_usb_configured) {
+                usb_cancel_transfer(event_usb_ep_data[0].ep_addr);
+                dap_watch_drop(read / DAP_WATCH_EVENT_SIZE);
+                break;
+            }
+        }
+    }
+}
+
+K_THREAD_DEFINE(
+    dap_event_usb_thread,
+    KB(1),
+    event_usb_thread_fn,
+    NULL,
+    NULL,
+    NULL,
+    CONFIG_MAIN_THREAD_PRIORITY + 2,
+    0,
+    0
+);
@@ -0,0 +1,429 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "dap/dap.h"
+#include "util.h"
+
+LOG_MODULE_DECLARE(dap, CONFIG_DAP_LOG_LEVEL);
+
+/* abort register value that clears every sticky error flag */
+static const uint32_t abort_clear_errors = 0x1e;
+/* sticky error flag in the DP control status register */
+static const uint32_t ctrl_stat_stickyerr = 0x00000020;
+/* number of status reads while waiting for a core register transfer to complete */
+static const uint8_t core_reg_retries = 8;
+
+/* MEM-AP registers saved by the probe before its own accesses, and restored afterwards */
+struct mem_state {
+    uint32_t csw;
+    uint32_t tar;
+};
+
+static inline uint8_t mem_request(bool ap, bool read, uint8_t addr) {
+    return (ap ? transfer_request_apndp : 0) | (read ? transfer_request_rnw : 0) | (addr & 0x0c);
+}
+
+static inline uint8_t mem_transfer(struct dap_driver *dap, uint8_t request, uint32_t *data) {
+    port_set_ir(dap, (request & transfer_request_apndp) ? jtag_ir_apacc : jtag_ir_dpacc);
+    return port_transfer(dap, request, data);
+}
+
+static inline uint8_t mem_select(struct dap_driver *dap, uint8_t ap, uint8_t addr) {
+    uint32_t select = ((uint32_t) ap << 24) | (addr & 0xf0);
+    return mem_transfer(dap, mem_request(false, false, dp_addr_select), &select);
+}
+
+/* selects bank 0 of the MEM-AP, then sets the access size and single auto increment, while leaving
+ * the rest of the control status word untouched */
+static uint8_t mem_setup(struct dap_driver *dap, uint8_t ap, uint32_t size) {
+    uint8_t ack = mem_select(dap, ap, ap_addr_csw);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    /* the control status word is only read when the transfer cache doesn't already know it */
+    uint32_t csw = 0;
+    if (!transfer_cache_get(dap, ap, ap_addr_csw, &csw)) {
+        ack = mem_transfer(dap, mem_request(true, true, ap_addr_csw), &csw);
+        if (ack != transfer_response_ack_ok) return ack;
+        ack = mem_transfer(dap, mem_request(false, true, dp_addr_rdbuff), &csw);
+        if (ack != transfer_response_ack_ok) return ack;
+    }
+
+    if ((csw & (csw_size_mask | csw_addrinc_mask)) != (size | csw_addrinc_single)) {
+        csw = (csw & ~(csw_size_mask | csw_addrinc_mask)) | size | csw_addrinc_single;
+        ack = mem_transfer(dap, mem_request(true, false, ap_addr_csw), &csw);
+    }
+    return ack;
+}
+
+/* places bytes on the byte lanes used by an access of the given size at addr */
+static inline uint32_t mem_pack(uint32_t addr, uint32_t bytes, const uint8_t *data) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < bytes; i++) {
+        value |= (uint32_t) data[i] << (((addr + i) & 0x03) * 8);
+    }
+    return value;
+}
+
+/* takes bytes from the byte lanes used by an access of the given size at addr */
+static inline void mem_unpack(uint32_t value, uint32_t addr, uint32_t bytes, uint8_t *data) {
+    for (uint32_t i = 0; i < bytes; i++) {
+        data[i] = (uint8_t) (value >> (((addr + i) & 0x03) * 8));
+    }
+}
+
+uint8_t dp_read(struct dap_driver *dap, uint8_t addr, uint32_t *data) {
+    uint8_t ack = mem_transfer(dap, mem_request(false, true, addr), data);
+    if (ack != transfer_response_ack_ok || dap->swj.port == dap_port_swd) return ack;
+
+    /* jtag dp reads are posted, the result arrives with the following read */
+    return mem_transfer(dap, mem_request(false, true, dp_addr_rdbuff), data);
+}
+
+uint8_t dp_write(struct dap_driver *dap, uint8_t addr, uint32_t data) {
+    uint8_t ack = mem_transfer(dap, mem_request(false, false, addr), &data);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    /* a final read collects the acknowledge of the write */
+    return mem_transfer(dap, mem_request(false, true, dp_addr_rdbuff), &data);
+}
+
+uint8_t ap_read(struct dap_driver *dap, uint8_t ap, uint8_t addr, uint32_t *data) {
+    uint8_t ack = mem_select(dap, ap, addr);
+    if (ack != transfer_response_ack_ok) return ack;
+    ack = mem_transfer(dap, mem_request(true, true, addr), data);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    /* ap reads are posted, the result arrives with the following read */
+    return mem_transfer(dap, mem_request(false, true, dp_addr_rdbuff), data);
+}
+
+uint8_t ap_write(struct dap_driver *dap, uint8_t ap, uint8_t addr, uint32_t data) {
+    uint8_t ack = mem_select(dap, ap, addr);
+    if (ack != transfer_response_ack_ok) return ack;
+    ack = mem_transfer(dap, mem_request(true, false, addr), &data);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    /* a final read collects the acknowledge of the write */
+    return mem_transfer(dap, mem_request(false, true, dp_addr_rdbuff), &data);
+}
+
+uint8_t mem_read(struct dap_driver *dap, uint8_t ap, uint32_t addr, uint32_t *data, uint32_t count) {
+    uint8_t ack = mem_setup(dap, ap, csw_size_word);
+
+    while (ack == transfer_response_ack_ok && count > 0) {
+        /* every 1KiB block gets a fresh transfer address, instead of relying on auto increment */
+        uint32_t block = MIN(count, (mem_tar_block_size - (addr & (mem_tar_block_size - 1))) / 4);
+        uint32_t tar = addr;
+        ack = mem_transfer(dap, mem_request(true, false, ap_addr_tar), &tar);
+        if (ack != transfer_response_ack_ok) break;
+
+        /* each drw read returns the result of the one before, the last result comes from rdbuff */
+        ack = mem_transfer(dap, mem_request(true, true, ap_addr_drw), &data[0]);
+        for (uint32_t i = 1; i < block && ack == transfer_response_ack_ok; i++) {
+            ack = mem_transfer(dap, mem_request(true, true, ap_addr_drw), &data[i - 1]);
+        }
+        if (ack != transfer_response_ack_ok) break;
+        ack = mem_transfer(dap, mem_request(false, true, dp_addr_rdbuff), &data[block - 1]);
+
+        addr += block * 4;
+        data += block;
+        count -= block;
+    }
+
+    return ack;
+}
+
+uint8_t mem_write(struct dap_driver *dap, uint8_t ap, uint32_t addr, const uint32_t *data, uint32_t count) {
+    uint8_t ack = mem_setup(dap, ap, csw_size_word);
+
+    while (ack == transfer_response_ack_ok && count > 0) {
+        /* every 1KiB block gets a fresh transfer address, instead of relying on auto increment */
+        uint32_t block = MIN(count, (mem_tar_block_size - (addr & (mem_tar_block_size - 1))) / 4);
+        uint32_t tar = addr;
+        ack = mem_transfer(dap, mem_request(true, false, ap_addr_tar), &tar);
+
+        for (uint32_t i = 0; i < block && ack == transfer_response_ack_ok; i++) {
+            uint32_t word = data[i];
+            ack = mem_transfer(dap, mem_request(true, false, ap_addr_drw), &word);
+        }
+
+        addr += block * 4;
+        data += block;
+        count -= block;
+    }
+
+    if (ack == transfer_response_ack_ok) {
+        /* a final read collects the acknowledge of the last write */
+        uint32_t temp = 0;
+        ack = mem_transfer(dap, mem_request(false, true, dp_addr_rdbuff), &temp);
+    }
+    return ack;
+}
+
+uint8_t mem_read_sized(struct dap_driver *dap, uint8_t ap, uint32_t addr, uint8_t size, uint8_t *data, uint32_t len) {
+    uint32_t bytes = 1 << size;
+    uint8_t ack = mem_setup(dap, ap, size);
+
+    while (ack == transfer_response_ack_ok && len > 0) {
+        /* every 1KiB block gets a fresh transfer address, instead of relying on auto increment */
+        uint32_t block = MIN(len, mem_tar_block_size - (addr & (mem_tar_block_size - 1)));
+        uint32_t tar = addr;
+        ack = mem_transfer(dap, mem_request(true, false, ap_addr_tar), &tar);
+        if (ack != transfer_response_ack_ok) break;
+
+        /* each drw read returns the result of the one before, the last result comes from rdbuff, and
+         * every result holds its data on the byte lanes of its own address */
+        uint32_t value = 0;
+        ack = mem_transfer(dap, mem_request(true, true, ap_addr_drw), &value);
+        for (uint32_t i = bytes; i < block && ack == transfer_response_ack_ok; i += bytes) {
+            ack = mem_transfer(dap, mem_request(true, true, ap_addr_drw), &value);
+            mem_unpack(value, addr + i - bytes, bytes, &data[i - bytes]);
+        }
+        if (ack != transfer_response_ack_ok) break;
+        ack = mem_transfer(dap, mem_request(false, true, dp_addr_rdbuff), &value);
+        mem_unpack(value, addr + block - bytes, bytes, &data[block - bytes]);
+
+        addr += block;
+        data += block;
+        len -= block;
+    }
+
+    return ack;
+}
+
+uint8_t mem_write_sized(struct dap_driver *dap, uint8_t ap, uint32_t addr, uint8_t size, const uint8_t *data, uint32_t len) {
+    uint32_t bytes = 1 << size;
+    uint8_t ack = mem_setup(dap, ap, size);
+
+    while (ack == transfer_response_ack_ok && len > 0) {
+        /* every 1KiB block gets a fresh transfer address, instead of relying on auto increment */
+        uint32_t block = MIN(len, mem_tar_block_size - (addr & (mem_tar_block_size - 1)));
+        uint32_t tar = addr;
+        ack = mem_transfer(dap, mem_request(true, false, ap_addr_tar), &tar);
+
+        for (uint32_t i = 0; i < block && ack == transfer_response_ack_ok; i += bytes) {
+            uint32_t value = mem_pack(addr + i, bytes, &data[i]);
+            ack = mem_transfer(dap, mem_request(true, false, ap_addr_drw), &value);
+        }
+
+        addr += block;
+        data += block;
+        len -= block;
+    }
+
+    if (ack == transfer_response_ack_ok) {
+        /* a final read collects the acknowledge of the last write */
+        uint32_t temp = 0;
+        ack = mem_transfer(dap, mem_request(false, true, dp_addr_rdbuff), &temp);
+    }
+    return ack;
+}
+
+/* selects the banked data registers over the core debug registers, so each register is a single transfer */
+static uint8_t core_reg_setup(struct dap_driver *dap, uint8_t ap) {
+    uint8_t ack = mem_setup(dap, ap, csw_size_word);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    uint32_t tar = dhcsr;
+    ack = mem_transfer(dap, mem_request(true, false, ap_addr_tar), &tar);
+    if (ack != transfer_response_ack_ok) return ack;
+    return mem_select(dap, ap, ap_addr_bd0);
+}
+
+/* reads the debug halting status until the last register transfer has completed */
+static uint8_t core_reg_wait(struct dap_driver *dap) {
+    const uint8_t bd_dhcsr = ap_addr_bd0 | (dhcsr & 0x0c);
+
+    uint32_t status = 0;
+    for (uint8_t i = 0; i < core_reg_retries; i++) {
+        uint8_t ack = mem_transfer(dap, mem_request(true, true, bd_dhcsr), &status);
+        if (ack != transfer_response_ack_ok) return ack;
+        ack = mem_transfer(dap, mem_request(false, true, dp_addr_rdbuff), &status);
+        if (ack != transfer_response_ack_ok) return ack;
+        if ((status & dhcsr_s_regrdy) != 0) return transfer_response_ack_ok;
+    }
+    return transfer_response_ack_wait;
+}
+
+uint8_t core_reg_read(struct dap_driver *dap, uint8_t ap, const uint8_t *regsel, uint32_t *values, uint32_t count,
+    uint32_t *completed) {
+    const uint8_t bd_dcrsr = ap_addr_bd0 | (dcrsr & 0x0c);
+    const uint8_t bd_dcrdr = ap_addr_bd0 | (dcrdr & 0x0c);
+
+    *completed = 0;
+    uint8_t ack = core_reg_setup(dap, ap);
+    for (uint32_t i = 0; i < count && ack == transfer_response_ack_ok; i++) {
+        uint32_t select = regsel[i] & dcrsr_regsel_mask;
+        ack = mem_transfer(dap, mem_request(true, false, bd_dcrsr), &select);
+        if (ack != transfer_response_ack_ok) break;
+        ack = core_reg_wait(dap);
+        if (ack != transfer_response_ack_ok) break;
+        ack = mem_transfer(dap, mem_request(true, true, bd_dcrdr), &values[i]);
+        if (ack != transfer_response_ack_ok) break;
+        ack = mem_transfer(dap, mem_request(false, true, dp_addr_rdbuff), &values[i]);
+        if (ack == transfer_response_ack_ok) (*completed)++;
+    }
+
+    return ack;
+}
+
+uint8_t core_reg_write(struct dap_driver *dap, uint8_t ap, const uint8_t *regsel, const uint32_t *values,
+    uint32_t count, uint32_t *completed) {
+    const uint8_t bd_dcrsr = ap_addr_bd0 | (dcrsr & 0x0c);
+    const uint8_t bd_dcrdr = ap_addr_bd0 | (dcrdr & 0x0c);
+
+    *completed = 0;
+    uint8_t ack = core_reg_setup(dap, ap);
+    for (uint32_t i = 0; i < count && ack == transfer_response_ack_ok; i++) {
+        uint32_t value = values[i];
+        ack = mem_transfer(dap, mem_request(true, false, bd_dcrdr), &value);
+        if (ack != transfer_response_ack_ok) break;
+        uint32_t select = (regsel[i] & dcrsr_regsel_mask) | dcrsr_regwnr;
+        ack = mem_transfer(dap, mem_request(true, false, bd_dcrsr), &select);
+        if (ack != transfer_response_ack_ok) break;
+        /* the status read also collects the acknowledge of both writes */
+        ack = core_reg_wait(dap);
+        if (ack == transfer_response_ack_ok) (*completed)++;
+    }
+
+    return ack;
+}
+
+uint8_t mem_read_bytes(struct dap_driver *dap, uint8_t ap, uint32_t addr, uint8_t *data, uint32_t len) {
+    uint32_t words[16];
+    uint8_t ack = transfer_response_ack_ok;
+
+    while (ack == transfer_response_ack_ok && len > 0) {
+        /* read every word containing the requested bytes, then pick out the bytes themselves */
+        uint32_t offset = addr & 0x03;
+        uint32_t count = MIN((offset + len + 3) / 4, ARRAY_SIZE(words));
+        ack = mem_read(dap, ap, addr - offset, words, count);
+        if (ack != transfer_response_ack_ok) break;
+
+        uint32_t bytes = MIN(len, count * 4 - offset);
+        for (uint32_t i = 0; i < bytes; i++) {
+            data[i] = (uint8_t) (words[(offset + i) / 4] >> (((offset + i) % 4) * 8));
+        }
+
+        addr += bytes;
+        data += bytes;
+        len -= bytes;
+    }
+
+    return ack;
+}
+
+uint8_t mem_write_bytes(struct dap_driver *dap, uint8_t ap, uint32_t addr, const uint8_t *data, uint32_t len) {
+    uint32_t words[16];
+    uint8_t ack = transfer_response_ack_ok;
+
+    while (ack == transfer_response_ack_ok && len > 0) {
+        if ((addr & 0x03) != 0 || len < 4) {
+            /* unaligned leading and trailing bytes use byte sized accesses */
+            uint32_t count = (addr & 0x03) != 0 ? MIN(len, 4 - (addr & 0x03)) : len;
+            ack = mem_write_sized(dap, ap, addr, csw_size_byte, data, count);
+
+            addr += count;
+            data += count;
+            len -= count;
+        } else {
+            uint32_t count = MIN(len / 4, ARRAY_SIZE(words));
+            for (uint32_t i = 0; i < count; i++) {
+                words[i] = sys_get_le32(&data[i * 4]);
+            }
+            ack = mem_write(dap, ap, addr, words, count);
+
+            addr += count * 4;
+            data += count * 4;
+            len -= count * 4;
+        }
+    }
+
+    return ack;
+}
+
+static uint8_t mem_state_save(struct dap_driver *dap, uint8_t ap, struct mem_state *state) {
+    bool csw_known = transfer_cache_get(dap, ap, ap_addr_csw, &state->csw);
+    bool tar_known = transfer_cache_get(dap, ap, ap_addr_tar, &state->tar);
+    if (csw_known && tar_known) return transfer_response_ack_ok;
+    if (csw_known) return ap_read(dap, ap, ap_addr_tar, &state->tar);
+    if (tar_known) return ap_read(dap, ap, ap_addr_csw, &state->csw);
+
+    /* both registers are in bank 0, so they share a select, and the posted read of one collects the other */
+    uint8_t ack = mem_select(dap, ap, ap_addr_csw);
+    if (ack != transfer_response_ack_ok) return ack;
+    ack = mem_transfer(dap, mem_request(true, true, ap_addr_csw), &state->csw);
+    if (ack != transfer_response_ack_ok) return ack;
+    ack = mem_transfer(dap, mem_request(true, true, ap_addr_tar), &state->csw);
+    if (ack != transfer_response_ack_ok) return ack;
+    return mem_transfer(dap, mem_request(false, true, dp_addr_rdbuff), &state->tar);
+}
+
+static uint8_t mem_state_restore(struct dap_driver *dap, uint8_t ap, const struct mem_state *state) {
+    uint8_t ack = mem_select(dap, ap, ap_addr_csw);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    uint32_t csw = state->csw;
+    ack = mem_transfer(dap, mem_request(true, false, ap_addr_csw), &csw);
+    if (ack != transfer_response_ack_ok) return ack;
+    uint32_t tar = state->tar;
+    ack = mem_transfer(dap, mem_request(true, false, ap_addr_tar), &tar);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    /* leave the DP with the AP and bank the host last selected */
+    return dp_write(dap, dp_addr_select, dap->transfer.select);
+}
+
+/* the host doesn't know the probe is sharing the MEM-AP, so the AP is left exactly as found, and a sticky error
+ * is only ever cleared when the probe's own access flagged it */
+uint8_t mem_shared_access(struct dap_driver *dap, uint8_t ap, mem_shared_access_t access, void *context,
+    bool *deferred) {
+    /* an error already flagged comes from the host's accesses, and stays for the host to find */
+    uint8_t ack = dp_check_errors(dap);
+    *deferred = ack == transfer_response_fault;
+    if (*deferred) return ack;
+
+    struct mem_state state;
+    bool saved = false;
+    if (ack == transfer_response_ack_ok) {
+        ack = mem_state_save(dap, ap, &state);
+        saved = ack == transfer_response_ack_ok;
+    }
+    if (ack == transfer_response_ack_ok) {
+        ack = access(dap, context);
+    }
+
+    if (ack != transfer_response_ack_ok) {
+        dp_clear_errors(dap);
+    }
+    if (saved) {
+        mem_state_restore(dap, ap, &state);
+    }
+    return ack;
+}
+
+uint8_t dp_check_errors(struct dap_driver *dap) {
+    uint32_t ctrl_stat = 0;
+    uint8_t ack = dp_read(dap, dp_addr_ctrl_stat, &ctrl_stat);
+    if (ack != transfer_response_ack_ok) return ack;
+    return (ctrl_stat & ctrl_stat_stickyerr) != 0 ? transfer_response_fault : transfer_response_ack_ok;
+}
+
+void dp_clear_errors(struct dap_driver *dap) {
+    uint32_t abort = abort_clear_errors;
+    port_set_ir(dap, jtag_ir_abort);
+    port_transfer(dap, mem_request(false, false, dp_addr_abort), &abort);
+}
+
+/* the probe changes SELECT for its own accesses, but leaves it as the host last wrote it afterwards,
+ * the MEM-AP CSW and TAR are left as the last access left them */
+uint8_t mem_command_finish(struct dap_driver *dap, uint8_t ack) {
+    if (ack != transfer_response_ack_ok) return ack;
+
+    /* the last access only reports its error through the sticky flag, since nothing follows it */
+    ack = dp_check_errors(dap);
+    if (ack != transfer_response_ack_ok) return ack;
+
+    return dp_write(dap, dp_addr_select, dap->transfer.select);
+}
@@ -0,0 +1,117 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/socket.h>
+
+#include "dap/dap.h"
+
+LOG_MODULE_REGISTER(dap_rtt_tcp, CONFIG_DAP_LOG_LEVEL);
+
+/* how long to wait for target data before checking on the client again */
+static const int32_t rtt_tcp_poll_ms = 20;
+
+static uint8_t rtt_tcp_down_buf[256];
+static uint8_t rtt_tcp_up_buf[256];
+
+static int32_t rtt_tcp_listen(void) {
+    int32_t sock;
+
+    /* an IPv6 socket will still allow IPv4 connections using an IPv4-mapped IPv6 address */
+    struct sockaddr_in6 sock_addr = {
+        .sin6_family = AF_INET6,
+        .sin6_addr = IN6ADDR_ANY_INIT,
+        .sin6_port = sys_cpu_to_be16(CONFIG_DAP_RTT_TCP_PORT),
+    };
+
+    if ((sock = zsock_socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+        LOG_ERR("socket initialize failed with error %d", errno);
+        return -1 * errno;
+    }
+    if (zsock_bind(sock, (struct sockaddr*) &sock_addr, sizeof(sock_addr)) < 0) {
+        LOG_ERR("socket bind failed with error %d", errno);
+        zsock_close(sock);
+        return -1 * errno;
+    }
+    if (zsock_listen(sock, 1) < 0) {
+        LOG_ERR("socket listen failed with error %d", errno);
+        zsock_close(sock);
+        return -1 * errno;
+    }
+
+    return sock;
+}
+
+/* moves data between a single connected client and the rtt host channel, until the client goes away */
+static void rtt_tcp_serve(int32_t sock) {
+    /* client data received, and how much of it the down channel has taken so far */
+    int32_t received = 0;
+    int32_t written = 0;
+
+    while (1) {
+        /* more is only read from the client once the down channel has taken everything before it, but the
+         * connection is always watched, and the up channel always served */
+        struct zsock_pollfd poll_fd = { .fd = sock, .events = written < received ? 0 : ZSOCK_POLLIN };
+        if (zsock_poll(&poll_fd, 1, 0) < 0) {
+            LOG_ERR("socket poll failed with error %d", errno);
+            return;
+        }
+        if ((poll_fd.revents & (ZSOCK_POLLHUP | ZSOCK_POLLERR)) != 0) return;
+
+        if ((poll_fd.revents & ZSOCK_POLLIN) != 0) {
+            received = zsock_recv(sock, rtt_tcp_down_buf, sizeof(rtt_tcp_down_buf), 0);
+            written = 0;
+            if (received <= 0) {
+                /* a zero length receive is the client closing the connection */
+                if (received < 0) LOG_ERR("socket receive failed with error %d", errno);
+                return;
+            }
+        }
+        if (written < received) {
+            written += dap_rtt_write(&rtt_tcp_down_buf[written], received - written);
+        }
+
+        /* waiting on the target is what paces the loop, a full down channel is only retried this often */
+        int32_t read = dap_rtt_read(rtt_tcp_up_buf, sizeof(rtt_tcp_up_buf), K_MSEC(rtt_tcp_poll_ms));
+        if (read > 0 && zsock_send(sock, rtt_tcp_up_buf, read, 0) < read) {
+            LOG_ERR("socket send failed with error %d", errno);
+            return;
+        }
+    }
+}
+
+static void rtt_tcp_thread_fn(void *arg1, void *arg2, void *arg3) {
+    ARG_UNUSED(arg1);
+    ARG_UNUSED(arg2);
+    ARG_UNUSED(arg3);
+
+    int32_t bind_sock;
+    while ((bind_sock = rtt_tcp_listen()) < 0) {
+        k_sleep(K_SECONDS(1));
+    }
+
+    while (1) {
+        struct sockaddr conn_addr;
+        socklen_t conn_addr_len = sizeof(conn_addr);
+        int32_t conn_sock = zsock_accept(bind_sock, &conn_addr, &conn_addr_len);
+        if (conn_sock < 0) {
+            LOG_ERR("socket accept failed with error %d", errno);
+            k_sleep(K_SECONDS(1));
+            continue;
+        }
+
+        LOG_DBG("rtt client connected");
+        rtt_tcp_serve(conn_sock);
+        zsock_close(conn_sock);
+    }
+}
+
+K_THREAD_DEFINE(
+    dap_rtt_tcp_thread,
+    KB(2),
+    rtt_tcp_thread_fn,
+    NULL,
+    NULL,
+    NULL,
+    CONFIG_MAIN_THREAD_PRIORITY + 2,
+    0,
+    0
+);
@@ -1,7 +1,16 @@
 #ifndef __DAP_TRANSPORT_H__
 #define __DAP_TRANSPORT_H__
 
-#include "dap/dap.h"
+#include <zephyr/kernel.h>
+
+/* maximum number of regions making up a single response */
+#define DAP_TRANSPORT_MAX_BUFS  (3)
+
+/** @brief A contiguous region of response data, a single response may be split across several regions. */
+struct dap_transport_buf {
+    uint8_t *data;
+    size_t len;
+};
 
 /** @brief Initializes the transport. */
 typedef int32_t (*transport_init_t)(void);
@@ -9,11 +18,13 @@ typedef int32_t (*transport_init_t)(void);
 /** @brief Checks if a transport is ready to accept data, configures if so, or returns a negative code if not. */
 typedef int32_t (*transport_configure_t)(void);
 
-/** @brief Waits for receive data to be available, reads into a buffer, then returns the number of bytes received. */
-typedef int32_t (*transport_recv_t)(uint8_t *recv, size_t len);
+/** @brief Waits up to timeout for receive data to be available, reads into a buffer, then returns the number of
+ * bytes received, or -EAGAIN if nothing arrived in time. A timed out receive may be left pending, and is
+ * continued by the next call with the same buffer. */
+typedef int32_t (*transport_recv_t)(uint8_t *recv, size_t len, k_timeout_t timeout);
 
-/** @brief Sends a response, and returns the number of bytes sent. */
-typedef int32_t (*transport_send_t)(uint8_t *send, size_t len);
+/** @brief Sends a response made up of one or more regions in order, and returns the total number of bytes sent. */
+typedef int32_t (*transport_send_t)(const struct dap_transport_buf *bufs, size_t count);
 
 struct dap_transport {
     const char *name;
@@ -81,7 +81,19 @@ int32_t dap_tcp_transport_configure(void) {
     return 0;
 }
 
-int32_t dap_tcp_transport_recv(uint8_t *read, size_t len) {
+int32_t dap_tcp_transport_recv(uint8_t *read, size_t len, k_timeout_t timeout) {
+    /* only the start of a request is waited on with a timeout, the rest of it follows right away */
+    struct zsock_pollfd poll_fd = { .fd = tcp_conn_sock, .events = ZSOCK_POLLIN };
+    int32_t timeout_ms = K_TIMEOUT_EQ(timeout, K_FOREVER) ? -1 : (int32_t) k_ticks_to_ms_ceil32(timeout.ticks);
+    int32_t ready = zsock_poll(&poll_fd, 1, timeout_ms);
+    if (ready == 0) {
+        return -EAGAIN;
+    } else if (ready < 0) {
+        LOG_ERR("socket poll failed with error %d", errno);
+        zsock_close(tcp_conn_sock);
+        return -1 * errno;
+    }
+
     /* tcp transport 'packets' are DAP requests preceeded by a 16-bit little endian request length,
      * to make sure we know exactly when each message ends, which in practice should never
      * be split between recv calls */
@@ -125,19 +137,28 @@ int32_t dap_tcp_transport_recv(uint8_t *read, size_t len) {
     return received;
 }
 
-int32_t dap_tcp_transport_send(uint8_t *send, size_t len) {
+int32_t dap_tcp_transport_send(const struct dap_transport_buf *bufs, size_t count) {
+    if (count > DAP_TRANSPORT_MAX_BUFS) return -EINVAL;
+
     /* just like the request, tcp response messages will be preceeded by a 16-bit little endian value */
+    size_t len = 0;
+    for (size_t i = 0; i < count; i++) {
+        len += bufs[i].len;
+    }
     uint16_t response_len = (uint16_t) len;
 
-    struct iovec msg_iov[2];
+    /* every response region is passed straight to the socket, without any intermediate copies */
+    struct iovec msg_iov[1 + DAP_TRANSPORT_MAX_BUFS];
     msg_iov[0].iov_base = (uint8_t*) &response_len;
     msg_iov[0].iov_len = sizeof(response_len);
-    msg_iov[1].iov_base = send;
-    msg_iov[1].iov_len = len;
+    for (size_t i = 0; i < count; i++) {
+        msg_iov[1 + i].iov_base = bufs[i].data;
+        msg_iov[1 + i].iov_len = bufs[i].len;
+    }
     struct msghdr msg;
     memset(&msg, 0, sizeof(msg));
     msg.msg_iov = msg_iov;
-    msg.msg_iovlen = 2;
+    msg.msg_iovlen = 1 + count;
 
     int32_t sent = zsock_sendmsg(tcp_conn_sock, &msg, 0);
     if (sent == 0) {
@@ -3,6 +3,7 @@
 #include <zephyr/usb/usb_device.h>
 #include <usb_descriptor.h>
 
+#include "dap/dap.h"
 #include "transport.h"
 #include "usb_msos.h"
 
@@ -119,6 +120,9 @@ USBD_DEFINE_CFG_DATA(dap_usb_cfg) = {
     .endpoint = dap_usb_ep_data,
 };
 
+/* response regions are gathered here when they can't be sent directly */
+static uint8_t dap_usb_send_buf[DAP_MAX_PACKET_SIZE];
+
 int32_t dap_usb_transport_init(void) {
     /* all USB initialization is static, no need to do anything here. */
     return 0;
@@ -128,31 +132,60 @@ int32_t dap_usb_transport_configure(void) {
     return dap_usb_configured ? 0 : -EAGAIN;
 }
 
-int32_t dap_usb_transport_recv(uint8_t *read, size_t len) {    
-    int32_t recv_size = 0;
-    int32_t ret = usb_transfer(
-        dap_usb_ep_data[dap_out_idx].ep_addr,
-        read,
-        len,
-        USB_TRANS_READ,
-        dap_usb_recv_cb,
-        (void*) &recv_size
-    );
-    if (ret < 0) return ret;
+/* a receive that times out is left pending, and is picked up again by the next receive */
+static int32_t dap_usb_recv_size = 0;
+static bool dap_usb_recv_pending = false;
+
+int32_t dap_usb_transport_recv(uint8_t *read, size_t len, k_timeout_t timeout) {
+    if (!dap_usb_recv_pending) {
+        dap_usb_recv_size = 0;
+        int32_t ret = usb_transfer(
+            dap_usb_ep_data[dap_out_idx].ep_addr,
+            read,
+            len,
+            USB_TRANS_READ,
+            dap_usb_recv_cb,
+            (void*) &dap_usb_recv_size
+        );
+        if (ret < 0) return ret;
+        dap_usb_recv_pending = true;
+    }
 
+    k_timepoint_t end = sys_timepoint_calc(timeout);
     while (usb_transfer_is_busy(dap_usb_ep_data[dap_out_idx].ep_addr)) {
-        k_sem_take(&dap_usb_thread_wake, K_MSEC(100));
+        /* both the receive callback and any usb status change wake this wait */
+        if (k_sem_take(&dap_usb_thread_wake, sys_timepoint_timeout(end)) != 0 &&
+            usb_transfer_is_busy(dap_usb_ep_data[dap_out_idx].ep_addr)) {
+            return -EAGAIN;
+        }
 
         if (!dap_usb_configured) {
             usb_cancel_transfer(dap_usb_ep_data[dap_out_idx].ep_addr);
+            dap_usb_recv_pending = false;
             return -ESHUTDOWN;
         }
     }
 
-    return recv_size;
+    dap_usb_recv_pending = false;
+    return dap_usb_recv_size;
 }
 
-int32_t dap_usb_transport_send(uint8_t *send, size_t len) {
+int32_t dap_usb_transport_send(const struct dap_transport_buf *bufs, size_t count) {
+    /* a response must arrive at the host as a single bulk transfer, and the separate regions of a
+     * response don't fall on packet boundaries, so multiple regions are gathered into one packet, anything
+     * past the end of the packet is dropped and shows up as a short send */
+    uint8_t *send = bufs[0].data;
+    size_t len = bufs[0].len;
+    if (count > 1) {
+        len = 0;
+        for (size_t i = 0; i < count && len < sizeof(dap_usb_send_buf); i++) {
+            size_t copy_len = MIN(bufs[i].len, sizeof(dap_usb_send_buf) - len);
+            memcpy(&dap_usb_send_buf[len], bufs[i].data, copy_len);
+            len += copy_len;
+        }
+        send = dap_usb_send_buf;
+    }
+
     int32_t send_size = 0;
     int32_t ret = usb_transfer(
         dap_usb_ep_data[dap_in_idx].ep_addr,
@@ -52,11 +52,12 @@ struct usb_msos_compatid_descr {
 	uint8_t bReserved[7];
     struct usb_msos_compatid_func func0;
     struct usb_msos_compatid_func func1;
+    struct usb_msos_compatid_func func2;
 } __packed usb_msos_compatid_descr = {
     .dwLength = sizeof(struct usb_msos_compatid_descr),
 	.bcdVersion = 0x100,
 	.wIndex = 4,
-	.bCount = 2,
+	.bCount = 3,
 	.bReserved = {0, 0, 0, 0, 0, 0, 0},
     .func0 = {
         .bFirstInterfaceNumber = 0,
@@ -71,6 +72,13 @@ struct usb_msos_compatid_descr {
         .compatibleID = {'W', 'I', 'N', 'U', 'S', 'B', 0, 0},
         .subCompatibleID = {0, 0, 0, 0, 0, 0, 0, 0},
         .reserved = {0, 0, 0, 0, 0, 0},
+    },
+    .func2 = {
+        .bFirstInterfaceNumber = 0,
+        .bReserved = 1,
+        .compatibleID = {'W', 'I', 'N', 'U', 'S', 'B', 0, 0},
+        .subCompatibleID = {0, 0, 0, 0, 0, 0, 0, 0},
+        .reserved = {0, 0, 0, 0, 0, 0},
     }
 };
 
@@ -82,6 +90,10 @@ void usb_msos_set_func1_interface(uint8_t intf) {
     usb_msos_compatid_descr.func1.bFirstInterfaceNumber = intf;
 }
 
+void usb_msos_set_func2_interface(uint8_t intf) {
+    usb_msos_compatid_descr.func2.bFirstInterfaceNumber = intf;
+}
+
 struct usb_msos_device_intf_guid {
     uint32_t dwSize;
     uint32_t dwPropertyDataType;
@@ -52,6 +52,7 @@
 
 void usb_msos_set_func0_interface(uint8_t intf);
 void usb_msos_set_func1_interface(uint8_t intf);
+void usb_msos_set_func2_interface(uint8_t intf);
 
 int32_t usb_msos_custom_handle_req(struct usb_setup_packet *pSetup, int32_t *len, uint8_t **data);
 int32_t usb_msos_vendor_handle_req(struct usb_setup_packet *pSetup, int32_t *len, uint8_t **data);
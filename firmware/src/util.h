@@ -14,14 +14,18 @@
         }                           \
     } while (0)
 
-/* busy waits for a set amount of nanoseconds */
-static inline void busy_wait_nanos(uint32_t nanos) {
-    uint32_t start = k_cycle_get_32();
-    uint32_t wait = (uint32_t) (
+/* converts nanoseconds to hardware clock cycles, for waits repeated often enough that the conversion matters */
+static inline uint32_t nanos_to_cycles(uint32_t nanos) {
+    return (uint32_t) (
         (uint64_t) nanos *
         (uint64_t) sys_clock_hw_cycles_per_sec() /
         (uint64_t) NSEC_PER_SEC
     );
+}
+
+/* busy waits for a set amount of hardware clock cycles */
+static inline void busy_wait_cycles(uint32_t wait) {
+    uint32_t start = k_cycle_get_32();
 
     while (true) {
         /* native posix platforms don't progress time unless sleep functions are called */
@@ -34,6 +38,29 @@ static inline void busy_wait_nanos(uint32_t nanos) {
     }
 }
 
+/* busy waits for a set amount of nanoseconds */
+static inline void busy_wait_nanos(uint32_t nanos) {
+    busy_wait_cycles(nanos_to_cycles(nanos));
+}
+
+/* waits for a set amount of microseconds. a sleep is rounded up to the kernel tick and can overshoot by up to two
+ * ticks, so the last two ticks of a wait are busy waited on the cycle counter, and short waits are busy waited
+ * entirely. waits of a second or more only sleep, as the cycle counter could wrap */
+static inline void delay_micros(uint32_t micros) {
+    uint32_t tick_us = k_ticks_to_us_ceil32(1);
+    if (micros >= USEC_PER_SEC) {
+        k_sleep(K_USEC(micros));
+    } else if (micros > tick_us * 2) {
+        uint32_t start = k_cycle_get_32();
+        uint32_t wait = k_us_to_cyc_ceil32(micros);
+        k_sleep(K_USEC(micros - tick_us * 2));
+        uint32_t elapsed = k_cycle_get_32() - start;
+        if (elapsed < wait) busy_wait_cycles(wait - elapsed);
+    } else {
+        busy_wait_cycles(k_us_to_cyc_ceil32(micros));
+    }
+}
+
 /*
  * convenience functions for ring buffers
  */
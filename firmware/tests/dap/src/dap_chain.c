@@ -0,0 +1,190 @@
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include "dap_io.h"
+#include "dap_chain.h"
+
+/* next tap state for tms low and tms high, indexed by the current state */
+static const uint8_t chain_next_state[16][2] = {
+    [DAP_CHAIN_TEST_LOGIC_RESET] = {DAP_CHAIN_RUN_TEST_IDLE, DAP_CHAIN_TEST_LOGIC_RESET},
+    [DAP_CHAIN_RUN_TEST_IDLE] = {DAP_CHAIN_RUN_TEST_IDLE, DAP_CHAIN_SELECT_DR_SCAN},
+    [DAP_CHAIN_SELECT_DR_SCAN] = {DAP_CHAIN_CAPTURE_DR, DAP_CHAIN_SELECT_IR_SCAN},
+    [DAP_CHAIN_CAPTURE_DR] = {DAP_CHAIN_SHIFT_DR, DAP_CHAIN_EXIT1_DR},
+    [DAP_CHAIN_SHIFT_DR] = {DAP_CHAIN_SHIFT_DR, DAP_CHAIN_EXIT1_DR},
+    [DAP_CHAIN_EXIT1_DR] = {DAP_CHAIN_PAUSE_DR, DAP_CHAIN_UPDATE_DR},
+    [DAP_CHAIN_PAUSE_DR] = {DAP_CHAIN_PAUSE_DR, DAP_CHAIN_EXIT2_DR},
+    [DAP_CHAIN_EXIT2_DR] = {DAP_CHAIN_SHIFT_DR, DAP_CHAIN_UPDATE_DR},
+    [DAP_CHAIN_UPDATE_DR] = {DAP_CHAIN_RUN_TEST_IDLE, DAP_CHAIN_SELECT_DR_SCAN},
+    [DAP_CHAIN_SELECT_IR_SCAN] = {DAP_CHAIN_CAPTURE_IR, DAP_CHAIN_TEST_LOGIC_RESET},
+    [DAP_CHAIN_CAPTURE_IR] = {DAP_CHAIN_SHIFT_IR, DAP_CHAIN_EXIT1_IR},
+    [DAP_CHAIN_SHIFT_IR] = {DAP_CHAIN_SHIFT_IR, DAP_CHAIN_EXIT1_IR},
+    [DAP_CHAIN_EXIT1_IR] = {DAP_CHAIN_PAUSE_IR, DAP_CHAIN_UPDATE_IR},
+    [DAP_CHAIN_PAUSE_IR] = {DAP_CHAIN_PAUSE_IR, DAP_CHAIN_EXIT2_IR},
+    [DAP_CHAIN_EXIT2_IR] = {DAP_CHAIN_SHIFT_IR, DAP_CHAIN_UPDATE_IR},
+    [DAP_CHAIN_UPDATE_IR] = {DAP_CHAIN_RUN_TEST_IDLE, DAP_CHAIN_SELECT_DR_SCAN},
+};
+
+static struct {
+    struct gpio_callback cb;
+    const struct dap_chain_tap *taps;
+    size_t count;
+    uint8_t state;
+    uint32_t tck_count;
+    uint8_t stream[KB(2)];
+    size_t stream_bits;
+
+    struct {
+        uint32_t ir;
+        /* boundary scan cells driven onto the pins */
+        uint32_t bsr;
+        /* shift register of the current scan, and its length */
+        uint64_t shift;
+        uint8_t shift_length;
+        /* number of DPACC or APACC scans captured */
+        uint32_t acc_scans;
+    } tap[DAP_CHAIN_MAX_TAPS];
+} dap_chain;
+
+/* returns true if the current instruction of a tap selects its boundary scan register */
+static bool chain_bsr_selected(size_t index) {
+    const struct dap_chain_tap *tap = &dap_chain.taps[index];
+    uint32_t ir = dap_chain.tap[index].ir;
+    return tap->bsr_length != 0 && (ir == tap->sample_ir || ir == tap->extest_ir);
+}
+
+/* returns true if the current instruction of a tap selects its stream register */
+static bool chain_stream_selected(size_t index) {
+    const struct dap_chain_tap *tap = &dap_chain.taps[index];
+    return tap->stream_ir != 0 && dap_chain.tap[index].ir == tap->stream_ir;
+}
+
+/* loads the shift register of every tap on entry to capture-dr or capture-ir */
+static void chain_capture(bool ir) {
+    for (size_t i = 0; i < dap_chain.count; i++) {
+        const struct dap_chain_tap *tap = &dap_chain.taps[i];
+        if (ir) {
+            dap_chain.tap[i].shift = tap->ir_capture;
+            dap_chain.tap[i].shift_length = tap->ir_length;
+        } else if (chain_bsr_selected(i)) {
+            uint32_t pins = dap_chain.tap[i].bsr & ~tap->bsr_stuck_mask;
+            dap_chain.tap[i].shift = pins | (tap->bsr_stuck_value & tap->bsr_stuck_mask);
+            dap_chain.tap[i].shift_length = tap->bsr_length;
+        } else if (tap->dpacc_ir != 0 && (dap_chain.tap[i].ir == tap->dpacc_ir || dap_chain.tap[i].ir == tap->apacc_ir)) {
+            /* the acknowledge is in the low three bits, 0x1 for WAIT and 0x2 for OK */
+            bool wait = dap_chain.tap[i].acc_scans++ < tap->acc_waits;
+            dap_chain.tap[i].shift = wait ? 0x01 : (((uint64_t) tap->acc_data << 3) | 0x02);
+            dap_chain.tap[i].shift_length = 35;
+        } else if (chain_stream_selected(i)) {
+            dap_chain.tap[i].shift = 0;
+            dap_chain.tap[i].shift_length = 1;
+        } else if (tap->idcode != 0 && dap_chain.tap[i].ir == tap->idcode_ir) {
+            dap_chain.tap[i].shift = tap->idcode;
+            dap_chain.tap[i].shift_length = 32;
+        } else {
+            /* any other instruction selects the bypass register */
+            dap_chain.tap[i].shift = 0;
+            dap_chain.tap[i].shift_length = 1;
+        }
+    }
+}
+
+/* shifts tdi in at the tap furthest from tdo, moving every register one bit towards tdo */
+static void chain_shift(uint8_t tdi, bool ir) {
+    uint64_t in = tdi;
+    for (size_t i = dap_chain.count; i > 0; i--) {
+        if (!ir && chain_stream_selected(i - 1) && dap_chain.stream_bits < sizeof(dap_chain.stream) * 8) {
+            dap_chain.stream[dap_chain.stream_bits / 8] |= in << (dap_chain.stream_bits % 8);
+            dap_chain.stream_bits++;
+        }
+        uint64_t out = dap_chain.tap[i - 1].shift & 0x01;
+        uint8_t len = dap_chain.tap[i - 1].shift_length;
+        dap_chain.tap[i - 1].shift = (dap_chain.tap[i - 1].shift >> 1) | (in << (len - 1));
+        in = out;
+    }
+}
+
+static void chain_reset(void) {
+    for (size_t i = 0; i < dap_chain.count; i++) {
+        const struct dap_chain_tap *tap = &dap_chain.taps[i];
+        dap_chain.tap[i].ir = tap->idcode != 0 ? tap->idcode_ir : (uint32_t) BIT64_MASK(tap->ir_length);
+    }
+}
+
+static void dap_chain_handler(const struct device *port, struct gpio_callback *cb, gpio_port_pins_t pins) {
+    if (gpio_pin_get_dt(dap_io_tck_swclk) == 1) {
+        /* rising edge, the taps sample tms and tdi */
+        uint8_t tms = gpio_pin_get_dt(dap_io_tms_swdio);
+        uint8_t tdi = gpio_pin_get_dt(dap_io_tdi);
+        dap_chain.tck_count++;
+
+        uint8_t state = dap_chain.state;
+        if (state == DAP_CHAIN_SHIFT_DR || state == DAP_CHAIN_SHIFT_IR) {
+            chain_shift(tdi, state == DAP_CHAIN_SHIFT_IR);
+        } else if (state == DAP_CHAIN_CAPTURE_DR || state == DAP_CHAIN_CAPTURE_IR) {
+            chain_capture(state == DAP_CHAIN_CAPTURE_IR);
+        } else if (state == DAP_CHAIN_UPDATE_IR) {
+            for (size_t i = 0; i < dap_chain.count; i++) {
+                dap_chain.tap[i].ir = (uint32_t) dap_chain.tap[i].shift;
+            }
+        } else if (state == DAP_CHAIN_UPDATE_DR) {
+            for (size_t i = 0; i < dap_chain.count; i++) {
+                if (chain_bsr_selected(i)) dap_chain.tap[i].bsr = (uint32_t) dap_chain.tap[i].shift;
+            }
+        }
+
+        dap_chain.state = chain_next_state[state][tms];
+        if (dap_chain.state == DAP_CHAIN_TEST_LOGIC_RESET) {
+            chain_reset();
+        }
+    } else {
+        /* falling edge, the tap nearest tdo drives the next bit of a scan */
+        if (dap_chain.state != DAP_CHAIN_SHIFT_DR && dap_chain.state != DAP_CHAIN_SHIFT_IR) return;
+        gpio_emul_input_set(dap_io_tdo->port, dap_io_tdo->pin, dap_chain.tap[0].shift & 0x01);
+    }
+}
+
+void dap_chain_init(void) {
+    gpio_init_callback(&dap_chain.cb, dap_chain_handler, BIT(dap_io_tck_swclk->pin));
+}
+
+void dap_chain_start(const struct dap_chain_tap *taps, size_t count) {
+    dap_chain.taps = taps;
+    dap_chain.count = MIN(count, DAP_CHAIN_MAX_TAPS);
+    dap_chain.state = DAP_CHAIN_TEST_LOGIC_RESET;
+    dap_chain.tck_count = 0;
+    memset(dap_chain.stream, 0, sizeof(dap_chain.stream));
+    dap_chain.stream_bits = 0;
+    memset(dap_chain.tap, 0, sizeof(dap_chain.tap));
+    chain_reset();
+
+    gpio_pin_interrupt_configure_dt(dap_io_tck_swclk, GPIO_INT_EDGE_BOTH);
+    gpio_add_callback_dt(dap_io_tck_swclk, &dap_chain.cb);
+}
+
+void dap_chain_end(void) {
+    gpio_pin_interrupt_configure_dt(dap_io_tck_swclk, GPIO_INT_DISABLE);
+    gpio_remove_callback_dt(dap_io_tck_swclk, &dap_chain.cb);
+}
+
+uint8_t dap_chain_get_state(void) {
+    return dap_chain.state;
+}
+
+uint32_t dap_chain_get_ir(size_t index) {
+    return dap_chain.tap[index].ir;
+}
+
+uint32_t dap_chain_get_bsr(size_t index) {
+    return dap_chain.tap[index].bsr;
+}
+
+size_t dap_chain_get_stream(uint8_t *data, size_t len) {
+    memcpy(data, dap_chain.stream, MIN(len, sizeof(dap_chain.stream)));
+    return dap_chain.stream_bits;
+}
+
+uint32_t dap_chain_get_tck_count(void) {
+    return dap_chain.tck_count;
+}
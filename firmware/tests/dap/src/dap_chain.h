@@ -0,0 +1,77 @@
+#ifndef __DAP_CHAIN_H__
+#define __DAP_CHAIN_H__
+
+#include <string.h>
+
+/* maximum number of taps in the emulated JTAG chain */
+#define DAP_CHAIN_MAX_TAPS      (8)
+
+/* emulated JTAG tap states, in IEEE 1149.1 order */
+#define DAP_CHAIN_TEST_LOGIC_RESET  (0)
+#define DAP_CHAIN_RUN_TEST_IDLE     (1)
+#define DAP_CHAIN_SELECT_DR_SCAN    (2)
+#define DAP_CHAIN_CAPTURE_DR        (3)
+#define DAP_CHAIN_SHIFT_DR          (4)
+#define DAP_CHAIN_EXIT1_DR          (5)
+#define DAP_CHAIN_PAUSE_DR          (6)
+#define DAP_CHAIN_EXIT2_DR          (7)
+#define DAP_CHAIN_UPDATE_DR         (8)
+#define DAP_CHAIN_SELECT_IR_SCAN    (9)
+#define DAP_CHAIN_CAPTURE_IR        (10)
+#define DAP_CHAIN_SHIFT_IR          (11)
+#define DAP_CHAIN_EXIT1_IR          (12)
+#define DAP_CHAIN_PAUSE_IR          (13)
+#define DAP_CHAIN_EXIT2_IR          (14)
+#define DAP_CHAIN_UPDATE_IR         (15)
+
+/* a single tap of the chain, without an idcode register if idcode is 0 */
+struct dap_chain_tap {
+    uint8_t ir_length;
+    /* value loaded into the instruction shift register in capture-ir */
+    uint32_t ir_capture;
+    /* instruction selecting the idcode register, loaded in test-logic-reset */
+    uint32_t idcode_ir;
+    uint32_t idcode;
+    /* boundary scan register selected by either instruction, without one if bsr_length is 0, its pins read back
+     * what the register last drove, except for those in the stuck mask which always read the stuck value */
+    uint8_t bsr_length;
+    uint32_t sample_ir;
+    uint32_t extest_ir;
+    uint32_t bsr_stuck_mask;
+    uint32_t bsr_stuck_value;
+    /* instruction selecting a single bit register that records every bit shifted into it, without one if 0 */
+    uint32_t stream_ir;
+    /* instructions selecting a 35 bit DPACC or APACC register, without them if 0, the first acc_waits scans of
+     * either answer WAIT, and every one after that OK with acc_data */
+    uint32_t dpacc_ir;
+    uint32_t apacc_ir;
+    uint32_t acc_waits;
+    uint32_t acc_data;
+};
+
+/* initialize chain data structures */
+void dap_chain_init(void);
+
+/* (reset internal state and) start responding to JTAG clocks, tap 0 is the one connected to TDO, and the taps
+ * must stay valid while the chain runs */
+void dap_chain_start(const struct dap_chain_tap *taps, size_t count);
+
+/* ends chain run */
+void dap_chain_end(void);
+
+/* returns the current tap controller state */
+uint8_t dap_chain_get_state(void);
+
+/* returns the instruction currently held by a tap */
+uint32_t dap_chain_get_ir(size_t index);
+
+/* returns the values last updated into the boundary scan register of a tap */
+uint32_t dap_chain_get_bsr(size_t index);
+
+/* copies the bits recorded by stream registers since the chain started, lsb first, returning the number of bits */
+size_t dap_chain_get_stream(uint8_t *data, size_t len);
+
+/* returns the number of tck cycles since the chain started */
+uint32_t dap_chain_get_tck_count(void);
+
+#endif /* __DAP_CHAIN_H__ */
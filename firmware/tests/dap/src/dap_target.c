@@ -0,0 +1,516 @@
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include "dap_io.h"
+#include "dap_target.h"
+
+/* swd packet phases, counted in clock cycles from the start bit */
+#define TARGET_HEADER_END       (7)
+#define TARGET_ACK_START        (9)
+#define TARGET_READ_START       (12)
+#define TARGET_READ_END         (45)
+#define TARGET_WRITE_START      (13)
+#define TARGET_WRITE_END        (45)
+#define TARGET_NO_DATA_END      (12)
+
+/* number of consecutive high swdio bits that make up a line reset */
+#define TARGET_LINE_RESET_BITS  (50)
+/* TARGETSEL write packet header, in the order the bits are received */
+#define TARGET_TARGETSEL_HEADER (0x99)
+
+static const uint8_t target_state_idle = 0;
+static const uint8_t target_state_packet = 1;
+static const uint8_t target_state_lockout = 2;
+
+static const uint8_t target_ack_ok = 0x01;
+static const uint8_t target_ack_wait = 0x02;
+static const uint8_t target_ack_fault = 0x04;
+
+static const uint32_t target_dpidr = 0x2ba01477;
+static const uint32_t target_ap_idr = 0x24770011;
+
+/* core debug register fields */
+static const uint32_t dhcsr_dbgkey = 0xa05f0000;
+static const uint32_t dhcsr_c_debugen = 0x00000001;
+static const uint32_t dhcsr_c_halt = 0x00000002;
+static const uint32_t dhcsr_s_regrdy = 0x00010000;
+static const uint32_t dhcsr_s_halt = 0x00020000;
+static const uint32_t dcrsr_regwnr = 0x00010000;
+static const uint32_t demcr_vc_corereset = 0x00000001;
+static const uint32_t aircr_vectkey = 0x05fa0000;
+static const uint32_t aircr_sysresetreq = 0x00000004;
+
+static const uint32_t ctrl_stat_stickyerr = 0x00000020;
+static const uint32_t ctrl_stat_powerup_req = 0x50000000;
+
+static struct {
+    struct gpio_callback cb;
+    uint8_t state;
+    /* clock cycles since the start bit of the current packet */
+    uint8_t cycle;
+    /* consecutive high bits, for line reset detection */
+    uint8_t ones;
+    bool line_reset;
+    /* packet header bits */
+    bool ap_ndp;
+    bool r_nw;
+    uint8_t addr;
+    /* current packet acknowledge and data */
+    uint8_t ack;
+    uint32_t data;
+
+    uint32_t transfers;
+    uint32_t waits;
+    /* clock cycles a memory access keeps the ap busy for, and the cycles left of the current one */
+    uint32_t ap_latency;
+    uint32_t ap_busy;
+
+    /* debug port registers */
+    uint32_t ctrl_stat;
+    uint32_t select;
+    uint32_t rdbuff;
+    /* mem-ap registers */
+    uint32_t csw;
+    uint32_t tar;
+
+    /* multi-drop targets, the registers above belong to the selected one while the others keep theirs here */
+    struct {
+        uint32_t id;
+        uint32_t ctrl_stat;
+        uint32_t select;
+        uint32_t rdbuff;
+        uint32_t csw;
+        uint32_t tar;
+    } drops[DAP_TARGET_DROP_COUNT];
+    size_t drop_count;
+    /* selected multi-drop target, or -1 if none are */
+    int8_t drop;
+    /* set by a line reset, when the next packet can select a target */
+    bool targetsel_pending;
+    /* the current packet is a TARGETSEL write, which no target acknowledges */
+    bool targetsel;
+
+    /* core debug state */
+    struct {
+        uint32_t dhcsr;
+        uint32_t dcrdr;
+        uint32_t demcr;
+        uint32_t regs[DAP_TARGET_CORE_REG_COUNT];
+        /* program counters the running core steps through */
+        const uint32_t *pcs;
+        size_t pc_count;
+        size_t pc_index;
+        /* runs whatever function the core is resumed into */
+        dap_target_core_call_t call;
+    } core;
+
+    uint8_t ram[DAP_TARGET_RAM_SIZE];
+} dap_target;
+
+static uint32_t target_core_pc(void) {
+    if (dap_target.core.pc_count == 0) return dap_target.core.regs[15];
+    return dap_target.core.pcs[dap_target.core.pc_index % dap_target.core.pc_count];
+}
+
+static bool target_sys_access(uint32_t addr, uint32_t *data, bool write) {
+    bool halted = (dap_target.core.dhcsr & dhcsr_s_halt) != 0;
+
+    if (addr == 0xe000edf0) {
+        if (write && (*data & 0xffff0000) == dhcsr_dbgkey) {
+            bool halt = (*data & dhcsr_c_debugen) != 0 && (*data & dhcsr_c_halt) != 0;
+            if (halt && !halted) {
+                dap_target.core.regs[15] = target_core_pc();
+            } else if (!halt && halted && dap_target.core.call != NULL) {
+                /* the function returns straight away, and halts on its breakpoint */
+                halt = dap_target.core.call(dap_target.core.regs);
+            } else if (!halt && halted) {
+                dap_target.core.pc_index++;
+            }
+            dap_target.core.dhcsr = (*data & 0x0f) | (halt ? dhcsr_s_halt : 0);
+        }
+        /* register transfers complete immediately */
+        *data = dap_target.core.dhcsr | dhcsr_s_regrdy;
+    } else if (addr == 0xe000edf4) {
+        uint8_t reg = *data & 0x7f;
+        if (write && halted && reg < DAP_TARGET_CORE_REG_COUNT) {
+            if ((*data & dcrsr_regwnr) != 0) {
+                dap_target.core.regs[reg] = dap_target.core.dcrdr;
+            } else {
+                dap_target.core.dcrdr = dap_target.core.regs[reg];
+            }
+        }
+        *data = 0;
+    } else if (addr == 0xe000edf8) {
+        if (write) dap_target.core.dcrdr = *data;
+        *data = dap_target.core.dcrdr;
+    } else if (addr == 0xe000edfc) {
+        if (write) dap_target.core.demcr = *data;
+        *data = dap_target.core.demcr;
+    } else if (addr == 0xe000ed0c) {
+        if (write && (*data & 0xffff0000) == aircr_vectkey && (*data & aircr_sysresetreq) != 0) {
+            /* the core starts its program over, halting on the reset vector if debug catches it */
+            dap_target.core.pc_index = 0;
+            bool halt = (dap_target.core.dhcsr & dhcsr_c_debugen) != 0 &&
+                (dap_target.core.demcr & demcr_vc_corereset) != 0;
+            if (halt) dap_target.core.regs[15] = target_core_pc();
+            dap_target.core.dhcsr = (dap_target.core.dhcsr & dhcsr_c_debugen) | (halt ? dhcsr_c_halt | dhcsr_s_halt : 0);
+        }
+        *data = 0xfa050000;
+    } else if (addr == 0xe000101c) {
+        /* every pc sample read sees the running core a step further along */
+        *data = halted ? 0xffffffff : target_core_pc();
+        if (!halted) dap_target.core.pc_index++;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool target_mem_access(uint32_t addr, uint32_t *data, bool write, uint32_t size) {
+    if (addr >= 0xe0000000) return size == 4 && target_sys_access(addr, data, write);
+    if (addr < DAP_TARGET_RAM_BASE || addr >= DAP_TARGET_RAM_BASE + DAP_TARGET_RAM_SIZE) return false;
+
+    /* data is always placed on the byte lanes of the addressed bytes within the word */
+    uint8_t *word = &dap_target.ram[(addr - DAP_TARGET_RAM_BASE) & ~0x03];
+    uint8_t lane = addr & 0x03;
+    for (uint8_t i = lane; i < lane + size && i < 4; i++) {
+        if (write) {
+            word[i] = (uint8_t) (*data >> (i * 8));
+        }
+    }
+    if (!write) {
+        *data = sys_get_le32(word);
+    }
+    return true;
+}
+
+static uint32_t target_ap_access(uint8_t reg, uint32_t data, bool write) {
+    /* only a single mem-ap exists, at index 0 */
+    if ((dap_target.select >> 24) != 0) return 0;
+
+    if (reg == 0x00) {
+        if (write) {
+            dap_target.csw = data & 0xff7fff77;
+        }
+        /* device enabled is always set */
+        return dap_target.csw | 0x40;
+    } else if (reg == 0x04) {
+        if (write) {
+            dap_target.tar = data;
+        }
+        return dap_target.tar;
+    } else if (reg == 0x0c || (reg >= 0x10 && reg <= 0x1c)) {
+        uint32_t size = 1 << (dap_target.csw & 0x07);
+        uint32_t addr = dap_target.tar;
+        if (reg != 0x0c) {
+            addr = (dap_target.tar & ~0x0f) | (reg & 0x0c);
+            size = 4;
+        }
+        if (!target_mem_access(addr, &data, write, size)) {
+            dap_target.ctrl_stat |= ctrl_stat_stickyerr;
+            return 0;
+        }
+        dap_target.ap_busy = dap_target.ap_latency;
+        if (reg == 0x0c && (dap_target.csw & 0x30) == 0x10) {
+            /* auto increment only operates within a 1KiB block */
+            dap_target.tar = (dap_target.tar & ~0x3ff) | ((dap_target.tar + size) & 0x3ff);
+        }
+        return data;
+    } else if (reg == 0xfc) {
+        return target_ap_idr;
+    }
+
+    return 0;
+}
+
+static void target_dp_write(uint8_t addr, uint32_t data) {
+    if (addr == 0x00) {
+        /* abort, clears sticky error flags */
+        if ((data & 0x04) != 0) {
+            dap_target.ctrl_stat &= ~ctrl_stat_stickyerr;
+        }
+    } else if (addr == 0x04) {
+        dap_target.ctrl_stat = (data & ~ctrl_stat_stickyerr) | (dap_target.ctrl_stat & ctrl_stat_stickyerr);
+    } else if (addr == 0x08) {
+        dap_target.select = data;
+    }
+}
+
+static uint32_t target_dp_read(uint8_t addr) {
+    if (addr == 0x00) {
+        return target_dpidr;
+    } else if (addr == 0x04) {
+        /* power up acknowledge bits mirror the requests */
+        return dap_target.ctrl_stat | ((dap_target.ctrl_stat & ctrl_stat_powerup_req) << 1);
+    } else if (addr == 0x0c) {
+        return dap_target.rdbuff;
+    }
+
+    return 0;
+}
+
+/* moves the debug port and mem-ap registers of the selected multi-drop target aside, and brings in another's */
+static void target_drop_select(int8_t drop) {
+    if (dap_target.drop >= 0) {
+        dap_target.drops[dap_target.drop].ctrl_stat = dap_target.ctrl_stat;
+        dap_target.drops[dap_target.drop].select = dap_target.select;
+        dap_target.drops[dap_target.drop].rdbuff = dap_target.rdbuff;
+        dap_target.drops[dap_target.drop].csw = dap_target.csw;
+        dap_target.drops[dap_target.drop].tar = dap_target.tar;
+    }
+    if (drop >= 0) {
+        dap_target.ctrl_stat = dap_target.drops[drop].ctrl_stat;
+        dap_target.select = dap_target.drops[drop].select;
+        dap_target.rdbuff = dap_target.drops[drop].rdbuff;
+        dap_target.csw = dap_target.drops[drop].csw;
+        dap_target.tar = dap_target.drops[drop].tar;
+    }
+    dap_target.drop = drop;
+}
+
+/* called after the last header bit, determines the acknowledge and any read data */
+static void target_header_complete(uint8_t header) {
+    uint8_t parity = (header >> 1) & 0x0f;
+    parity = (parity ^ (parity >> 1) ^ (parity >> 2) ^ (parity >> 3)) & 0x01;
+    if (((header >> 5) & 0x01) != parity || ((header >> 6) & 0x01) != 0 || ((header >> 7) & 0x01) != 1) {
+        /* protocol error, target will not respond again until a line reset */
+        dap_target.state = target_state_lockout;
+        return;
+    }
+
+    if (dap_target.drop_count > 0) {
+        /* only the packet straight after a line reset can select a target, and a deselected target ignores
+         * everything else until the next line reset */
+        bool pending = dap_target.targetsel_pending;
+        dap_target.targetsel_pending = false;
+        if (pending && header == TARGET_TARGETSEL_HEADER) {
+            dap_target.targetsel = true;
+            dap_target.ack = target_ack_ok;
+            dap_target.r_nw = false;
+            return;
+        } else if (dap_target.drop < 0) {
+            dap_target.state = target_state_lockout;
+            return;
+        }
+    }
+
+    dap_target.ap_ndp = (header >> 1) & 0x01;
+    dap_target.r_nw = (header >> 2) & 0x01;
+    dap_target.addr = ((header >> 3) & 0x03) << 2;
+    dap_target.ack = target_ack_ok;
+
+    if (dap_target.ap_ndp && (dap_target.ctrl_stat & ctrl_stat_stickyerr) != 0) {
+        dap_target.ack = target_ack_fault;
+        return;
+    }
+    /* a busy ap stalls its own accesses, and reads of its posted result */
+    if (dap_target.ap_busy > 0 && (dap_target.ap_ndp || (dap_target.r_nw && dap_target.addr == 0x0c))) {
+        dap_target.ack = target_ack_wait;
+        dap_target.waits++;
+        return;
+    }
+    dap_target.transfers++;
+
+    if (dap_target.r_nw) {
+        if (dap_target.ap_ndp) {
+            /* ap reads return the previously posted result */
+            dap_target.data = dap_target.rdbuff;
+            dap_target.rdbuff = target_ap_access((dap_target.select & 0xf0) | dap_target.addr, 0, false);
+        } else {
+            dap_target.data = target_dp_read(dap_target.addr);
+        }
+    }
+}
+
+static void target_write_complete(void) {
+    if (dap_target.targetsel) {
+        dap_target.targetsel = false;
+        int8_t drop = -1;
+        for (size_t i = 0; i < dap_target.drop_count; i++) {
+            if (dap_target.drops[i].id == dap_target.data) drop = i;
+        }
+        target_drop_select(drop);
+    } else if (dap_target.ap_ndp) {
+        target_ap_access((dap_target.select & 0xf0) | dap_target.addr, dap_target.data, true);
+    } else {
+        target_dp_write(dap_target.addr, dap_target.data);
+    }
+}
+
+static void dap_target_handler(const struct device *port, struct gpio_callback *cb, gpio_port_pins_t pins) {
+    gpio_flags_t flags;
+    gpio_emul_flags_get(dap_io_tms_swdio->port, dap_io_tms_swdio->pin, &flags);
+    bool swdio_output = (flags & GPIO_OUTPUT) == GPIO_OUTPUT ? true : false;
+
+    if (gpio_pin_get_dt(dap_io_tck_swclk) == 1) {
+        /* rising edge, the target samples any probe driven data */
+        uint8_t swdio = gpio_pin_get_dt(dap_io_tms_swdio);
+        if (dap_target.ap_busy > 0) dap_target.ap_busy--;
+        if (swdio_output) {
+            dap_target.ones = swdio ? MIN(dap_target.ones + 1, TARGET_LINE_RESET_BITS) : 0;
+        }
+
+        if (dap_target.state == target_state_idle) {
+            if (swdio_output && swdio == 1) {
+                dap_target.state = target_state_packet;
+                dap_target.cycle = 0;
+                dap_target.data = 1;
+            }
+        } else if (dap_target.state == target_state_packet) {
+            dap_target.cycle++;
+            if (dap_target.cycle <= TARGET_HEADER_END) {
+                /* header bits are collected in the data field until the header is complete */
+                dap_target.data |= swdio << dap_target.cycle;
+                if (dap_target.cycle == TARGET_HEADER_END) {
+                    target_header_complete((uint8_t) dap_target.data);
+                }
+            } else if (dap_target.ack != target_ack_ok) {
+                if (dap_target.cycle >= TARGET_NO_DATA_END) {
+                    dap_target.state = target_state_idle;
+                }
+            } else if (dap_target.r_nw) {
+                if (dap_target.cycle >= TARGET_READ_END) {
+                    dap_target.state = target_state_idle;
+                }
+            } else {
+                if (dap_target.cycle == TARGET_WRITE_START) {
+                    dap_target.data = 0;
+                }
+                if (dap_target.cycle >= TARGET_WRITE_START && dap_target.cycle < TARGET_WRITE_END) {
+                    dap_target.data |= (uint32_t) swdio << (dap_target.cycle - TARGET_WRITE_START);
+                } else if (dap_target.cycle == TARGET_WRITE_END) {
+                    target_write_complete();
+                    dap_target.state = target_state_idle;
+                }
+            }
+        } else if (dap_target.state == target_state_lockout) {
+            /* only a line reset followed by an idle bit gets the target out of lockout */
+            if (swdio_output && swdio == 0 && dap_target.line_reset) {
+                dap_target.state = target_state_idle;
+                dap_target.line_reset = false;
+                dap_target.targetsel_pending = dap_target.drop_count > 0;
+            }
+        }
+
+        if (dap_target.ones >= TARGET_LINE_RESET_BITS) {
+            dap_target.state = target_state_lockout;
+            dap_target.line_reset = true;
+        }
+    } else {
+        /* falling edge, the target drives data for the upcoming cycle */
+        if (swdio_output) return;
+        if (dap_target.state != target_state_packet || dap_target.targetsel) {
+            /* nothing drives a multi-drop bus while no target responds, so it is pulled high */
+            if (dap_target.drop_count > 0) gpio_emul_input_set(dap_io_tms_swdio->port, dap_io_tms_swdio->pin, 1);
+            return;
+        }
+
+        uint8_t next = dap_target.cycle + 1;
+        int32_t bit = -1;
+        if (next >= TARGET_ACK_START && next < TARGET_ACK_START + 3) {
+            bit = (dap_target.ack >> (next - TARGET_ACK_START)) & 0x01;
+        } else if (dap_target.ack == target_ack_ok && dap_target.r_nw) {
+            if (next >= TARGET_READ_START && next < TARGET_READ_END - 1) {
+                bit = (dap_target.data >> (next - TARGET_READ_START)) & 0x01;
+            } else if (next == TARGET_READ_END - 1) {
+                bit = __builtin_parity(dap_target.data);
+            }
+        }
+
+        if (bit >= 0) {
+            gpio_emul_input_set(dap_io_tms_swdio->port, dap_io_tms_swdio->pin, bit);
+        }
+    }
+}
+
+void dap_target_init(void) {
+    gpio_init_callback(&dap_target.cb, dap_target_handler, BIT(dap_io_tck_swclk->pin));
+}
+
+void dap_target_reset(void) {
+    dap_target.state = target_state_idle;
+    dap_target.cycle = 0;
+    dap_target.ones = 0;
+    dap_target.line_reset = false;
+    dap_target.transfers = 0;
+    dap_target.waits = 0;
+    dap_target.ap_latency = 0;
+    dap_target.ap_busy = 0;
+    dap_target.ctrl_stat = 0;
+    dap_target.select = 0;
+    dap_target.rdbuff = 0;
+    dap_target.csw = 0x03000002;
+    dap_target.tar = 0;
+    dap_target.drop_count = 0;
+    dap_target.drop = -1;
+    dap_target.targetsel_pending = false;
+    dap_target.targetsel = false;
+    memset(&dap_target.core, 0, sizeof(dap_target.core));
+}
+
+void dap_target_start(void) {
+    dap_target_reset();
+
+    gpio_pin_interrupt_configure_dt(dap_io_tck_swclk, GPIO_INT_EDGE_BOTH);
+    gpio_add_callback_dt(dap_io_tck_swclk, &dap_target.cb);
+}
+
+void dap_target_end(void) {
+    gpio_pin_interrupt_configure_dt(dap_io_tck_swclk, GPIO_INT_DISABLE);
+    gpio_remove_callback_dt(dap_io_tck_swclk, &dap_target.cb);
+}
+
+void dap_target_mem_write(uint32_t addr, const void *data, size_t len) {
+    memcpy(&dap_target.ram[addr - DAP_TARGET_RAM_BASE], data, len);
+}
+
+void dap_target_mem_read(uint32_t addr, void *data, size_t len) {
+    memcpy(data, &dap_target.ram[addr - DAP_TARGET_RAM_BASE], len);
+}
+
+uint32_t dap_target_get_transfer_count(void) {
+    return dap_target.transfers;
+}
+
+uint32_t dap_target_get_wait_count(void) {
+    return dap_target.waits;
+}
+
+void dap_target_set_ap_latency(uint32_t cycles) {
+    dap_target.ap_latency = cycles;
+}
+
+void dap_target_set_multidrop(const uint32_t *ids, size_t count) {
+    dap_target.drop_count = MIN(count, DAP_TARGET_DROP_COUNT);
+    for (size_t i = 0; i < dap_target.drop_count; i++) {
+        dap_target.drops[i].id = ids[i];
+        dap_target.drops[i].ctrl_stat = 0;
+        dap_target.drops[i].select = 0;
+        dap_target.drops[i].rdbuff = 0;
+        dap_target.drops[i].csw = 0x03000002;
+        dap_target.drops[i].tar = 0;
+    }
+    /* no target is selected until the first line reset and TARGETSEL */
+    dap_target.drop = -1;
+    dap_target.state = target_state_lockout;
+}
+
+int8_t dap_target_get_drop(void) {
+    return dap_target.drop;
+}
+
+void dap_target_core_set_pcs(const uint32_t *pcs, size_t count) {
+    dap_target.core.pcs = pcs;
+    dap_target.core.pc_count = count;
+    dap_target.core.pc_index = 0;
+}
+
+void dap_target_core_set_call(dap_target_core_call_t call) {
+    dap_target.core.call = call;
+}
+
+bool dap_target_core_halted(void) {
+    return (dap_target.core.dhcsr & dhcsr_s_halt) != 0;
+}
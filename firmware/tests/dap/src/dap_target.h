@@ -0,0 +1,58 @@
+#ifndef __DAP_TARGET_H__
+#define __DAP_TARGET_H__
+
+#include <string.h>
+
+/* emulated target ram, accessible through the MEM-AP at index 0 */
+#define DAP_TARGET_RAM_BASE     (0x20000000)
+#define DAP_TARGET_RAM_SIZE     (KB(16))
+/* number of emulated core registers, reachable through the core debug registers */
+#define DAP_TARGET_CORE_REG_COUNT   (21)
+/* maximum number of targets sharing a multi-drop bus */
+#define DAP_TARGET_DROP_COUNT   (2)
+
+/* initialize target data structures */
+void dap_target_init(void);
+
+/* reset target internal state, ram contents are kept */
+void dap_target_reset(void);
+
+/* (reset internal state and) start responding to SWD transfers */
+void dap_target_start(void);
+
+/* ends target run */
+void dap_target_end(void);
+
+/* direct access to target ram, outside of any SWD transfers */
+void dap_target_mem_write(uint32_t addr, const void *data, size_t len);
+void dap_target_mem_read(uint32_t addr, void *data, size_t len);
+
+/* returns the number of SWD transfers acknowledged by the target since the last reset */
+uint32_t dap_target_get_transfer_count(void);
+
+/* returns the number of SWD transfers answered with WAIT since the last reset */
+uint32_t dap_target_get_wait_count(void);
+
+/* sets the number of clock cycles each memory access keeps the ap busy for, answering WAIT until then */
+void dap_target_set_ap_latency(uint32_t cycles);
+
+/* makes the target a multi-drop bus of targets answering to each of the TARGETSEL ids, each with its own debug port
+ * and mem-ap registers but sharing ram and the core, must be set after the target starts */
+void dap_target_set_multidrop(const uint32_t *ids, size_t count);
+
+/* returns the index of the selected multi-drop target, or -1 if none is */
+int8_t dap_target_get_drop(void);
+
+/* program counters the emulated core steps through, one step per pc sample read or halt, the
+ * sequence repeats once finished, and must stay valid while the target runs */
+void dap_target_core_set_pcs(const uint32_t *pcs, size_t count);
+
+/* called with the core registers whenever the halted core is resumed, returns true if the function the
+ * core was resumed into has completed and the core halted again, must be set after the target starts */
+typedef bool (*dap_target_core_call_t)(uint32_t *regs);
+void dap_target_core_set_call(dap_target_core_call_t call);
+
+/* returns true if the emulated core is halted */
+bool dap_target_core_halted(void);
+
+#endif /* __DAP_TARGET_H__ */
@@ -13,27 +13,36 @@ static int32_t dap_transport_configure(void) {
 
 static uint8_t buf[KB(3)];
 static size_t buf_len;
+/* requests are kept apart from responses, since a response can be sent while the next request is made */
+static uint8_t request_buf[KB(3)];
+static size_t request_buf_len;
 
 /* a test request is available and the transport_recv function can continue */
 static K_SEM_DEFINE(request_available, 0, 1);
-static int32_t dap_transport_recv(uint8_t *recv, size_t len) {
-    k_sem_take(&request_available, K_FOREVER);
+static int32_t dap_transport_recv(uint8_t *recv, size_t len, k_timeout_t timeout) {
+    if (k_sem_take(&request_available, timeout) != 0) return -EAGAIN;
 
-    zassert(len > buf_len, "requested command length greater than available space");
-    memcpy(recv, buf, buf_len);
+    zassert(len > request_buf_len, "requested command length greater than available space");
+    memcpy(recv, request_buf, request_buf_len);
 
-    return buf_len;
+    return request_buf_len;
 }
 
 static K_SEM_DEFINE(response_available, 0, 1);
-static int32_t dap_transport_send(uint8_t *send, size_t len) {
-    /* we should be all set with the request data in the buffer at this point */
-    buf_len = len;
-    memcpy(buf, send, len);
+/* the last response has been read by the test and the buffer can take another */
+static K_SEM_DEFINE(response_free, 1, 1);
+static int32_t dap_transport_send(const struct dap_transport_buf *bufs, size_t count) {
+    k_sem_take(&response_free, K_FOREVER);
+
+    buf_len = 0;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(&buf[buf_len], bufs[i].data, bufs[i].len);
+        buf_len += bufs[i].len;
+    }
 
     k_sem_give(&response_available);
 
-    return len;
+    return buf_len;
 }
 
 DAP_TRANSPORT_DEFINE(
@@ -45,9 +54,10 @@ DAP_TRANSPORT_DEFINE(
 );
 
 void dap_transport_command(uint8_t *request, size_t request_len, uint8_t **response, size_t *response_len) {
-    buf_len = request_len;
-    memcpy(buf, request, request_len);
+    request_buf_len = request_len;
+    memcpy(request_buf, request, request_len);
     k_sem_give(&request_available);
+    k_sem_give(&response_free);
 
     /* queued commands will never call the send function, since no response has been created, but we
      * want to make sure it isn't called, so wait for a reasonable timeout and then return no data. */
@@ -58,3 +68,15 @@ void dap_transport_command(uint8_t *request, size_t request_len, uint8_t **respo
     }
     *response = buf;
 }
+
+void dap_transport_response(uint8_t **response, size_t *response_len) {
+    /* sends that don't need a request, like the rest of a long memory read, are only made once the test is
+     * done with the last response */
+    k_sem_give(&response_free);
+    if (k_sem_take(&response_available, K_SECONDS(1)) == -EAGAIN) {
+        *response_len = 0;
+    } else {
+        *response_len = buf_len;
+    }
+    *response = buf;
+}
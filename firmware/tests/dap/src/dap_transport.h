@@ -6,6 +6,7 @@
 #include "util/print.h"
 
 void dap_transport_command(uint8_t *request, size_t request_len, uint8_t **response, size_t *response_len);
+void dap_transport_response(uint8_t **response, size_t *response_len);
 
 /* always expects '_request' and '_expect' in string forms, so make sure to skip
  * the null terminator when calculating size. */
@@ -3,7 +3,9 @@
 #include <zephyr/ztest.h>
 
 #include "dap_io.h"
+#include "dap_chain.h"
 #include "dap_emul.h"
+#include "dap_target.h"
 #include "dap_transport.h"
 #include "util/gpio.h"
 
@@ -32,7 +34,9 @@ static void *dap_tests_setup(void) {
     zassert_ok(flash_area_write(fa, 0, nvs_data, sizeof(nvs_data)));
     flash_area_close(fa);
 
+    dap_chain_init();
     dap_emul_init();
+    dap_target_init();
 
     zassert_ok(nvs_init());
     zassert_ok(dap_init());
@@ -48,8 +52,10 @@ static void dap_tests_before(void *fixture) {
     assert_dap_command_expect("\x03", "\x03\x00");
     /* target reference voltage low */
     assert_gpio_emul_input_set(dap_io_vtref, 0);
-    /* target emulator disabled */
+    /* target emulators disabled */
+    dap_chain_end();
     dap_emul_end();
+    dap_target_end();
 }
 
 ZTEST_SUITE(dap, NULL, dap_tests_setup, dap_tests_before, NULL, NULL);
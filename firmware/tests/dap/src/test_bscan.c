@@ -0,0 +1,63 @@
+#include <zephyr/ztest.h>
+
+#include "dap_io.h"
+#include "dap_chain.h"
+#include "dap_transport.h"
+#include "util/gpio.h"
+
+ZTEST(dap, test_vendor_bscan) {
+    /* 12 cell boundary register, vectors are the cells to drive, the cells expected back, and the compare mask */
+    const uint8_t vectors[] = {
+        0xa5, 0x00, 0xa5, 0x00, 0xff, 0x0f,
+        0x5a, 0x03, 0x5a, 0x03, 0xff, 0x0f,
+        0xff, 0x0f, 0x00, 0x00, 0x0f, 0x00,
+    };
+    struct dap_chain_tap taps[] = {
+        {.ir_length = 4, .ir_capture = 0x01, .idcode_ir = 0x0e, .idcode = 0x4ba00477},
+        {.ir_length = 5, .ir_capture = 0x01, .bsr_length = 12, .sample_ir = 0x02, .extest_ir = 0x00},
+        {.ir_length = 3, .ir_capture = 0x01},
+    };
+
+    uint8_t upload[5 + sizeof(vectors)] = {0x97, 0x00, 0x00, sizeof(vectors), 0x00};
+    memcpy(&upload[5], vectors, sizeof(vectors));
+    uint8_t *response;
+    size_t response_len;
+    dap_transport_command(upload, sizeof(upload), &response, &response_len);
+    zassert_equal(response_len, 2);
+    zassert_mem_equal(response, "\x97\x00", 2);
+    /* vectors must fit in the vector memory */
+    assert_dap_command_expect("\x97\xff\x0f\x02\x00\x00\x00", "\x97\xff");
+
+    /* only available on the JTAG port */
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+    assert_dap_command_expect("\x98\x01\x0c\x00" "\x02\x00\x00\x00" "\x00\x00\x00\x00" "\x03\x00", "\x98\xff\x00\x00");
+    assert_dap_command_expect("\x02\x02", "\x02\x02");
+    assert_dap_command_expect("\x15\x03\x04\x05\x03", "\x15\x00");
+
+    /* host resets the taps and moves them to idle */
+    dap_chain_start(taps, 3);
+    assert_dap_command_expect("\x12\x08\xff", "\x12\x00");
+    assert_dap_command_expect("\x14\x01\x01\x00", "\x14\x00");
+
+    /* vectors past the end of memory, or a device not on the chain, are rejected */
+    assert_dap_command_expect("\x98\x01\x0c\x00" "\x02\x00\x00\x00" "\x00\x00\x00\x00" "\x00\x10", "\x98\xff\x00\x00");
+    assert_dap_command_expect("\x98\x03\x0c\x00" "\x02\x00\x00\x00" "\x00\x00\x00\x00" "\x03\x00", "\x98\xff\x00\x00");
+
+    /* on a good board only the last vector, which expects the wrong value, fails */
+    assert_dap_command_expect("\x98\x01\x0c\x00" "\x02\x00\x00\x00" "\x00\x00\x00\x00" "\x03\x00", "\x98\x00\x01\x00\x04");
+    zassert_equal(dap_chain_get_ir(0), 0x0f);
+    zassert_equal(dap_chain_get_ir(1), 0x00);
+    zassert_equal(dap_chain_get_ir(2), 0x07);
+    zassert_equal(dap_chain_get_bsr(1), 0xfff);
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_UPDATE_DR);
+    dap_chain_end();
+
+    /* with a pin stuck low, the first vector fails as well */
+    taps[1].bsr_stuck_mask = 0x001;
+    dap_chain_start(taps, 3);
+    assert_dap_command_expect("\x12\x08\xff", "\x12\x00");
+    assert_dap_command_expect("\x14\x01\x01\x00", "\x14\x00");
+    assert_dap_command_expect("\x98\x01\x0c\x00" "\x02\x00\x00\x00" "\x00\x00\x00\x00" "\x03\x00", "\x98\x00\x02\x00\x05");
+    dap_chain_end();
+}
@@ -0,0 +1,120 @@
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#include "dap_io.h"
+#include "dap_target.h"
+#include "dap_transport.h"
+#include "util/gpio.h"
+
+/* algorithm placed at the start of ram, with two page buffers, and a region of ram standing in for flash */
+#define FLASH_ALGO_BKPT         (DAP_TARGET_RAM_BASE)
+#define FLASH_ALGO_PROGRAM      (DAP_TARGET_RAM_BASE + 0x20)
+#define FLASH_ALGO_INIT         (DAP_TARGET_RAM_BASE + 0x40)
+#define FLASH_ALGO_SB           (DAP_TARGET_RAM_BASE + 0x400)
+#define FLASH_ALGO_SP           (DAP_TARGET_RAM_BASE + 0x800)
+#define FLASH_BUFFER_0          (DAP_TARGET_RAM_BASE + 0x1000)
+#define FLASH_BUFFER_1          (DAP_TARGET_RAM_BASE + 0x1100)
+#define FLASH_PAGE_SIZE         (0x100)
+#define FLASH_BASE              (DAP_TARGET_RAM_BASE + 0x2000)
+/* programming this page fails */
+#define FLASH_BAD_PAGE          (FLASH_BASE + 0x300)
+
+static uint32_t flash_pages;
+
+static bool flash_algo_call(uint32_t *regs) {
+    /* every call returns to the breakpoint, with the static base and stack set up */
+    zassert_equal(regs[14], FLASH_ALGO_BKPT | 0x01);
+    zassert_equal(regs[9], FLASH_ALGO_SB);
+    zassert_equal(regs[13], FLASH_ALGO_SP);
+
+    if (regs[15] == FLASH_ALGO_INIT) {
+        regs[0] = regs[0] + regs[1] + regs[2] + regs[3];
+    } else if (regs[15] == FLASH_ALGO_PROGRAM) {
+        zassert_equal(regs[1], FLASH_PAGE_SIZE);
+        zassert_true(regs[2] == FLASH_BUFFER_0 || regs[2] == FLASH_BUFFER_1);
+        uint8_t page[FLASH_PAGE_SIZE];
+        dap_target_mem_read(regs[2], page, FLASH_PAGE_SIZE);
+        dap_target_mem_write(regs[0], page, FLASH_PAGE_SIZE);
+        regs[0] = regs[0] == FLASH_BAD_PAGE ? 1 : 0;
+        flash_pages++;
+    } else {
+        zassert_unreachable("unknown algorithm function 0x%x", regs[15]);
+    }
+    return true;
+}
+
+/* sends image data, checking the status response */
+static void flash_data(const uint8_t *data, uint16_t len, const uint8_t *expected) {
+    uint8_t request[3 + 300];
+    uint8_t *response;
+    size_t response_len;
+    request[0] = 0x8e;
+    sys_put_le16(len, &request[1]);
+    memcpy(&request[3], data, len);
+    dap_transport_command(request, 3 + len, &response, &response_len);
+    zassert_equal(response_len, 12);
+    zassert_mem_equal(response, expected, 12);
+}
+
+ZTEST(dap, test_flash) {
+    uint8_t image[600];
+    uint8_t read[3 * FLASH_PAGE_SIZE];
+    for (uint16_t i = 0; i < sizeof(image); i++) {
+        image[i] = (uint8_t) (i * 11 + 1);
+    }
+
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    dap_target_start();
+    dap_target_core_set_call(flash_algo_call);
+    flash_pages = 0;
+
+    /* nothing runs before the runner is started */
+    assert_dap_command_expect("\x8d\x03", "\x8d\xff\x00\x01" "\x00\x00\x00\x00" "\x00\x00\x00\x00");
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+
+    /* a zero page size is rejected */
+    assert_dap_command_expect(
+        "\x8d\x01\x00\xff" "\x20\x00\x00\x20" "\x00\x04\x00\x20" "\x00\x08\x00\x20" "\x00\x00\x00\x20"
+        "\x00\x10\x00\x20" "\x00\x11\x00\x20" "\x00\x00\x00\x00" "\x00\x20\x00\x20" "\x64\x00\x00\x00",
+        "\x8d\xff\x00\x01"
+    );
+
+    /* starting halts the core */
+    assert_dap_command_expect(
+        "\x8d\x01\x00\xff" "\x20\x00\x00\x20" "\x00\x04\x00\x20" "\x00\x08\x00\x20" "\x00\x00\x00\x20"
+        "\x00\x10\x00\x20" "\x00\x11\x00\x20" "\x00\x01\x00\x00" "\x00\x20\x00\x20" "\x64\x00\x00\x00",
+        "\x8d\x00\x01\x01" "\x00\x00\x00\x00" "\x00\x20\x00\x20"
+    );
+    zassert_true(dap_target_core_halted());
+
+    /* init style calls return their result */
+    assert_dap_command_expect(
+        "\x8d\x02" "\x40\x00\x00\x20" "\x01\x00\x00\x00" "\x02\x00\x00\x00" "\x03\x00\x00\x00" "\x04\x00\x00\x00",
+        "\x8d\x00\x01\x01" "\x0a\x00\x00\x00" "\x00\x20\x00\x20"
+    );
+
+    /* pages are programmed as they fill */
+    flash_data(&image[0], 300, "\x8e\x00\x01\x01" "\x0a\x00\x00\x00" "\x00\x21\x00\x20");
+    zassert_equal(flash_pages, 1);
+    flash_data(&image[300], 300, "\x8e\x00\x01\x01" "\x0a\x00\x00\x00" "\x00\x22\x00\x20");
+    zassert_equal(flash_pages, 2);
+
+    /* and the last partial page is padded when flushed */
+    assert_dap_command_expect("\x8d\x03", "\x8d\x00\x01\x01" "\x0a\x00\x00\x00" "\x00\x23\x00\x20");
+    zassert_equal(flash_pages, 3);
+    dap_target_mem_read(FLASH_BASE, read, sizeof(read));
+    zassert_mem_equal(read, image, sizeof(image));
+    for (uint16_t i = sizeof(image); i < sizeof(read); i++) {
+        zassert_equal(read[i], 0xff);
+    }
+
+    /* a failed page is reported along with its address */
+    flash_data(image, 256, "\x8e\x00\x01\x01" "\x0a\x00\x00\x00" "\x00\x24\x00\x20");
+    assert_dap_command_expect("\x8d\x03", "\x8d\xff\x02\x01" "\x01\x00\x00\x00" "\x00\x23\x00\x20");
+    flash_data(image, 4, "\x8e\xff\x02\x01" "\x01\x00\x00\x00" "\x00\x23\x00\x20");
+
+    /* stopping clears the failure */
+    assert_dap_command_expect("\x8d\x00", "\x8d\x00\x00\x01" "\x00\x00\x00\x00");
+
+    dap_target_end();
+}
@@ -88,6 +88,12 @@ ZTEST(dap, test_delay) {
     elapsed = k_uptime_get_32() - start;
     zassert_between_inclusive(elapsed, 29, 31);
 
+    /* 500 uS delay, shorter than a kernel tick, isn't rounded up to one */
+    start = k_cycle_get_32();
+    assert_dap_command_expect("\x09\xf4\x01", "\x09\x00");
+    elapsed = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    zassert_between_inclusive(elapsed, 500, 600);
+
     /* incomplete command request */
     assert_dap_command_expect("\x09\x00", "\xff");
 }
@@ -198,6 +204,11 @@ ZTEST(dap, test_swj_pins) {
     assert_dap_command_expect("\x10\x00\x80\xff\xff\x00\x00", "\x10\x07");
     assert_gpio_emul_output_val(dap_io_nreset, 0);
     assert_dap_command_expect("\x10\x00\xff\xff\xff\x00\x00", "\x10\x00");
+    /* waiting on nRESET ends as soon as the pin reaches the driven level, not after the full second */
+    uint32_t start = k_uptime_get_32();
+    assert_dap_command_expect("\x10\x80\x80\x40\x42\x0f\x00", "\x10\x80");
+    zassert_true(k_uptime_get_32() - start <= 1);
+    assert_dap_command_expect("\x10\x00\xff\xff\xff\x00\x00", "\x10\x00");
 
     /* TDO pin */
     assert_gpio_emul_input_set(dap_io_tdo, 1);
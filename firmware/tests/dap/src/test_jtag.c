@@ -1,6 +1,8 @@
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/ztest.h>
 
 #include "dap_io.h"
+#include "dap_chain.h"
 #include "dap_emul.h"
 #include "dap_transport.h"
 #include "util/gpio.h"
@@ -29,6 +31,16 @@ ZTEST(dap, test_jtag_sequence) {
     assert_dap_emul_tms_swdio_out("\x00\xff");
     assert_dap_emul_tdi_out("\x55\xaa");
 
+    /* tdo capture across a word boundary, ending part way through a byte */
+    dap_emul_reset();
+    dap_emul_set_tdo_in("\x12\x34\x56\x78\x9a\xbc", 6);
+    assert_dap_command_expect(
+        "\x14\x01\xa5\x01\x02\x03\x04\x05",
+        "\x14\x00\x12\x34\x56\x78\x1a"
+    );
+    assert_dap_emul_clk_cycles(37);
+    assert_dap_emul_tdi_out("\x01\x02\x03\x04\x05");
+
     /* sequence length of 64 encoded as '0' */
     dap_emul_reset();
     assert_dap_command_expect(
@@ -56,8 +68,14 @@ ZTEST(dap, test_jtag_configure_idcode) {
     /* set tck clock frequency */
     assert_dap_command_expect("\x11\x20\x4e\x00\x00", "\x11\x00");
 
-    /* only support 4 devices in the jtag chain, more will be an error */
-    assert_dap_command_expect("\x15\x05\x01\x01\x01\x01\x01", "\x15\xff");
+    /* more devices in the jtag chain than supported will be an error */
+    uint8_t *response;
+    size_t response_len;
+    uint8_t configure[2 + CONFIG_DAP_JTAG_MAX_DEVICE_COUNT + 1] = {0x15, CONFIG_DAP_JTAG_MAX_DEVICE_COUNT + 1};
+    memset(&configure[2], 0x01, CONFIG_DAP_JTAG_MAX_DEVICE_COUNT + 1);
+    dap_transport_command(configure, sizeof(configure), &response, &response_len);
+    zassert_equal(response_len, 2);
+    zassert_mem_equal(response, "\x15\xff", 2);
 
     /* two devices in chain, first 4 bits, second 5 bits */
     assert_dap_command_expect("\x15\x02\x04\x05", "\x15\x00");
@@ -74,16 +92,18 @@ ZTEST(dap, test_jtag_configure_idcode) {
     /* 6 extra clock cycles to byte-align the tdo values above */
     assert_dap_command_expect("\x14\x01\x06\x00", "\x14\x00");
     assert_dap_command_expect("\x16\x00", "\x16\x00\x12\x34\x56\x78");
-    assert_dap_emul_clk_cycles(58);
+    /* the tap is left in update-dr, ready for another scan */
+    assert_dap_emul_clk_cycles(57);
     assert_dap_emul_tms_swdio_out("\xc0\x00\x2c\x00\x00\x00\x80\x01");
 
     /* idcode for further device indexes require extra */
     dap_emul_reset();
     dap_emul_set_tdo_in("\x00\x00\x00\x12\x34\x56\x78\x00", 8);
-    /* 5 extra clock cycles to byte-align the tdo values above */
-    assert_dap_command_expect("\x14\x01\x05\x00", "\x14\x00");
+    /* the sequence first returns the tap from update-dr to idle, then 4 extra clock cycles to byte-align the tdo
+     * values above */
+    assert_dap_command_expect("\x14\x01\x04\x00", "\x14\x00");
     assert_dap_command_expect("\x16\x01", "\x16\x00\x12\x34\x56\x78");
-    assert_dap_emul_clk_cycles(58);
+    assert_dap_emul_clk_cycles(57);
     /* shifted one bit from the previous example */
     assert_dap_emul_tms_swdio_out("\x60\x00\x16\x00\x00\x00\x80\x01");
 
@@ -91,14 +111,278 @@ ZTEST(dap, test_jtag_configure_idcode) {
     dap_emul_reset();
     assert_dap_command_expect("\x15\x03\x0a\x0b\x0c", "\x15\x00");
     dap_emul_set_tdo_in("\x00\x00\x00\x00\x00\x00\x12\x34\x56\x78\x00", 11);
-    /* 4 extra clock cycles to byte-align the tdo values above */
-    assert_dap_command_expect("\x14\x01\x04\x00", "\x14\x00");
+    /* 1 clock cycle back to idle, and 3 extra clock cycles to byte-align the tdo values above */
+    assert_dap_command_expect("\x14\x01\x03\x00", "\x14\x00");
     assert_dap_command_expect("\x16\x02", "\x16\x00\x12\x34\x56\x78");
     /* requires 24 cycles more than previous attempt, because additional tap length */
-    assert_dap_emul_clk_cycles(82);
+    assert_dap_emul_clk_cycles(81);
 
     /* incomplete command request */
     assert_dap_command_expect("\x15", "\xff");
     assert_dap_command_expect("\x15\x03\x04\x05", "\xff");
     assert_dap_command_expect("\x16", "\xff");
 }
+
+ZTEST(dap, test_vendor_jtag_detect) {
+    const struct dap_chain_tap taps[] = {
+        {.ir_length = 4, .ir_capture = 0x01, .idcode_ir = 0x0e, .idcode = 0x4ba00477},
+        {.ir_length = 5, .ir_capture = 0x01},
+        {.ir_length = 7, .ir_capture = 0x01, .idcode_ir = 0x01, .idcode = 0x0362d093},
+        /* captures a second '01' marker, so can't be told apart from two shorter devices */
+        {.ir_length = 6, .ir_capture = 0x11, .idcode_ir = 0x09, .idcode = 0x13631093},
+    };
+
+    /* only available on the JTAG port */
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+    assert_dap_command_expect("\x95", "\x95\xff\x00\x00\x00");
+    assert_dap_command_expect("\x02\x02", "\x02\x02");
+
+    /* a chain with clear instruction boundaries is found and configured, with the devices left in idle */
+    dap_chain_start(taps, 3);
+    
+    assert_dap_command_expect(
+        "\x95",
+        "\x95\x00\x03\x10\x00" "\x04\x77\x04\xa0\x4b" "\x05\x00\x00\x00\x00" "\x07\x93\xd0\x62\x03"
+    );
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_RUN_TEST_IDLE);
+    assert_dap_command_expect("\x16\x00", "\x16\x00\x77\x04\xa0\x4b");
+    zassert_equal(dap_chain_get_ir(0), 0x0e);
+    zassert_equal(dap_chain_get_ir(1), 0x1f);
+    zassert_equal(dap_chain_get_ir(2), 0x7f);
+    dap_chain_end();
+
+    /* when instruction lengths can't be worked out the devices are still listed, but nothing is configured */
+    dap_chain_start(taps, 4);
+    assert_dap_command_expect(
+        "\x95",
+        "\x95\xff\x04\x16\x00" "\x00\x77\x04\xa0\x4b" "\x00\x00\x00\x00\x00" "\x00\x93\xd0\x62\x03"
+        "\x00\x93\x10\x63\x13"
+    );
+    assert_dap_command_expect("\x16\x03", "\x16\xff");
+    dap_chain_end();
+
+    /* a single device with a longer instruction than supported is listed, but not configured */
+    const struct dap_chain_tap long_ir[] = {{.ir_length = 40, .ir_capture = 0x01}};
+    dap_chain_start(long_ir, 1);
+    assert_dap_command_expect("\x95", "\x95\xff\x01\x28\x00" "\x00\x00\x00\x00\x00");
+    dap_chain_end();
+
+    /* a chain which never returns data is an error */
+    assert_dap_command_expect("\x95", "\x95\xff\x00\x00\x00");
+}
+
+ZTEST(dap, test_jtag_tap_state) {
+    const struct dap_chain_tap taps[] = {
+        {.ir_length = 4, .ir_capture = 0x01, .idcode_ir = 0x0e, .idcode = 0x4ba00477},
+        {.ir_length = 5, .ir_capture = 0x01},
+    };
+
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    assert_dap_command_expect("\x02\x02", "\x02\x02");
+    assert_dap_command_expect("\x15\x02\x04\x05", "\x15\x00");
+
+    /* host resets the taps and moves them to idle */
+    dap_chain_start(taps, 2);
+    assert_dap_command_expect("\x12\x08\xff", "\x12\x00");
+    assert_dap_command_expect("\x14\x01\x01\x00", "\x14\x00");
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_RUN_TEST_IDLE);
+
+    /* the first idcode read shifts in the instruction, and the scan ends in update-dr */
+    assert_dap_command_expect("\x16\x00", "\x16\x00\x77\x04\xa0\x4b");
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_UPDATE_DR);
+    zassert_equal(dap_chain_get_ir(0), 0x0e);
+    zassert_equal(dap_chain_get_ir(1), 0x1f);
+
+    /* the next scan goes straight from there to shift-dr, 3 cycles, 32 cycles of data ending in exit-1-dr, then 1 to update-dr */
+    uint32_t tck_count = dap_chain_get_tck_count();
+    assert_dap_command_expect("\x16\x00", "\x16\x00\x77\x04\xa0\x4b");
+    zassert_equal(dap_chain_get_tck_count() - tck_count, 36);
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_UPDATE_DR);
+
+    /* host sequences first return the taps to idle */
+    tck_count = dap_chain_get_tck_count();
+    assert_dap_command_expect("\x14\x01\x01\x00", "\x14\x00");
+    zassert_equal(dap_chain_get_tck_count() - tck_count, 2);
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_RUN_TEST_IDLE);
+
+    /* a host sequence can stop part way to where the next one carries on */
+    assert_dap_command_expect("\x14\x01\x41\x00", "\x14\x00");
+    assert_dap_command_expect("\x14\x01\x02\x00", "\x14\x00");
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_SHIFT_DR);
+
+    /* a run of tms ones leaves the taps in test-logic-reset, which the next scan starts from */
+    assert_dap_command_expect("\x12\x08\xff", "\x12\x00");
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_TEST_LOGIC_RESET);
+    assert_dap_command_expect("\x16\x00", "\x16\x00\x77\x04\xa0\x4b");
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_UPDATE_DR);
+
+    /* driving only nreset doesn't clock the taps */
+    tck_count = dap_chain_get_tck_count();
+    assert_dap_command_expect("\x10\x80\x80\x00\x00\x00\x00", "\x10");
+    zassert_equal(dap_chain_get_tck_count(), tck_count);
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_UPDATE_DR);
+
+    dap_chain_end();
+}
+
+ZTEST(dap, test_vendor_jtag_idcodes) {
+    const struct dap_chain_tap taps[] = {
+        {.ir_length = 4, .ir_capture = 0x01, .idcode_ir = 0x0e, .idcode = 0x4ba00477},
+        /* no idcode register, so in bypass after reset */
+        {.ir_length = 3, .ir_capture = 0x01},
+        /* not an arm device, where the arm idcode instruction selects a private single bit register */
+        {.ir_length = 6, .ir_capture = 0x01, .idcode_ir = 0x09, .idcode = 0x0362d093, .stream_ir = 0x0e},
+        {.ir_length = 5, .ir_capture = 0x01, .idcode_ir = 0x0e, .idcode = 0x5ba00477},
+    };
+
+    /* only available on the JTAG port, with a configured chain */
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+    assert_dap_command_expect("\x96", "\x96\xff\x00");
+    assert_dap_command_expect("\x02\x02", "\x02\x02");
+    assert_dap_command_expect("\x15\x00", "\x15\x00");
+    assert_dap_command_expect("\x96", "\x96\xff\x00");
+    assert_dap_command_expect("\x15\x04\x04\x03\x06\x05", "\x15\x00");
+
+    /* every idcode comes back from the registers selected by reset, in one data scan */
+    dap_chain_start(taps, 4);
+    assert_dap_command_expect("\x12\x08\xff", "\x12\x00");
+    assert_dap_command_expect("\x14\x01\x01\x00", "\x14\x00");
+    assert_dap_command_expect(
+        "\x96",
+        "\x96\x00\x04" "\x77\x04\xa0\x4b" "\x00\x00\x00\x00" "\x93\xd0\x62\x03" "\x77\x04\xa0\x5b"
+    );
+    zassert_equal(dap_chain_get_ir(0), 0x0e);
+    zassert_equal(dap_chain_get_ir(1), 0x07);
+    zassert_equal(dap_chain_get_ir(2), 0x09);
+    zassert_equal(dap_chain_get_ir(3), 0x0e);
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_UPDATE_DR);
+
+    /* reading again is 3 cycles to test-logic-reset, 4 to shift-dr, 97 cycles of data, then 2 to update-dr */
+    uint32_t tck_count = dap_chain_get_tck_count();
+    assert_dap_command_expect(
+        "\x96",
+        "\x96\x00\x04" "\x77\x04\xa0\x4b" "\x00\x00\x00\x00" "\x93\xd0\x62\x03" "\x77\x04\xa0\x5b"
+    );
+    zassert_equal(dap_chain_get_tck_count() - tck_count, 106);
+
+    /* and single device accesses afterwards put the other devices back in bypass */
+    assert_dap_command_expect("\x16\x03", "\x16\x00\x77\x04\xa0\x5b");
+    zassert_equal(dap_chain_get_ir(0), 0x0f);
+    zassert_equal(dap_chain_get_ir(1), 0x07);
+    zassert_equal(dap_chain_get_ir(2), 0x3f);
+    zassert_equal(dap_chain_get_ir(3), 0x0e);
+
+    dap_chain_end();
+}
+
+ZTEST(dap, test_vendor_jtag_stream) {
+    const struct dap_chain_tap taps[] = {
+        {.ir_length = 4, .ir_capture = 0x01, .idcode_ir = 0x0e, .idcode = 0x4ba00477},
+        {.ir_length = 6, .ir_capture = 0x01, .stream_ir = 0x05},
+    };
+    /* three packets, with the last few bits of the last packet unused */
+    static uint8_t data[500 + 500 + 76];
+    const uint32_t bits = sizeof(data) * 8 - 3;
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i * 7 + 3;
+    }
+    uint8_t *response;
+    size_t response_len;
+
+    /* only available on the JTAG port, for a device on the chain */
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+    assert_dap_command_expect("\x99\x01\x05\x00\x00\x00\x10\x00\x00\x00", "\x99\xff");
+    assert_dap_command_expect("\x02\x02", "\x02\x02");
+    assert_dap_command_expect("\x15\x02\x04\x06", "\x15\x00");
+    assert_dap_command_expect("\x99\x02\x05\x00\x00\x00\x10\x00\x00\x00", "\x99\xff");
+
+    dap_chain_start(taps, 2);
+    assert_dap_command_expect("\x12\x08\xff", "\x12\x00");
+    assert_dap_command_expect("\x14\x01\x01\x00", "\x14\x00");
+
+    /* the stream is acknowledged once when started, then only after its last packet */
+    uint8_t start[] = {0x99, 0x01, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    sys_put_le32(bits, &start[6]);
+    dap_transport_command(start, sizeof(start), &response, &response_len);
+    zassert_equal(response_len, 2);
+    zassert_mem_equal(response, "\x99\x00", 2);
+    zassert_equal(dap_chain_get_ir(1), 0x05);
+    dap_transport_command(&data[0], 500, &response, &response_len);
+    zassert_equal(response_len, 0);
+    dap_transport_command(&data[500], 500, &response, &response_len);
+    zassert_equal(response_len, 0);
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_SHIFT_DR);
+    dap_transport_command(&data[1000], 76, &response, &response_len);
+    zassert_equal(response_len, 2);
+    zassert_mem_equal(response, "\x99\x00", 2);
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_UPDATE_DR);
+
+    /* every bit reached the device, without any leading bypass bits */
+    static uint8_t recorded[sizeof(data)];
+    zassert_equal(dap_chain_get_stream(recorded, sizeof(recorded)), bits);
+    zassert_mem_equal(recorded, data, sizeof(data) - 1);
+    zassert_equal(recorded[sizeof(data) - 1], data[sizeof(data) - 1] & 0x1f);
+
+    /* a stream sent more data than it asked for fails, and commands work again afterwards */
+    assert_dap_command_expect("\x99\x01\x05\x00\x00\x00\x10\x00\x00\x00", "\x99\x00");
+    dap_transport_command((uint8_t *) "\x12\x34\x56", 3, &response, &response_len);
+    zassert_equal(response_len, 2);
+    zassert_mem_equal(response, "\x99\xff", 2);
+    assert_dap_command_expect("\x16\x00", "\x16\x00\x77\x04\xa0\x4b");
+
+    dap_chain_end();
+}
+
+ZTEST(dap, test_vendor_jtag_stream_background) {
+    const struct dap_chain_tap taps[] = {
+        {.ir_length = 4, .ir_capture = 0x01, .dpacc_ir = 0x0a, .apacc_ir = 0x0b},
+        {.ir_length = 6, .ir_capture = 0x01, .stream_ir = 0x05},
+    };
+    static uint8_t data[500 + 100];
+    const uint32_t bits = sizeof(data) * 8;
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i * 5 + 1;
+    }
+    uint8_t *response;
+    size_t response_len;
+
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    dap_chain_start(taps, 2);
+    assert_dap_command_expect("\x02\x02", "\x02\x02");
+    assert_dap_command_expect("\x12\x08\xff", "\x12\x00");
+    assert_dap_command_expect("\x14\x01\x01\x00", "\x14\x00");
+    assert_dap_command_expect("\x15\x02\x04\x06", "\x15\x00");
+
+    /* an rtt search polling every 1ms, which would scan the first device if it ran */
+    assert_dap_command_expect(
+        "\x83\x01\x00" "\x00\x00\x00\x20" "\x00\x20\x00\x00" "\x00\x00" "\x01\x00",
+        "\x83\x00"
+    );
+
+    /* background polling waits while the stream is in progress, even when it is long overdue */
+    uint8_t start[] = {0x99, 0x01, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    sys_put_le32(bits, &start[6]);
+    dap_transport_command(start, sizeof(start), &response, &response_len);
+    zassert_mem_equal(response, "\x99\x00", 2);
+    dap_transport_command(&data[0], 500, &response, &response_len);
+    zassert_equal(response_len, 0);
+    k_sleep(K_MSEC(20));
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_SHIFT_DR);
+    zassert_equal(dap_chain_get_ir(1), 0x05);
+    dap_transport_command(&data[500], 100, &response, &response_len);
+    zassert_equal(response_len, 2);
+    zassert_mem_equal(response, "\x99\x00", 2);
+
+    static uint8_t recorded[sizeof(data)];
+    zassert_equal(dap_chain_get_stream(recorded, sizeof(recorded)), bits);
+    zassert_mem_equal(recorded, data, sizeof(data));
+
+    assert_dap_command_expect(
+        "\x83\x00\x00" "\x00\x00\x00\x00" "\x00\x00\x00\x00" "\x00\x00" "\x00\x00",
+        "\x83\x00"
+    );
+    dap_chain_end();
+}
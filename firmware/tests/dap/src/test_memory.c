@@ -0,0 +1,193 @@
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/ztest.h>
+
+#include "dap_io.h"
+#include "dap_target.h"
+#include "dap_transport.h"
+#include "util/gpio.h"
+
+ZTEST(dap, test_vendor_memory) {
+    uint8_t request[512];
+    uint8_t *response;
+    size_t response_len;
+    uint8_t pattern[300];
+    uint8_t read[300];
+    for (uint16_t i = 0; i < sizeof(pattern); i++) {
+        pattern[i] = (uint8_t) (i * 7 + 3);
+    }
+
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    dap_target_start();
+
+    /* nothing is accessed without a connected port */
+    assert_dap_command_expect("\x87\x00\x02" "\x00\x00\x00\x20" "\x04\x00\x00\x00", "\x87\xff\x00\x00");
+
+    /* host selects the ap identification register bank */
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+    assert_dap_command_expect("\x05\x00\x01" "\x08\xf0\x00\x00\x00", "\x05\x01\x01");
+
+    /* unaligned addresses and lengths for the access size are rejected */
+    assert_dap_command_expect("\x87\x00\x02" "\x02\x00\x00\x20" "\x04\x00\x00\x00", "\x87\xff\x00\x00");
+    assert_dap_command_expect("\x88\x00\x01" "\x00\x00\x00\x20" "\x03\x00" "\x01\x02\x03", "\x88\xff");
+    assert_dap_command_expect("\x87\x00\x03" "\x00\x00\x00\x20" "\x08\x00\x00\x00", "\x87\xff\x00\x00");
+
+    /* word write across a 1KiB transfer address boundary */
+    uint32_t addr = DAP_TARGET_RAM_BASE + 0x3f0;
+    request[0] = 0x88;
+    request[1] = 0x00;
+    request[2] = 0x02;
+    sys_put_le32(addr, &request[3]);
+    sys_put_le16(sizeof(pattern), &request[7]);
+    memcpy(&request[9], pattern, sizeof(pattern));
+    dap_transport_command(request, 9 + sizeof(pattern), &response, &response_len);
+    zassert_equal(response_len, 2);
+    zassert_mem_equal(response, "\x88\x01", 2);
+    dap_target_mem_read(addr, read, sizeof(pattern));
+    zassert_mem_equal(read, pattern, sizeof(pattern));
+
+    /* and read back the same way */
+    request[0] = 0x87;
+    sys_put_le32(sizeof(pattern), &request[7]);
+    dap_transport_command(request, 11, &response, &response_len);
+    zassert_equal(response_len, 4 + sizeof(pattern));
+    zassert_mem_equal(response, "\x87\x01\x2c\x01", 4);
+    zassert_mem_equal(&response[4], pattern, sizeof(pattern));
+
+    /* halfword writes and byte reads land on the right byte lanes */
+    assert_dap_command_expect("\x88\x00\x01" "\x02\x08\x00\x20" "\x06\x00" "\xa1\xa2\xa3\xa4\xa5\xa6", "\x88\x01");
+    dap_target_mem_read(DAP_TARGET_RAM_BASE + 0x800, read, 8);
+    zassert_mem_equal(&read[2], "\xa1\xa2\xa3\xa4\xa5\xa6", 6);
+    assert_dap_command_expect("\x87\x00\x00" "\x03\x08\x00\x20" "\x03\x00\x00\x00", "\x87\x01\x03\x00" "\xa2\xa3\xa4");
+
+    /* reads longer than a single response carry on in further responses, without any more requests */
+    uint8_t large[1200];
+    for (uint16_t i = 0; i < sizeof(large); i++) {
+        large[i] = (uint8_t) (i * 11 + 1);
+    }
+    dap_target_mem_write(DAP_TARGET_RAM_BASE + 0x1000, large, sizeof(large));
+    request[0] = 0x87;
+    sys_put_le32(DAP_TARGET_RAM_BASE + 0x1000, &request[3]);
+    sys_put_le32(sizeof(large), &request[7]);
+    dap_transport_command(request, 11, &response, &response_len);
+    zassert_equal(response_len, 512);
+    zassert_mem_equal(response, "\x87\x01\xfc\x01", 4);
+    zassert_mem_equal(&response[4], &large[0], 508);
+    dap_transport_response(&response, &response_len);
+    zassert_equal(response_len, 512);
+    zassert_mem_equal(response, "\x87\x01\xfc\x01", 4);
+    zassert_mem_equal(&response[4], &large[508], 508);
+    dap_transport_response(&response, &response_len);
+    zassert_equal(response_len, 4 + 184);
+    zassert_mem_equal(response, "\x87\x01\xb8\x00", 4);
+    zassert_mem_equal(&response[4], &large[1016], 184);
+
+    /* any other request ends a read still being sent, once a response already on its way is out */
+    dap_transport_command(request, 11, &response, &response_len);
+    zassert_mem_equal(response, "\x87\x01\xfc\x01", 4);
+    dap_transport_command("\x05\x00\x01" "\x0f", 4, &response, &response_len);
+    if (response[0] == 0x87) {
+        zassert_mem_equal(&response[4], &large[508], 508);
+        dap_transport_response(&response, &response_len);
+    }
+    zassert_equal(response_len, 7);
+    zassert_mem_equal(response, "\x05\x01\x01" "\x11\x00\x77\x24", 7);
+    dap_transport_response(&response, &response_len);
+    zassert_equal(response_len, 0);
+
+    /* the host's ap selection is still in place */
+    assert_dap_command_expect("\x05\x00\x01" "\x0f", "\x05\x01\x01" "\x11\x00\x77\x24");
+
+    /* unmapped memory reports the fault, and returns no data */
+    assert_dap_command_expect("\x87\x00\x02" "\x00\x00\x00\x10" "\x04\x00\x00\x00", "\x87\x04\x00\x00");
+    assert_dap_command_expect("\x08\x00" "\x1e\x00\x00\x00", "\x08\x00");
+
+    dap_target_end();
+}
+
+ZTEST(dap, test_vendor_memory_crc32) {
+    uint8_t *response;
+    size_t response_len;
+    uint8_t pattern[1024];
+    for (uint16_t i = 0; i < sizeof(pattern); i++) {
+        pattern[i] = (uint8_t) (i * 13 + 5);
+    }
+    dap_target_mem_write(DAP_TARGET_RAM_BASE + 0x1000, pattern, sizeof(pattern));
+    dap_target_mem_write(DAP_TARGET_RAM_BASE + 0x2000, "\x00\x00\x00\x00", 4);
+
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    dap_target_start();
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+
+    /* ranges and sectors must be word aligned */
+    assert_dap_command_expect(
+        "\x89\x00" "\x02\x10\x00\x20" "\x00\x04\x00\x00" "\x00\x00\x00\x00",
+        "\x89\xff\x00\x00"
+    );
+    assert_dap_command_expect(
+        "\x89\x00" "\x00\x10\x00\x20" "\x00\x04\x00\x00" "\x02\x01\x00\x00",
+        "\x89\xff\x00\x00"
+    );
+
+    /* crc of four zero bytes */
+    assert_dap_command_expect(
+        "\x89\x00" "\x00\x20\x00\x20" "\x04\x00\x00\x00" "\x00\x00\x00\x00",
+        "\x89\x01\x01\x00" "\x1c\xdf\x44\x21"
+    );
+
+    /* a single crc over the whole range */
+    uint8_t whole[] = {0x89, 0x00, 0x00, 0x10, 0x00, 0x20, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    dap_transport_command(whole, sizeof(whole), &response, &response_len);
+    zassert_equal(response_len, 8);
+    zassert_mem_equal(response, "\x89\x01\x01\x00", 4);
+    zassert_equal(sys_get_le32(&response[4]), crc32_ieee(pattern, sizeof(pattern)));
+
+    /* one crc per 256 byte sector, with a short last sector */
+    uint8_t sectors[] = {0x89, 0x00, 0x00, 0x10, 0x00, 0x20, 0x80, 0x03, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00};
+    dap_transport_command(sectors, sizeof(sectors), &response, &response_len);
+    zassert_equal(response_len, 4 + 4 * 4);
+    zassert_mem_equal(response, "\x89\x01\x04\x00", 4);
+    for (uint8_t i = 0; i < 3; i++) {
+        zassert_equal(sys_get_le32(&response[4 + i * 4]), crc32_ieee(&pattern[i * 256], 256));
+    }
+    zassert_equal(sys_get_le32(&response[16]), crc32_ieee(&pattern[768], 128));
+
+    dap_target_end();
+}
+
+ZTEST(dap, test_vendor_core_regs) {
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    dap_target_start();
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+
+    /* registers of a running core can't be accessed */
+    assert_dap_command_expect("\x8b\x00\x00" "\x07\x00\x00\x00", "\x8b\xff\x00");
+
+    /* halt the core */
+    assert_dap_command_expect("\x88\x00\x02" "\xf0\xed\x00\xe0" "\x04\x00" "\x03\x00\x5f\xa0", "\x88\x01");
+
+    /* selectors past the end of the register selector range are rejected */
+    assert_dap_command_expect("\x8b\x00\x70" "\x00\x00\x01\x00", "\x8b\xff\x00");
+    assert_dap_command_expect("\x8c\x00\x70" "\x00\x00\x01\x00" "\x01\x02\x03\x04", "\x8c\xff\x00");
+
+    /* write r0, r1, r2 and xpsr, then read them back along with r3 */
+    assert_dap_command_expect(
+        "\x8c\x00\x00" "\x07\x00\x01\x00" "\x10\x00\x00\x00" "\x11\x00\x00\x00" "\x12\x00\x00\x00" "\x00\x00\x00\x01",
+        "\x8c\x01\x04"
+    );
+    uint8_t request[] = {0x8b, 0x00, 0x00, 0x0f, 0x00, 0x01, 0x00};
+    uint8_t *response;
+    size_t response_len;
+    dap_transport_command(request, sizeof(request), &response, &response_len);
+    zassert_equal(response_len, 3 + 5 * 4);
+    zassert_mem_equal(
+        response,
+        "\x8b\x01\x05" "\x10\x00\x00\x00" "\x11\x00\x00\x00" "\x12\x00\x00\x00" "\x00\x00\x00\x00" "\x00\x00\x00\x01",
+        response_len
+    );
+
+    /* a register base offsets every bit of the bitmap */
+    assert_dap_command_expect("\x8b\x00\x02" "\x01\x00\x00\x00", "\x8b\x01\x01" "\x12\x00\x00\x00");
+
+    dap_target_end();
+}
@@ -0,0 +1,107 @@
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#include "dap_io.h"
+#include "dap_target.h"
+#include "dap_transport.h"
+#include "util/gpio.h"
+
+static const uint32_t pcsample_pcs[] = {0x08000100, 0x08000104, 0x08000200};
+
+/* reads pc samples from the probe, returning the number of entries, the total samples taken and the
+ * samples lost */
+static uint16_t pcsample_read(uint8_t **entries, uint32_t *samples, uint32_t *lost) {
+    uint8_t request[] = {0x86, 0x40, 0x00};
+    uint8_t *response;
+    size_t response_len;
+    dap_transport_command(request, sizeof(request), &response, &response_len);
+    zassert_true(response_len >= 12);
+    zassert_equal(response[0], 0x86);
+
+    uint16_t count = sys_get_le16(&response[2]);
+    *samples = sys_get_le32(&response[4]);
+    *lost = sys_get_le32(&response[8]);
+    *entries = &response[12];
+    return count;
+}
+
+ZTEST(dap, test_pcsample) {
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    dap_target_start();
+    dap_target_core_set_pcs(pcsample_pcs, ARRAY_SIZE(pcsample_pcs));
+
+    /* unknown sources and a zero sample interval are rejected */
+    assert_dap_command_expect("\x85\x01\x00\x02\x00" "\x64\x00\x00\x00", "\x85\xff");
+    assert_dap_command_expect("\x85\x01\x00\x00\x00" "\x00\x00\x00\x00", "\x85\xff");
+
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+
+    /* stream of pc sample register reads every 100us, which follow the core exactly */
+    assert_dap_command_expect("\x85\x01\x00\x00\x00" "\x64\x00\x00\x00", "\x85\x00");
+    uint32_t stream[6];
+    uint32_t stream_count = 0;
+    uint32_t samples = 0;
+    uint32_t lost = 0;
+    for (uint8_t i = 0; i < 50 && stream_count < ARRAY_SIZE(stream); i++) {
+        k_sleep(K_MSEC(1));
+        uint8_t *entries;
+        uint16_t count = pcsample_read(&entries, &samples, &lost);
+        for (uint16_t j = 0; j < count && stream_count < ARRAY_SIZE(stream); j++) {
+            stream[stream_count++] = sys_get_le32(&entries[j * 4]);
+        }
+    }
+    zassert_equal(stream_count, ARRAY_SIZE(stream));
+    for (uint8_t i = 0; i < ARRAY_SIZE(stream); i++) {
+        zassert_equal(stream[i], pcsample_pcs[i % ARRAY_SIZE(pcsample_pcs)]);
+    }
+
+    /* with nothing cached, each sample is a ctrl/stat check, a pipelined csw and tar save, the pcsr read with
+     * its own csw setup, and the restore of csw, tar and select */
+    uint8_t *entries;
+    uint32_t start_samples = 0;
+    pcsample_read(&entries, &start_samples, &lost);
+    uint32_t start_transfers = dap_target_get_transfer_count();
+    for (uint8_t i = 0; i < 50 && samples < start_samples + 4; i++) {
+        k_sleep(K_MSEC(1));
+        pcsample_read(&entries, &samples, &lost);
+    }
+    zassert_true(samples >= start_samples + 4);
+    zassert_equal(dap_target_get_transfer_count() - start_transfers, (samples - start_samples) * 17);
+
+    assert_dap_command_expect("\x85\x00\x00\x00\x00" "\x00\x00\x00\x00", "\x85\x00");
+    assert_dap_command_expect("\x86\x00\x00", "\x86\x00\x00\x00");
+
+    /* histogram of samples taken by halting the core, for cores without a pc sample register */
+    int64_t start = k_uptime_get();
+    assert_dap_command_expect("\x85\x01\x00\x01\x01" "\x64\x00\x00\x00", "\x85\x00");
+    samples = 0;
+    for (uint8_t i = 0; i < 50 && samples < 6; i++) {
+        k_sleep(K_MSEC(1));
+        /* a zero maximum count only reports the sample totals */
+        uint8_t request[] = {0x86, 0x00, 0x00};
+        uint8_t *response;
+        size_t response_len;
+        dap_transport_command(request, sizeof(request), &response, &response_len);
+        samples = sys_get_le32(&response[4]);
+    }
+    assert_dap_command_expect("\x85\x00\x00\x00\x00" "\x00\x00\x00\x00", "\x85\x00");
+    int64_t elapsed_ms = k_uptime_get() - start;
+    zassert_false(dap_target_core_halted());
+
+    uint16_t bins = pcsample_read(&entries, &samples, &lost);
+    zassert_equal(bins, ARRAY_SIZE(pcsample_pcs));
+    uint32_t total = 0;
+    for (uint16_t i = 0; i < bins; i++) {
+        uint32_t pc = sys_get_le32(&entries[i * 8]);
+        zassert_true(pc == pcsample_pcs[0] || pc == pcsample_pcs[1] || pc == pcsample_pcs[2]);
+        total += sys_get_le32(&entries[i * 8 + 4]);
+    }
+    zassert_equal(total, samples);
+    /* one sample is taken or lost for each due time, never a burst of them */
+    zassert_true(samples + lost <= (elapsed_ms + 1) * 10 + 1);
+
+    /* bins are emptied once read */
+    zassert_equal(pcsample_read(&entries, &samples, &lost), 0);
+
+    dap_target_end();
+}
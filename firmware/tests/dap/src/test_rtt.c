@@ -0,0 +1,119 @@
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#include "dap_io.h"
+#include "dap_target.h"
+#include "dap_transport.h"
+#include "util/gpio.h"
+
+int32_t dap_rtt_read(uint8_t *buf, size_t len, k_timeout_t timeout);
+int32_t dap_rtt_write(const uint8_t *buf, size_t len);
+
+/* control block placed across a search slice boundary, with one up and one down buffer */
+#define RTT_CB_ADDR     (DAP_TARGET_RAM_BASE + 0x0248)
+#define RTT_UP_ADDR     (DAP_TARGET_RAM_BASE + 0x1000)
+#define RTT_DOWN_ADDR   (DAP_TARGET_RAM_BASE + 0x1101)
+#define RTT_UP_SIZE     (64)
+#define RTT_DOWN_SIZE   (16)
+
+static void rtt_target_setup(void) {
+    uint8_t cb[72] = "SEGGER RTT";
+    /* one up buffer, one down buffer */
+    sys_put_le32(1, &cb[16]);
+    sys_put_le32(1, &cb[20]);
+    /* up buffer descriptor: name, buffer, size, write offset, read offset, flags */
+    sys_put_le32(RTT_UP_ADDR, &cb[28]);
+    sys_put_le32(RTT_UP_SIZE, &cb[32]);
+    /* down buffer descriptor */
+    sys_put_le32(RTT_DOWN_ADDR, &cb[52]);
+    sys_put_le32(RTT_DOWN_SIZE, &cb[56]);
+    dap_target_mem_write(RTT_CB_ADDR, cb, sizeof(cb));
+}
+
+static uint32_t rtt_target_get_le32(uint32_t addr) {
+    uint8_t word[4];
+    dap_target_mem_read(addr, word, 4);
+    return sys_get_le32(word);
+}
+
+static void rtt_target_put_le32(uint32_t addr, uint32_t value) {
+    uint8_t word[4];
+    sys_put_le32(value, word);
+    dap_target_mem_write(addr, word, 4);
+}
+
+ZTEST(dap, test_rtt) {
+    uint8_t read[64];
+    int32_t len = 0;
+
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    rtt_target_setup();
+    dap_target_start();
+
+    /* unaligned search ranges and a zero poll interval are rejected */
+    assert_dap_command_expect(
+        "\x83\x01\x00" "\x02\x00\x00\x20" "\x00\x20\x00\x00" "\x00\x00" "\x01\x00",
+        "\x83\xff"
+    );
+    assert_dap_command_expect(
+        "\x83\x01\x00" "\x00\x00\x00\x20" "\x00\x20\x00\x00" "\x00\x00" "\x00\x00",
+        "\x83\xff"
+    );
+
+    /* host selects ap 0 and sets up a transfer address, which the rtt poller must not disturb */
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+    assert_dap_command_expect(
+        "\x05\x00\x02" "\x08\x00\x00\x00\x00" "\x05\x10\x00\x00\x20",
+        "\x05\x02\x01"
+    );
+
+    /* search for the control block through the first 8KiB of ram, every 1ms */
+    assert_dap_command_expect(
+        "\x83\x01\x00" "\x00\x00\x00\x20" "\x00\x20\x00\x00" "\x00\x00" "\x01\x00",
+        "\x83\x00"
+    );
+
+    /* target writes to the up buffer, which wraps around the end */
+    dap_target_mem_write(RTT_UP_ADDR + RTT_UP_SIZE - 4, "hell", 4);
+    dap_target_mem_write(RTT_UP_ADDR, "o rtt", 5);
+    rtt_target_put_le32(RTT_CB_ADDR + 24 + 16, RTT_UP_SIZE - 4);
+    rtt_target_put_le32(RTT_CB_ADDR + 24 + 12, 5);
+    for (uint8_t i = 0; i < 50 && len < 9; i++) {
+        len += dap_rtt_read(&read[len], sizeof(read) - len, K_MSEC(10));
+    }
+    zassert_equal(len, 9);
+    zassert_mem_equal(read, "hello rtt", 9);
+    zassert_equal(rtt_target_get_le32(RTT_CB_ADDR + 24 + 16), 5);
+
+    /* host data goes to the down buffer, starting from an unaligned buffer address */
+    zassert_equal(dap_rtt_write("abcdef", 6), 6);
+    for (uint8_t i = 0; i < 50 && rtt_target_get_le32(RTT_CB_ADDR + 48 + 12) != 6; i++) {
+        k_sleep(K_MSEC(10));
+    }
+    zassert_equal(rtt_target_get_le32(RTT_CB_ADDR + 48 + 12), 6);
+    dap_target_mem_read(RTT_DOWN_ADDR, read, 6);
+    zassert_mem_equal(read, "abcdef", 6);
+
+    /* control block location and byte counts */
+    assert_dap_command_expect(
+        "\x84",
+        "\x84\x02" "\x48\x02\x00\x20" "\x09\x00\x00\x00" "\x06\x00\x00\x00"
+    );
+
+    /* the host transfer address is unchanged after all the polling */
+    assert_dap_command_expect("\x05\x00\x01" "\x07", "\x05\x01\x01" "\x10\x00\x00\x20");
+
+    /* stopping clears all state */
+    assert_dap_command_expect(
+        "\x83\x00\x00" "\x00\x00\x00\x00" "\x00\x00\x00\x00" "\x00\x00" "\x00\x00",
+        "\x83\x00"
+    );
+    assert_dap_command_expect("\x84", "\x84\x00" "\x00\x00\x00\x00");
+
+    /* host data with no down channel to go to is discarded, rather than filling up the buffer */
+    uint8_t down[2048] = {0};
+    zassert_equal(dap_rtt_write(down, sizeof(down)), sizeof(down));
+    zassert_equal(dap_rtt_write(down, sizeof(down)), sizeof(down));
+
+    dap_target_end();
+}
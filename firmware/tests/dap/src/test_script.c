@@ -0,0 +1,202 @@
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#include "dap_io.h"
+#include "dap_target.h"
+#include "dap_transport.h"
+#include "util/gpio.h"
+
+/* word the polling script waits on */
+#define SCRIPT_FLAG     (DAP_TARGET_RAM_BASE + 0x100)
+
+/* uploads a program at the given offset, checking the status response */
+static void script_upload(uint16_t offset, const uint8_t *program, uint16_t len, uint8_t status) {
+    uint8_t request[5 + 64];
+    uint8_t *response;
+    size_t response_len;
+    request[0] = 0x8f;
+    sys_put_le16(offset, &request[1]);
+    sys_put_le16(len, &request[3]);
+    memcpy(&request[5], program, len);
+    dap_transport_command(request, 5 + len, &response, &response_len);
+    zassert_equal(response_len, 2);
+    zassert_equal(response[0], 0x8f);
+    zassert_equal(response[1], status);
+}
+
+/* runs a script with the first three registers set, checking the whole response */
+static void script_run(
+    uint16_t entry,
+    uint32_t max_steps,
+    const uint32_t *regs,
+    const uint8_t *expected,
+    const uint32_t *expected_regs
+) {
+    uint8_t request[12 + 3 * 4];
+    uint8_t *response;
+    size_t response_len;
+    request[0] = 0x90;
+    sys_put_le16(entry, &request[1]);
+    sys_put_le32(max_steps, &request[3]);
+    sys_put_le32(1000, &request[7]);
+    request[11] = 3;
+    for (uint8_t i = 0; i < 3; i++) {
+        sys_put_le32(regs[i], &request[12 + i * 4]);
+    }
+    dap_transport_command(request, sizeof(request), &response, &response_len);
+    zassert_equal(response_len, 10 + 8 * 4);
+    zassert_mem_equal(response, expected, 10);
+    for (uint8_t i = 0; i < 3; i++) {
+        zassert_equal(sys_get_le32(&response[10 + i * 4]), expected_regs[i]);
+    }
+}
+
+ZTEST(dap, test_vendor_script) {
+    /* polls the flag word r2 times for the value 0x5a, failing with code 0x07 if it never shows up */
+    const uint8_t poll[] = {
+        /* 0x00 */ 0x24, 0x00, 0x00, 0x01,
+        /* 0x04 */ 0x11, 0x01, 0x5a, 0x00, 0x00, 0x00, 0x12, 0x00,
+        /* 0x0c */ 0x13, 0x02, 0x00, 0x00,
+        /* 0x10 */ 0x01, 0x07,
+        /* 0x12 */ 0x00,
+    };
+    /* reads the word at r0, retrying from the flag word if the read faults */
+    const uint8_t retry[] = {
+        /* 0x40 */ 0x14, 0x50, 0x00,
+        /* 0x43 */ 0x24, 0x00, 0x00, 0x01,
+        /* 0x47 */ 0x00,
+    };
+    const uint8_t recover[] = {
+        /* 0x50 */ 0x02, 0x00, 0x00, 0x01, 0x00, 0x20,
+        /* 0x56 */ 0x10, 0x43, 0x00,
+    };
+    /* waits for 10 seconds */
+    const uint8_t wait[] = {
+        /* 0x70 */ 0x31, 0x80, 0x96, 0x98, 0x00,
+        /* 0x75 */ 0x00,
+    };
+
+    dap_target_mem_write(SCRIPT_FLAG, "\x00\x00\x00\x00", 4);
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    dap_target_start();
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+
+    /* programs must fit in script memory */
+    script_upload(0x3f0, poll, sizeof(poll), 0xff);
+    script_upload(0x00, poll, sizeof(poll), 0x00);
+    script_upload(0x40, retry, sizeof(retry), 0x00);
+    script_upload(0x50, recover, sizeof(recover), 0x00);
+    script_upload(0x60, "\xee", 1, 0x00);
+    script_upload(0x70, wait, sizeof(wait), 0x00);
+
+    /* the flag never changes, so the script gives up on its own */
+    script_run(
+        0x00, 100, (uint32_t[]) {SCRIPT_FLAG, 0, 3},
+        "\x90\xff\x01\x07" "\x10\x00" "\x0a\x00\x00\x00", (uint32_t[]) {SCRIPT_FLAG, 0, 0}
+    );
+
+    /* a limited number of steps stops it earlier */
+    script_run(
+        0x00, 4, (uint32_t[]) {SCRIPT_FLAG, 0, 3},
+        "\x90\xff\x02\x00" "\x04\x00" "\x04\x00\x00\x00", (uint32_t[]) {SCRIPT_FLAG, 0, 2}
+    );
+
+    /* and once the flag is set the script ends successfully */
+    dap_target_mem_write(SCRIPT_FLAG, "\x5a\x00\x00\x00", 4);
+    script_run(
+        0x00, 100, (uint32_t[]) {SCRIPT_FLAG, 0, 3},
+        "\x90\x00\x00\x00" "\x12\x00" "\x03\x00\x00\x00", (uint32_t[]) {SCRIPT_FLAG, 0x5a, 3}
+    );
+
+    /* without a failure branch a faulting read stops the script */
+    script_run(
+        0x43, 100, (uint32_t[]) {0x10000000, 0, 0},
+        "\x90\xff\x04\x04" "\x43\x00" "\x01\x00\x00\x00", (uint32_t[]) {0x10000000, 0, 0}
+    );
+    assert_dap_command_expect("\x08\x00" "\x1e\x00\x00\x00", "\x08\x00");
+
+    /* with one the script recovers, and reports the last failed ack */
+    script_run(
+        0x40, 100, (uint32_t[]) {0x10000000, 0, 0},
+        "\x90\x00\x00\x04" "\x47\x00" "\x06\x00\x00\x00", (uint32_t[]) {SCRIPT_FLAG, 0x5a, 0}
+    );
+    assert_dap_command_expect("\x87\x00\x02" "\x00\x01\x00\x20" "\x04\x00\x00\x00", "\x87\x01\x04\x00" "\x5a\x00\x00\x00");
+
+    /* a long delay is cut short by the time limit of the run */
+    int64_t start = k_uptime_get();
+    script_run(
+        0x70, 100, (uint32_t[]) {0, 0, 0},
+        "\x90\xff\x03\x00" "\x70\x00" "\x01\x00\x00\x00", (uint32_t[]) {0, 0, 0}
+    );
+    zassert_true(k_uptime_get() - start < 2000);
+
+    /* unknown opcodes and a missing step limit are rejected */
+    script_run(
+        0x60, 100, (uint32_t[]) {0, 0, 0},
+        "\x90\xff\x05\x00" "\x60\x00" "\x01\x00\x00\x00", (uint32_t[]) {0, 0, 0}
+    );
+    script_run(
+        0x00, 0, (uint32_t[]) {0, 0, 0},
+        "\x90\xff\x05\x00" "\x00\x00" "\x00\x00\x00\x00", (uint32_t[]) {0, 0, 0}
+    );
+
+    dap_target_end();
+}
+
+ZTEST(dap, test_vendor_script_reset) {
+    /* pulses nreset, then resets through AIRCR with a reset vector catch, waiting until the core halts */
+    const uint8_t reset_halt[] = {
+        /* 0x80 */ 0x32, 0x00,
+        /* 0x82 */ 0x31, 0x64, 0x00, 0x00, 0x00,
+        /* 0x87 */ 0x32, 0x01,
+        /* 0x89 */ 0x33, 0x01, 0xe8, 0x03, 0x00, 0x00,
+        /* 0x8f */ 0x02, 0x00, 0xf0, 0xed, 0x00, 0xe0,
+        /* 0x95 */ 0x02, 0x01, 0x01, 0x00, 0x5f, 0xa0,
+        /* 0x9b */ 0x25, 0x00, 0x00, 0x01,
+        /* 0x9f */ 0x02, 0x00, 0xfc, 0xed, 0x00, 0xe0,
+        /* 0xa5 */ 0x02, 0x01, 0x01, 0x00, 0x00, 0x01,
+        /* 0xab */ 0x25, 0x00, 0x00, 0x01,
+        /* 0xaf */ 0x02, 0x00, 0x0c, 0xed, 0x00, 0xe0,
+        /* 0xb5 */ 0x02, 0x01, 0x04, 0x00, 0xfa, 0x05,
+        /* 0xbb */ 0x25, 0x00, 0x00, 0x01,
+        /* 0xbf */ 0x02, 0x00, 0xf0, 0xed, 0x00, 0xe0,
+        /* 0xc5 */ 0x24, 0x00, 0x00, 0x01,
+        /* 0xc9 */ 0x05, 0x01, 0x00, 0x00, 0x02, 0x00,
+        /* 0xcf */ 0x11, 0x01, 0x00, 0x00, 0x00, 0x00, 0xc5, 0x00,
+        /* 0xd7 */ 0x00,
+    };
+
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    dap_target_start();
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+
+    /* without a reset sequence, the host resets the target itself */
+    assert_dap_command_expect("\x0a", "\x0a\x00\x00");
+
+    script_upload(0x80, reset_halt, 0x40, 0x00);
+    script_upload(0xc0, &reset_halt[0x40], sizeof(reset_halt) - 0x40, 0x00);
+
+    /* sequences must start in script memory, and have both limits */
+    assert_dap_command_expect("\x9b\x00\x04" "\x64\x00\x00\x00" "\xe8\x03\x00\x00", "\x9b\xff");
+    assert_dap_command_expect("\x9b\x80\x00" "\x00\x00\x00\x00" "\xe8\x03\x00\x00", "\x9b\xff");
+    assert_dap_command_expect("\x9b\x80\x00" "\x64\x00\x00\x00" "\xe8\x03\x00\x00", "\x9b\x00");
+
+    /* a single command resets the target and leaves it halted on the reset vector */
+    zassert_false(dap_target_core_halted());
+    assert_dap_command_expect("\x0a", "\x0a\x00\x01");
+    zassert_true(dap_target_core_halted());
+    assert_gpio_emul_output_val(dap_io_nreset, 1);
+
+    /* a sequence that doesn't run to its end fails the reset */
+    assert_dap_command_expect("\x9b\x80\x00" "\x05\x00\x00\x00" "\xe8\x03\x00\x00", "\x9b\x00");
+    assert_dap_command_expect("\x0a", "\x0a\xff\x01");
+
+    /* and without an entry there is no sequence again */
+    assert_dap_command_expect("\x9b\xff\xff" "\x00\x00\x00\x00" "\x00\x00\x00\x00", "\x9b\x00");
+    assert_dap_command_expect("\x0a", "\x0a\x00\x00");
+
+    /* incomplete command request */
+    assert_dap_command_expect("\x9b\x80\x00" "\x64\x00\x00\x00", "\xff");
+
+    dap_target_end();
+}
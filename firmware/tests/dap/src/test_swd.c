@@ -2,6 +2,7 @@
 
 #include "dap_io.h"
 #include "dap_emul.h"
+#include "dap_target.h"
 #include "dap_transport.h"
 #include "util/gpio.h"
 
@@ -46,3 +47,66 @@ ZTEST(dap, test_swd_sequence) {
     assert_dap_command_expect("\x1d\x01\x08", "\xff");
     assert_dap_command_expect("\x1d\x03\x08\xff\x80", "\xff");
 }
+
+ZTEST(dap, test_vendor_swd_targetsel) {
+    const uint32_t ids[] = {0x01002927, 0x11002927};
+    uint8_t word[4];
+
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    dap_target_start();
+    dap_target_set_multidrop(ids, 2);
+    assert_dap_command_expect("\x8a\x01", "\x8a\x00\x00\x00\x00\x00");
+
+    /* only available on the SWD port */
+    assert_dap_command_expect("\x02\x02", "\x02\x02");
+    assert_dap_command_expect("\x9a\x27\x29\x00\x01", "\x9a\xff\x00\x00\x00\x00");
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+
+    /* nothing answers to an id that isn't on the bus */
+    assert_dap_command_expect("\x9a\x27\x29\x00\x21", "\x9a\xff\x00\x00\x00\x00");
+    zassert_equal(dap_target_get_drop(), -1);
+
+    /* select the first target, then its ap 0 bank 0, word size with single auto increment, and a transfer address */
+    assert_dap_command_expect("\x9a\x27\x29\x00\x01", "\x9a\x00\x77\x14\xa0\x2b");
+    zassert_equal(dap_target_get_drop(), 0);
+    assert_dap_command_expect(
+        "\x05\x00\x03" "\x08\x00\x00\x00\x00" "\x01\x12\x00\x00\x23" "\x05\x00\x01\x00\x20",
+        "\x05\x03\x01"
+    );
+
+    /* then the second target, with a different transfer address */
+    assert_dap_command_expect("\x9a\x27\x29\x00\x11", "\x9a\x00\x77\x14\xa0\x2b");
+    zassert_equal(dap_target_get_drop(), 1);
+    assert_dap_command_expect(
+        "\x05\x00\x03" "\x08\x00\x00\x00\x00" "\x01\x12\x00\x00\x23" "\x05\x00\x02\x00\x20",
+        "\x05\x03\x01"
+    );
+
+    /* back on the first target only SELECT has to be written again, its ap registers are still known */
+    assert_dap_command_expect("\x9a\x27\x29\x00\x01", "\x9a\x00\x77\x14\xa0\x2b");
+    zassert_equal(dap_target_get_drop(), 0);
+    uint32_t transfers = dap_target_get_transfer_count();
+    assert_dap_command_expect(
+        "\x05\x00\x04" "\x08\x00\x00\x00\x00" "\x01\x12\x00\x00\x23" "\x05\x00\x01\x00\x20" "\x0d\x44\x44\x44\x44",
+        "\x05\x04\x01"
+    );
+    zassert_equal(dap_target_get_transfer_count(), transfers + 3);
+    dap_target_mem_read(DAP_TARGET_RAM_BASE + 0x100, word, 4);
+    zassert_mem_equal(word, "\x44\x44\x44\x44", 4);
+
+    /* a raw sequence forgets every target, so selecting the second one again writes its ap registers as well */
+    assert_dap_command_expect("\x12\x08\xff", "\x12\x00");
+    assert_dap_command_expect("\x9a\x27\x29\x00\x11", "\x9a\x00\x77\x14\xa0\x2b");
+    transfers = dap_target_get_transfer_count();
+    assert_dap_command_expect(
+        "\x05\x00\x04" "\x08\x00\x00\x00\x00" "\x01\x12\x00\x00\x23" "\x05\x00\x02\x00\x20" "\x0d\x55\x55\x55\x55",
+        "\x05\x04\x01"
+    );
+    zassert_equal(dap_target_get_transfer_count(), transfers + 5);
+    dap_target_mem_read(DAP_TARGET_RAM_BASE + 0x200, word, 4);
+    zassert_mem_equal(word, "\x55\x55\x55\x55", 4);
+
+    /* only the first target's return skipped any writes */
+    assert_dap_command_expect("\x8a\x00", "\x8a\x00\x02\x00\x00\x00");
+    dap_target_end();
+}
@@ -1,5 +1,6 @@
 #include <pinctrl_soc.h>
 #include <zephyr/drivers/serial/uart_emul.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/ztest.h>
 
 #include "dap_io.h"
@@ -100,3 +101,217 @@ ZTEST(dap, test_swo) {
     assert_dap_command_expect("\x1e", "\xff");
     assert_dap_command_expect("\x1c\x00", "\xff");
 }
+
+/* reads swo data with timestamped chunk headers, returning the length of the first chunk, and the
+ * timestamp and dropped count in its header */
+static uint16_t swo_read_chunk(uint8_t *request, uint32_t *timestamp, uint32_t *dropped, uint8_t **data) {
+    uint8_t *resp;
+    size_t resp_len;
+    dap_transport_command(request, 3, &resp, &resp_len);
+    zassert_true(resp_len >= 14);
+    zassert_equal(resp[0], 0x1c);
+    *timestamp = sys_get_le32(&resp[4]);
+    *dropped = sys_get_le32(&resp[8]);
+    *data = &resp[14];
+    return sys_get_le16(&resp[12]);
+}
+
+ZTEST(dap, test_swo_overflow_policy) {
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+    assert_dap_command_expect("\x17\x01", "\x17\x00");
+    assert_dap_command_expect("\x18\x01", "\x18\x00");
+
+    /* invalid policies, flags, and watermarks aren't accepted */
+    assert_dap_command_expect("\x80\x02\x00\x00\x04\x00\x02", "\x80\xff");
+    assert_dap_command_expect("\x80\x00\x02\x00\x04\x00\x02", "\x80\xff");
+    assert_dap_command_expect("\x80\x00\x00\x01\x08\x00\x02", "\x80\xff");
+    assert_dap_command_expect("\x80\x00\x00\x00\x02\x00\x04", "\x80\xff");
+    /* overwrite oldest data, with watermarks of 1024 and 512 bytes */
+    assert_dap_command_expect("\x80\x01\x00\x00\x04\x00\x02", "\x80\x00");
+    assert_dap_command_expect("\x1a\x01", "\x1a\x00");
+    /* configuration can't change while capture is active */
+    assert_dap_command_expect("\x80\x00\x00\x00\x04\x00\x02", "\x80\xff");
+    assert_dap_command_expect("\x81", "\x81\x01\x00\x00\x00\x00\x00\x00\x00\x00");
+
+    /* reaching the high watermark sets the watermark status bit */
+    for (uint16_t i = 0; i < 1024; i++) { uart_emul_put_rx_data(dap_swo_uart, "\x55", 1); }
+    assert_dap_command_expect("\x81", "\x81\x03\x00\x04\x00\x00\x00\x00\x00\x00");
+    /* filling the buffer then writing more drops the oldest bytes */
+    for (uint16_t i = 0; i < 1024; i++) { uart_emul_put_rx_data(dap_swo_uart, "\x55", 1); }
+    uart_emul_put_rx_data(dap_swo_uart, "\x01\x02\x03\x04", 4);
+    assert_dap_command_expect("\x81", "\x81\x83\x00\x08\x00\x00\x04\x00\x00\x00");
+    /* the newest bytes are at the end of the buffer */
+    for (uint16_t i = 0; i < (2032 / 16); i++) {
+        assert_dap_command_expect(
+            "\x1c\x10\x00",
+            "\x1c\x81\x10\x00" "\x55\x55\x55\x55\x55\x55\x55\x55\x55\x55\x55\x55\x55\x55\x55\x55"
+        );
+    }
+    assert_dap_command_expect(
+        "\x1c\x10\x00",
+        "\x1c\x81\x10\x00" "\x55\x55\x55\x55\x55\x55\x55\x55\x55\x55\x55\x55\x01\x02\x03\x04"
+    );
+    /* draining below the low watermark clears the watermark status bit, but not the dropped count */
+    assert_dap_command_expect("\x81", "\x81\x81\x00\x00\x00\x00\x04\x00\x00\x00");
+
+    /* drop new data, with timestamped chunks */
+    assert_dap_command_expect("\x1a\x00", "\x1a\x00");
+    assert_dap_command_expect("\x80\x00\x01\x00\x06\x00\x02", "\x80\x00");
+    assert_dap_command_expect("\x1a\x01", "\x1a\x00");
+    assert_dap_command_expect("\x81", "\x81\x01\x00\x00\x00\x00\x00\x00\x00\x00");
+
+    /* an idle gap on the swo line starts a new chunk */
+    uart_emul_put_rx_data(dap_swo_uart, "\x01\x02\x03\x04\x05\x06\x07\x08", 8);
+    k_sleep(K_USEC(500));
+    uart_emul_put_rx_data(dap_swo_uart, "\x09\x0a\x0b\x0c", 4);
+    uint32_t first_timestamp, second_timestamp, dropped;
+    uint8_t *data;
+    /* the first chunk is split across responses when the host requests less data */
+    zassert_equal(swo_read_chunk("\x1c\x0e\x00", &first_timestamp, &dropped, &data), 4);
+    zassert_mem_equal(data, "\x01\x02\x03\x04", 4);
+    zassert_equal(dropped, 0);
+    zassert_equal(swo_read_chunk("\x1c\x0e\x00", &second_timestamp, &dropped, &data), 4);
+    zassert_mem_equal(data, "\x05\x06\x07\x08", 4);
+    zassert_equal(second_timestamp, first_timestamp);
+    zassert_equal(swo_read_chunk("\x1c\x40\x00", &second_timestamp, &dropped, &data), 4);
+    zassert_mem_equal(data, "\x09\x0a\x0b\x0c", 4);
+    zassert_true((second_timestamp - first_timestamp) >= 500);
+
+    /* bytes dropped from a full buffer are reported in the header of the next chunk */
+    for (uint16_t i = 0; i < 2048; i++) { uart_emul_put_rx_data(dap_swo_uart, "\x55", 1); }
+    uart_emul_put_rx_data(dap_swo_uart, "\x01\x02\x03\x04\x05\x06", 6);
+    assert_dap_command_expect("\x81", "\x81\x83\x00\x08\x00\x00\x06\x00\x00\x00");
+    uint16_t total = 0;
+    while (total < 2048) {
+        uint16_t len = swo_read_chunk("\x1c\xf4\x01", &first_timestamp, &dropped, &data);
+        zassert_equal(dropped, 0);
+        total += len;
+    }
+    zassert_equal(total, 2048);
+    uart_emul_put_rx_data(dap_swo_uart, "\x0a\x0b", 2);
+    zassert_equal(swo_read_chunk("\x1c\x40\x00", &second_timestamp, &dropped, &data), 2);
+    zassert_mem_equal(data, "\x0a\x0b", 2);
+    zassert_equal(dropped, 6);
+
+    /* restore the default configuration */
+    assert_dap_command_expect("\x1a\x00", "\x1a\x00");
+    assert_dap_command_expect("\x80\x00\x00\x00\x06\x00\x02", "\x80\x00");
+
+    /* incomplete command requests */
+    assert_dap_command_expect("\x80\x00\x00\x00\x06\x00", "\xff");
+}
+
+ZTEST(dap, test_swo_data_regions) {
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+    assert_dap_command_expect("\x17\x01", "\x17\x00");
+    assert_dap_command_expect("\x18\x01", "\x18\x00");
+    assert_dap_command_expect("\x1a\x01", "\x1a\x00");
+
+    /* move the swo buffer position near the end of the buffer */
+    for (uint16_t i = 0; i < 2040; i++) { uart_emul_put_rx_data(dap_swo_uart, "\x55", 1); }
+    for (uint16_t i = 0; i < (2040 / 8); i++) {
+        assert_dap_command_expect("\x1c\x08\x00", "\x1c\x01\x08\x00" "\x55\x55\x55\x55\x55\x55\x55\x55");
+    }
+    /* data that wraps around the end of the buffer is still returned in one response */
+    uart_emul_put_rx_data(
+        dap_swo_uart,
+        "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f\x10",
+        16
+    );
+    assert_dap_command_expect(
+        "\x1c\x10\x00",
+        "\x1c\x01\x10\x00" "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f\x10"
+    );
+    assert_dap_command_expect("\x1b", "\x1b\x01\x00\x00\x00\x00");
+
+    /* swo data followed by other commands in the same response */
+    uart_emul_put_rx_data(dap_swo_uart, "\x01\x02\x03\x04\x05\x06", 6);
+    assert_dap_command_expect(
+        "\x7f\x02\x1c\x04\x00\x1b",
+        "\x7f\x02\x1c\x01\x04\x00\x01\x02\x03\x04\x1b\x01\x02\x00\x00\x00"
+    );
+    /* and as the last of multiple commands */
+    assert_dap_command_expect(
+        "\x7f\x02\x1b\x1c\x04\x00",
+        "\x7f\x02\x1b\x01\x02\x00\x00\x00\x1c\x01\x02\x00\x05\x06"
+    );
+
+    /* a host asking for more than fits in one packet only gets what fits after the response header */
+    for (uint16_t i = 0; i < 1024; i++) { uart_emul_put_rx_data(dap_swo_uart, "\x55", 1); }
+    uint8_t *resp;
+    size_t resp_len;
+    dap_transport_command("\x1c\x00\x04", 3, &resp, &resp_len);
+    zassert_equal(resp_len, 512);
+    zassert_mem_equal(resp, "\x1c\x01\xfc\x01", 4);
+    dap_transport_command("\x1c\x00\x04", 3, &resp, &resp_len);
+    zassert_equal(resp_len, 512);
+    zassert_mem_equal(resp, "\x1c\x01\xfc\x01", 4);
+    assert_dap_command_expect("\x1c\x00\x04", "\x1c\x01\x08\x00" "\x55\x55\x55\x55\x55\x55\x55\x55");
+
+    assert_dap_command_expect("\x1a\x00", "\x1a\x00");
+}
+
+/* uart frames driven onto the swo line by a timer, one bit per timer period */
+static const uint8_t swo_line_bytes[] = {0x00, 0x55, 0xf0, 0x0f, 0x33, 0x81, 0xaa, 0x7e};
+static uint16_t swo_line_bit;
+static struct k_timer swo_line_timer;
+
+static void swo_line_timer_handler(struct k_timer *timer) {
+    /* each frame is a low start bit, 8 data bits lsb first, a high stop bit, then 2 idle bits */
+    uint8_t frame_bit = swo_line_bit % 12;
+    uint8_t byte = swo_line_bytes[(swo_line_bit / 12) % sizeof(swo_line_bytes)];
+    uint8_t level = 1;
+    if (frame_bit == 0) {
+        level = 0;
+    } else if (frame_bit <= 8) {
+        level = (byte >> (frame_bit - 1)) & 0x01;
+    }
+    gpio_emul_input_set(dap_io_tdo->port, dap_io_tdo->pin, level);
+    swo_line_bit++;
+}
+
+ZTEST(dap, test_swo_baudrate) {
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+    /* baudrate detection requires uart mode */
+    assert_dap_command_expect("\x18\x00", "\x18\x00");
+    assert_dap_command_expect("\x82\x0a\x00", "\x82\x00\x00\x00\x00");
+    assert_dap_command_expect("\x18\x01", "\x18\x00");
+
+    /* the 18.432MHz uart clock divides evenly into 115200 baud, so the rate is exact */
+    assert_dap_command_expect("\x19\x00\xc2\x01\x00", "\x19\x00\xc2\x01\x00");
+    /* 1MHz isn't possible, the closest generated rate is 1.152MHz */
+    assert_dap_command_expect("\x19\x40\x42\x0f\x00", "\x19\x00\x94\x11\x00");
+    /* rates above the uart clock divided by the oversampling can't be generated */
+    assert_dap_command_expect("\x19\x00\x84\x1e\x00", "\x19\x00\x00\x00\x00");
+
+    /* detection fails with no activity on the swo line */
+    assert_gpio_emul_input_set(dap_io_tdo, 1);
+    assert_dap_command_expect("\x82\x0a\x00", "\x82\x00\x00\x00\x00");
+
+    /* a target sending at 10000 baud, the closest generated rate is 10017 */
+    swo_line_bit = 0;
+    k_timer_init(&swo_line_timer, swo_line_timer_handler, NULL);
+    k_timer_start(&swo_line_timer, K_USEC(100), K_USEC(100));
+    assert_dap_command_expect("\x82\x64\x00", "\x82\x21\x27\x00\x00");
+    k_timer_stop(&swo_line_timer);
+    /* the tdo/swo pin is returned to the uart function */
+    assert_pinctrl_sim_func(2, SIM_PINMUX_FUNC_UART);
+
+    /* rates too fast to time edges of reliably aren't detected */
+    swo_line_bit = 0;
+    k_timer_start(&swo_line_timer, K_USEC(2), K_USEC(2));
+    assert_dap_command_expect("\x82\x64\x00", "\x82\x00\x00\x00\x00");
+    k_timer_stop(&swo_line_timer);
+
+    /* capture still works after detection */
+    assert_dap_command_expect("\x1a\x01", "\x1a\x00");
+    uart_emul_put_rx_data(dap_swo_uart, "\x01\x02", 2);
+    assert_dap_command_expect("\x1c\x04\x00", "\x1c\x01\x02\x00\x01\x02");
+    assert_dap_command_expect("\x1a\x00", "\x1a\x00");
+
+    /* incomplete command requests */
+    assert_dap_command_expect("\x82\x0a", "\xff");
+}
@@ -1,7 +1,10 @@
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/ztest.h>
 
 #include "dap_io.h"
+#include "dap_chain.h"
 #include "dap_emul.h"
+#include "dap_target.h"
 #include "dap_transport.h"
 #include "util/gpio.h"
 
@@ -53,27 +56,33 @@ ZTEST(dap, test_configure_transfer_jtag) {
     dap_emul_set_tdo_in("\x00\x40\x00\x80\x00\x00\x01\x00", 8);
     assert_dap_command_expect("\x05\x00\x01" "\x06", "\x05\x00\x02");
     assert_dap_emul_clk_cycles(62);
-    /* but succeed if limit isn't reached */
+    /* but succeed if limit isn't reached, the dpacc instruction is still held from the last command */
     dap_emul_reset();
-    dap_emul_set_tdo_in("\x00\x40\x00\x00\x01\x00\x00\x00\x00\x00\x05\x08\x0c\x10\x00\x00", 16);
+    dap_emul_set_tdo_in("\x08\x00\x20\x00\x00\x00\x00\x00\xa0\x00\x81\x01\x02\x00\x00", 15);
     assert_dap_command_expect("\x05\x00\x01" "\x06", "\x05\x01\x01" "\x01\x02\x03\x04");
-    assert_dap_emul_clk_cycles(124);
+    assert_dap_emul_clk_cycles(113);
 
     /* write to match mask and make sure a proper read matches */
     dap_emul_reset();
     dap_emul_set_tdo_in("\x00\x80\x00\x00\x00\x00\x00\x80\x02\x04\x06\x08\x00\x00", 14);
     assert_dap_command_expect("\x05\x00\x02" "\x20\xff\x00\xff\x00" "\x1f\x01\x00\x03\x00", "\x05\x02\x01");
     assert_dap_emul_clk_cycles(107);
-    /* incorrect matches will be retried up to limit (1) */
+    /* incorrect matches will be retried up to limit (1), the apacc instruction is still held */
     dap_emul_reset();
-    dap_emul_set_tdo_in("\x00\x80\x00\x00\x00\x00\x00\x80\x04\x04\x06\x08\x00\x80\x02\x04\x06\x08\x00\x00", 20);
+    dap_emul_set_tdo_in("\x10\x00\x00\x00\x00\x00\x90\x80\xc0\x00\x01\x00\x50\x80\xc0\x00\x01\x00\x00", 19);
     assert_dap_command_expect("\x05\x00\x02" "\x20\xff\x00\xff\x00" "\x1f\x01\x00\x03\x00", "\x05\x02\x01");
-    assert_dap_emul_clk_cycles(155);
+    assert_dap_emul_clk_cycles(144);
     /* incorrect matches above the limit will be an error */
     dap_emul_reset();
-    dap_emul_set_tdo_in("\x00\x80\x00\x00\x00\x00\x00\x80\x04\x04\x06\x08\x00\x80\x04\x04\x06\x08\x00\x00", 20);
+    dap_emul_set_tdo_in("\x10\x00\x00\x00\x00\x00\x90\x80\xc0\x00\x01\x00\x90\x80\xc0\x00\x01\x00\x00", 19);
     assert_dap_command_expect("\x05\x00\x02" "\x20\xff\x00\xff\x00" "\x1f\x01\x00\x03\x00", "\x05\x01\x11");
-    assert_dap_emul_clk_cycles(155);
+    assert_dap_emul_clk_cycles(144);
+    /* a raw jtag sequence could change the instruction, so it is shifted in again */
+    assert_dap_command_expect("\x14\x01\x01\x00", "\x14\x00");
+    dap_emul_reset();
+    dap_emul_set_tdo_in("\x00\x80\x00\x00\x00\x00\x00\x80\x02\x04\x06\x08\x00\x00", 14);
+    assert_dap_command_expect("\x05\x00\x02" "\x20\xff\x00\xff\x00" "\x1f\x01\x00\x03\x00", "\x05\x02\x01");
+    assert_dap_emul_clk_cycles(107);
 
     /* incomplete command request */
     assert_dap_command_expect("\x04", "\xff");
@@ -290,3 +299,216 @@ ZTEST(dap, test_transfer_write_abort) {
     assert_dap_command_expect("\x08", "\xff");
     assert_dap_command_expect("\x08\x04\x01", "\xff");
 }
+
+ZTEST(dap, test_transfer_cache) {
+    uint8_t word[4];
+
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    dap_target_start();
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+
+    /* unknown controls are rejected */
+    assert_dap_command_expect("\x8a\x02", "\x8a\xff\x00\x00\x00\x00");
+    assert_dap_command_expect("\x8a\x01", "\x8a\x00\x00\x00\x00\x00");
+
+    /* select ap 0 bank 0, word size with single auto increment, and a transfer address */
+    assert_dap_command_expect(
+        "\x05\x00\x03" "\x08\x00\x00\x00\x00" "\x01\x12\x00\x00\x23" "\x05\x00\x01\x00\x20",
+        "\x05\x03\x01"
+    );
+    uint32_t transfers = dap_target_get_transfer_count();
+
+    /* writing the same values again never reaches the target */
+    assert_dap_command_expect(
+        "\x05\x00\x03" "\x08\x00\x00\x00\x00" "\x01\x12\x00\x00\x23" "\x05\x00\x01\x00\x20",
+        "\x05\x03\x01"
+    );
+    zassert_equal(dap_target_get_transfer_count(), transfers);
+
+    /* the transfer address follows data writes, so rewinding it is sent but following it is not, each
+     * command also reads the buffer register to confirm its last write */
+    assert_dap_command_expect(
+        "\x05\x00\x04" "\x0d\x11\x11\x11\x11" "\x0d\x22\x22\x22\x22" "\x05\x08\x01\x00\x20"
+        "\x0d\x33\x33\x33\x33",
+        "\x05\x04\x01"
+    );
+    zassert_equal(dap_target_get_transfer_count(), transfers + 4);
+    dap_target_mem_read(DAP_TARGET_RAM_BASE + 0x108, word, 4);
+    zassert_mem_equal(word, "\x33\x33\x33\x33", 4);
+
+    /* an abort forgets everything, so the same select is sent again */
+    transfers = dap_target_get_transfer_count();
+    assert_dap_command_expect("\x05\x00\x02" "\x00\x1e\x00\x00\x00" "\x08\x00\x00\x00\x00", "\x05\x02\x01");
+    zassert_equal(dap_target_get_transfer_count(), transfers + 3);
+
+    /* as does a new connection */
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+    transfers = dap_target_get_transfer_count();
+    assert_dap_command_expect("\x05\x00\x01" "\x08\x00\x00\x00\x00", "\x05\x01\x01");
+    zassert_equal(dap_target_get_transfer_count(), transfers + 2);
+
+    /* disabling reports the number of skipped writes */
+    assert_dap_command_expect("\x8a\x00", "\x8a\x00\x04\x00\x00\x00");
+    transfers = dap_target_get_transfer_count();
+    assert_dap_command_expect("\x05\x00\x01" "\x08\x00\x00\x00\x00", "\x05\x01\x01");
+    zassert_equal(dap_target_get_transfer_count(), transfers + 2);
+
+    dap_target_end();
+}
+
+ZTEST(dap, test_transfer_match_timeout) {
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    dap_target_start();
+    dap_target_mem_write(DAP_TARGET_RAM_BASE + 0x200, "\x00\x00\x00\x00", 4);
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+
+    /* select ap 0 bank 0, word size without auto increment, and a transfer address */
+    assert_dap_command_expect(
+        "\x05\x00\x03" "\x08\x00\x00\x00\x00" "\x01\x02\x00\x00\x23" "\x05\x00\x02\x00\x20",
+        "\x05\x03\x01"
+    );
+
+    /* poll for at least 10ms, starting at 1ms between reads and backing off to at most 4ms, which is only
+     * a handful of reads */
+    assert_dap_command_expect("\x91" "\x10\x27\x00\x00" "\xe8\x03\x00\x00" "\xa0\x0f\x00\x00", "\x91\x00");
+    uint32_t transfers = dap_target_get_transfer_count();
+    int64_t start = k_uptime_get();
+    assert_dap_command_expect("\x05\x00\x02" "\x20\xff\x00\x00\x00" "\x1f\x5a\x00\x00\x00", "\x05\x01\x11");
+    zassert_true(k_uptime_get() - start >= 10);
+    zassert_true(dap_target_get_transfer_count() > transfers + 2);
+    zassert_true(dap_target_get_transfer_count() <= transfers + 7);
+
+    /* no sleep between reads is longer than the timeout, however long the host asks for */
+    assert_dap_command_expect("\x91" "\x10\x27\x00\x00" "\xff\xff\xff\xff" "\xff\xff\xff\xff", "\x91\x00");
+    start = k_uptime_get();
+    assert_dap_command_expect("\x05\x00\x01" "\x1f\x5a\x00\x00\x00", "\x05\x00\x11");
+    zassert_true(k_uptime_get() - start >= 10);
+    zassert_true(k_uptime_get() - start <= 30);
+
+    /* a value that is already there matches on the first read */
+    dap_target_mem_write(DAP_TARGET_RAM_BASE + 0x200, "\x5a\x00\x00\x00", 4);
+    transfers = dap_target_get_transfer_count();
+    assert_dap_command_expect("\x05\x00\x01" "\x1f\x5a\x00\x00\x00", "\x05\x01\x01");
+    zassert_equal(dap_target_get_transfer_count(), transfers + 2);
+
+    /* a zero timeout goes back to the retry count */
+    dap_target_mem_write(DAP_TARGET_RAM_BASE + 0x200, "\x00\x00\x00\x00", 4);
+    assert_dap_command_expect("\x91" "\x00\x00\x00\x00" "\x00\x00\x00\x00" "\x00\x00\x00\x00", "\x91\x00");
+    transfers = dap_target_get_transfer_count();
+    assert_dap_command_expect("\x05\x00\x01" "\x1f\x5a\x00\x00\x00", "\x05\x00\x11");
+    zassert_equal(dap_target_get_transfer_count(), transfers + 2);
+
+    dap_target_end();
+}
+
+ZTEST(dap, test_transfer_wait_backoff) {
+    uint8_t pattern[64];
+    uint8_t request[] = {0x87, 0x00, 0x02, 0x00, 0x03, 0x00, 0x20, 0x40, 0x00, 0x00, 0x00};
+    uint8_t *response;
+    size_t response_len;
+    for (uint8_t i = 0; i < sizeof(pattern); i++) {
+        pattern[i] = i * 3;
+    }
+
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    dap_target_start();
+    dap_target_mem_write(DAP_TARGET_RAM_BASE + 0x300, pattern, sizeof(pattern));
+    dap_target_set_ap_latency(300);
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+    /* 0 idle cycles, 100 wait retries, 0 match retry */
+    assert_dap_command_expect("\x04\x00\x64\x00\x00\x00", "\x04\x00");
+
+    /* without backoff every retry immediately follows the last */
+    assert_dap_command_expect("\x92\x00", "\x92\x00");
+    uint32_t waits = dap_target_get_wait_count();
+    dap_transport_command(request, sizeof(request), &response, &response_len);
+    zassert_equal(response_len, 4 + sizeof(pattern));
+    zassert_mem_equal(response, "\x87\x01\x40\x00", 4);
+    zassert_mem_equal(&response[4], pattern, sizeof(pattern));
+    uint32_t immediate = dap_target_get_wait_count() - waits;
+    zassert_true(immediate > 16 * 10);
+
+    /* the counters are reported once backoff is enabled */
+    dap_transport_command("\x92\x01", 2, &response, &response_len);
+    zassert_equal(response_len, 22);
+    zassert_mem_equal(response, "\x92\x00", 2);
+    zassert_equal(sys_get_le32(&response[2]), immediate);
+    zassert_equal(sys_get_le32(&response[6]), 0);
+
+    /* with it, retries wait about as long as the ap needed before */
+    waits = dap_target_get_wait_count();
+    dap_transport_command(request, sizeof(request), &response, &response_len);
+    zassert_equal(response_len, 4 + sizeof(pattern));
+    zassert_mem_equal(response, "\x87\x01\x40\x00", 4);
+    zassert_mem_equal(&response[4], pattern, sizeof(pattern));
+    uint32_t adaptive = dap_target_get_wait_count() - waits;
+    zassert_true(adaptive < immediate / 4);
+
+    /* along with the latency learned for ap 0 */
+    dap_transport_command("\x92\x01", 2, &response, &response_len);
+    zassert_equal(sys_get_le32(&response[2]), adaptive);
+    zassert_equal(response[10], 0x00);
+    zassert_true(sys_get_le16(&response[11]) > 100);
+
+    /* too few retries for the ap are counted as exhausted */
+    assert_dap_command_expect("\x04\x00\x01\x00\x00\x00", "\x04\x00");
+    assert_dap_command_expect("\x92\x00", "\x92\x00");
+    dap_transport_command(request, sizeof(request), &response, &response_len);
+    zassert_mem_equal(response, "\x87\x02", 2);
+    dap_transport_command("\x92\x01", 2, &response, &response_len);
+    zassert_equal(sys_get_le32(&response[6]), 1);
+
+    /* an ap slower than the longest backoff wait doesn't push the learned latency past it */
+    dap_target_set_ap_latency(20000);
+    assert_dap_command_expect("\x04\x00\x64\x00\x00\x00", "\x04\x00");
+    dap_transport_command("\x87\x00\x02" "\x00\x03\x00\x20" "\x04\x00\x00\x00", 11, &response, &response_len);
+    zassert_equal(response_len, 8);
+    zassert_mem_equal(response, "\x87\x01\x04\x00", 4);
+    dap_transport_command("\x92\x01", 2, &response, &response_len);
+    zassert_equal(sys_get_le16(&response[11]), 4096);
+
+    /* once the ap only needs a short wait, the learned latency decays all the way back down */
+    /* once the ap needs no more than the shortest wait, the learned latency decays all the way back down */
+    dap_target_set_ap_latency(70);
+    for (uint8_t i = 0; i < 20; i++) {
+        dap_transport_command("\x87\x00\x02" "\x00\x03\x00\x20" "\x04\x00\x00\x00", 11, &response, &response_len);
+    }
+    dap_target_set_ap_latency(60);
+    for (uint8_t i = 0; i < 40; i++) {
+        dap_transport_command("\x87\x00\x02" "\x00\x03\x00\x20" "\x04\x00\x00\x00", 11, &response, &response_len);
+        zassert_mem_equal(response, "\x87\x01\x04\x00", 4);
+    }
+    dap_transport_command("\x92\x01", 2, &response, &response_len);
+    zassert_equal(sys_get_le16(&response[11]), 0);
+
+    dap_target_end();
+}
+
+ZTEST(dap, test_transfer_jtag_wait) {
+    const struct dap_chain_tap taps[] = {
+        {.ir_length = 4, .ir_capture = 0x01, .idcode_ir = 0x0e, .idcode = 0x4ba00477,
+         .dpacc_ir = 0x0a, .apacc_ir = 0x0b, .acc_waits = 3, .acc_data = 0x12345678},
+    };
+    uint8_t *response;
+    size_t response_len;
+
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    assert_dap_command_expect("\x02\x02", "\x02\x02");
+    assert_dap_command_expect("\x15\x01\x04", "\x15\x00");
+    /* 0 idle cycles, so scans end in update-dr, 5 wait retries, 0 match retry */
+    assert_dap_command_expect("\x04\x00\x05\x00\x00\x00", "\x04\x00");
+    dap_transport_command((uint8_t*) "\x92\x01", 2, &response, &response_len);
+    zassert_mem_equal(response, "\x92\x00", 2);
+
+    /* host resets the tap and moves it to idle */
+    dap_chain_start(taps, 1);
+    assert_dap_command_expect("\x12\x08\xff", "\x12\x00");
+    assert_dap_command_expect("\x14\x01\x01\x00", "\x14\x00");
+
+    /* idling between retries goes back to run-test/idle first, rather than clocking towards test-logic-reset */
+    assert_dap_command_expect("\x05\x00\x01\x06", "\x05\x01\x01\x78\x56\x34\x12");
+    zassert_equal(dap_chain_get_ir(0), 0x0a);
+    zassert_equal(dap_chain_get_state(), DAP_CHAIN_UPDATE_DR);
+
+    dap_chain_end();
+}
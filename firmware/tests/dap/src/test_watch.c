@@ -0,0 +1,130 @@
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#include "dap_io.h"
+#include "dap_target.h"
+#include "dap_transport.h"
+#include "util/gpio.h"
+
+int32_t dap_watch_read(uint8_t channel, uint8_t *buf, size_t len, k_timeout_t timeout);
+void dap_watch_drop(uint32_t count);
+
+/* ram flag word the target changes */
+#define WATCH_FLAG      (DAP_TARGET_RAM_BASE + 0x200)
+
+/* waits for a number of events from the given channel */
+static int32_t watch_read_events(uint8_t channel, uint8_t *events, uint8_t count) {
+    int32_t len = 0;
+    for (uint8_t i = 0; i < 200 && len < count * 9; i++) {
+        len += dap_watch_read(channel, &events[len], count * 9 - len, K_MSEC(10));
+    }
+    return len;
+}
+
+ZTEST(dap, test_vendor_watch) {
+    uint8_t events[4 * 9];
+
+    assert_gpio_emul_input_set(dap_io_vtref, 1);
+    dap_target_mem_write(WATCH_FLAG, "\x00\x00\x00\x00", 4);
+    dap_target_start();
+
+    assert_dap_command_expect("\x02\x01", "\x02\x01");
+
+    /* bad indices, conditions and addresses are rejected, as is a zero interval */
+    assert_dap_command_expect(
+        "\x93\x01\x04\x00\x00" "\x00\x02\x00\x20" "\xff\xff\xff\xff" "\x00\x00\x00\x00",
+        "\x93\xff"
+    );
+    assert_dap_command_expect(
+        "\x93\x01\x00\x00\x03" "\x00\x02\x00\x20" "\xff\xff\xff\xff" "\x00\x00\x00\x00",
+        "\x93\xff"
+    );
+    assert_dap_command_expect(
+        "\x93\x01\x00\x00\x00" "\x02\x02\x00\x20" "\xff\xff\xff\xff" "\x00\x00\x00\x00",
+        "\x93\xff"
+    );
+    assert_dap_command_expect("\x93\x02\x00" "\x00\x00", "\x93\xff");
+
+    /* watch for the core halting, and for any change to the low byte of the flag word */
+    assert_dap_command_expect(
+        "\x93\x01\x00\x00\x00" "\xf0\xed\x00\xe0" "\x00\x00\x02\x00" "\x00\x00\x02\x00",
+        "\x93\x00"
+    );
+    assert_dap_command_expect(
+        "\x93\x01\x01\x00\x02" "\x00\x02\x00\x20" "\xff\x00\x00\x00" "\x00\x00\x00\x00",
+        "\x93\x00"
+    );
+    assert_dap_command_expect("\x93\x02\x00" "\x01\x00", "\x93\x00");
+
+    /* watches can't change while running */
+    assert_dap_command_expect(
+        "\x93\x01\x02\x00\x00" "\x00\x02\x00\x20" "\xff\xff\xff\xff" "\x00\x00\x00\x00",
+        "\x93\xff"
+    );
+
+    /* nothing has happened yet */
+    k_sleep(K_MSEC(100));
+    assert_dap_command_expect("\x94", "\x94\x01" "\x00\x00\x00\x00" "\x00");
+
+    /* halting the core raises a single event, however long it stays halted */
+    assert_dap_command_expect("\x88\x00\x02" "\xf0\xed\x00\xe0" "\x04\x00" "\x03\x00\x5f\xa0", "\x88\x01");
+    zassert_equal(watch_read_events(0, events, 1), 9);
+    zassert_equal(events[0], 0x00);
+    zassert_equal(sys_get_le32(&events[1]) & 0x00020000, 0x00020000);
+    k_sleep(K_MSEC(100));
+    zassert_equal(dap_watch_read(0, events, sizeof(events), K_NO_WAIT), 0);
+
+    /* host selects ap 0 and sets up a transfer address, which the watcher must not disturb */
+    assert_dap_command_expect(
+        "\x05\x00\x02" "\x08\x00\x00\x00\x00" "\x05\x10\x00\x00\x20",
+        "\x05\x02\x01"
+    );
+
+    /* every change of the flag is an event, changes outside the mask are not */
+    dap_target_mem_write(WATCH_FLAG, "\x00\x01\x00\x00", 4);
+    k_sleep(K_MSEC(100));
+    zassert_equal(dap_watch_read(0, events, sizeof(events), K_NO_WAIT), 0);
+    dap_target_mem_write(WATCH_FLAG, "\x01\x01\x00\x00", 4);
+    zassert_equal(watch_read_events(0, events, 1), 9);
+    dap_target_mem_write(WATCH_FLAG, "\x02\x01\x00\x00", 4);
+    zassert_equal(watch_read_events(0, &events[9], 1), 9);
+    zassert_mem_equal(events, "\x01" "\x01\x00\x00\x00", 5);
+    zassert_mem_equal(&events[9], "\x01" "\x02\x00\x00\x00", 5);
+    zassert_true(sys_get_le32(&events[14]) >= sys_get_le32(&events[5]));
+
+    /* events aren't delivered to a channel that wasn't selected */
+    dap_target_mem_write(WATCH_FLAG, "\x03\x00\x00\x00", 4);
+    zassert_equal(watch_read_events(2, events, 1), 0);
+    zassert_equal(watch_read_events(0, events, 1), 9);
+    zassert_mem_equal(events, "\x01" "\x03\x00\x00\x00", 5);
+
+    /* the host transfer address is unchanged after all the polling */
+    assert_dap_command_expect("\x05\x00\x01" "\x07", "\x05\x01\x01" "\x10\x00\x00\x20");
+
+    /* a sticky error from a host access is left for the host to find, the watches wait until it is cleared */
+    uint8_t *response;
+    size_t response_len;
+    dap_transport_command((uint8_t *) "\x05\x00\x02" "\x05\x00\x00\x00\x00" "\x0f", 9, &response, &response_len);
+    dap_target_mem_write(WATCH_FLAG, "\x04\x00\x00\x00", 4);
+    k_sleep(K_MSEC(100));
+    zassert_equal(dap_watch_read(0, events, sizeof(events), K_NO_WAIT), 0);
+    dap_transport_command((uint8_t *) "\x05\x00\x01" "\x06", 4, &response, &response_len);
+    zassert_equal(response_len, 7);
+    zassert_equal(sys_get_le32(&response[3]) & 0x20, 0x20);
+    assert_dap_command_expect("\x94", "\x94\x01" "\x00\x00\x00\x00" "\x00");
+    assert_dap_command_expect("\x08\x00" "\x1e\x00\x00\x00", "\x08\x00");
+    zassert_equal(watch_read_events(0, events, 1), 9);
+    zassert_mem_equal(events, "\x01" "\x04\x00\x00\x00", 5);
+
+    /* events a channel read but couldn't deliver are counted as dropped */
+    dap_watch_drop(2);
+    assert_dap_command_expect("\x94", "\x94\x01" "\x02\x00\x00\x00" "\x00");
+
+    /* stopping clears all state */
+    assert_dap_command_expect("\x93\x00", "\x93\x00");
+    dap_target_mem_write(WATCH_FLAG, "\x05\x00\x00\x00", 4);
+    k_sleep(K_MSEC(20));
+    assert_dap_command_expect("\x94", "\x94\x00" "\x00\x00\x00\x00" "\x00");
+
+    dap_target_end();
+}
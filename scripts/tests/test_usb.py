@@ -61,6 +61,22 @@ def test_io_interface_descirptor(usb_device):
     assert(in_ep is not None)
     assert((in_ep.bEndpointAddress & 0x80 == 0x80) and (in_ep.bmAttributes == 0x02))
 
+def test_dap_event_interface_descirptor(usb_device):
+    intf = usb.util.find_descriptor(
+        usb_device.get_active_configuration(),
+        custom_match=lambda i : usb.util.get_string(usb_device, i.iInterface) == 'Rice DAP Events v1'
+    )
+
+    assert(intf is not None)
+    assert(intf.bNumEndpoints == 0x01)
+    # vendor specific device
+    assert(intf.bInterfaceClass == 0xFF)
+    assert(intf.bInterfaceSubClass == 0x00)
+    assert(intf.bInterfaceProtocol == 0x00)
+    # interrupt in endpoint
+    (in_ep,) = intf.endpoints()
+    assert((in_ep.bEndpointAddress & 0x80 == 0x80) and (in_ep.bmAttributes == 0x03))
+
 def test_vcp_interface_descriptor(usb_device):
     comm_intf = usb.util.find_descriptor(
         usb_device.get_active_configuration(),